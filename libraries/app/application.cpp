@@ -31,6 +31,7 @@
 
 #include <muse/egenesis/egenesis.hpp>
 
+#include <graphene/net/config.hpp>
 #include <graphene/net/core_messages.hpp>
 #include <graphene/net/exceptions.hpp>
 
@@ -42,13 +43,18 @@
 #include <fc/rpc/api_connection.hpp>
 #include <fc/rpc/websocket_api.hpp>
 #include <fc/network/resolve.hpp>
+#include <fc/thread/thread.hpp>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/signals2.hpp>
 #include <boost/range/algorithm/reverse.hpp>
 
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
 
 #include <fc/log/file_appender.hpp>
 #include <fc/log/logger.hpp>
@@ -84,6 +90,19 @@ namespace detail {
       bool _is_block_producer = false;
       bool _force_validate = false;
 
+      /** A copy of a sync block with its memoized ids, merkle root and signee */
+      struct prevalidated_block
+      {
+         explicit prevalidated_block( const signed_block& b ) : block( b ), precomputed( block ) {}
+         prevalidated_block( const prevalidated_block& ) = delete;
+
+         const signed_block              block;
+         const chain::precomputed_block  precomputed;
+      };
+      typedef std::shared_ptr<prevalidated_block> prevalidated_block_ptr;
+
+      static const size_t max_prevalidated_blocks = 4000;
+
       void reset_p2p_node(const fc::path& data_dir)
       { try {
          _p2p_network = std::make_shared<graphene::net::node>("Graphene Reference Implementation");
@@ -91,6 +110,24 @@ namespace detail {
          _p2p_network->load_configuration(data_dir / "p2p");
          _p2p_network->set_node_delegate(this);
 
+         if( _options->count("sync-from-state-snapshot") && _options->at("sync-from-state-snapshot").as<bool>() )
+         {
+            if( _chain_db->head_block_num() == 0 )
+            {
+               fc::optional<block_id_type> expected_block_id;
+               if( _options->count("state-snapshot-block-id") )
+                  expected_block_id = block_id_type( _options->at("state-snapshot-block-id").as<string>() );
+               // a snapshot replaces all balances and witnesses, it must not be taken on the word of a peer
+               FC_ASSERT( _options->count("state-snapshot-hash"),
+                          "sync-from-state-snapshot requires state-snapshot-hash, the hash of a snapshot from a node you trust" );
+               const fc::sha256 expected_hash( _options->at("state-snapshot-hash").as<string>() );
+               ilog( "Downloading a state snapshot from peers before syncing blocks" );
+               _p2p_network->sync_from_state_snapshot( expected_block_id, expected_hash );
+            }
+            else
+               ilog( "Not syncing from a state snapshot, the blockchain already has blocks" );
+         }
+
          vector<string> seeds;
          if( _options->count("seed-node") )
             seeds = _options->at("seed-node").as<vector<string>>();
@@ -294,9 +331,29 @@ namespace detail {
          if( _options->count("replay-blockchain") )
             _chain_db->wipe( _data_dir / "blockchain", false );
 
+         if( _options->count("block-log-mmap") )
+            _chain_db->set_block_log_mmap( _options->at("block-log-mmap").as<bool>() );
+         if( _options->count("block-log-compression") )
+            _chain_db->set_block_log_compression( _options->at("block-log-compression").as<bool>() );
+         if( _options->count("replay-threads") )
+            _chain_db->set_replay_threads( _options->at("replay-threads").as<uint32_t>() );
+         if( _options->count("signature-threads") )
+            _chain_db->set_signature_threads( _options->at("signature-threads").as<uint32_t>() );
+         _prevalidation_threads = std::max( std::thread::hardware_concurrency(), 2u ) - 1;
+         if( _options->count("sync-prevalidation-threads") )
+            _prevalidation_threads = _options->at("sync-prevalidation-threads").as<uint32_t>();
+         if( _options->count("signature-cache-size") )
+            _chain_db->set_signature_cache_size( _options->at("signature-cache-size").as<uint32_t>() );
+         if( _options->count("state-checkpoint-interval") )
+            _chain_db->set_state_checkpoint_interval( _options->at("state-checkpoint-interval").as<uint32_t>() );
+         if( _options->count("state-snapshot-interval") )
+            _chain_db->set_state_snapshot_interval( _options->at("state-snapshot-interval").as<uint32_t>(),
+                                                    GRAPHENE_NET_STATE_SNAPSHOT_CHUNK_SIZE );
+
          try
          {
-            _chain_db->open( _data_dir / "blockchain", initial_state(), GRAPHENE_CURRENT_DB_VERSION );
+            _initial_state = initial_state();
+            _chain_db->open( _data_dir / "blockchain", _initial_state, GRAPHENE_CURRENT_DB_VERSION );
          }
          catch( const fc::exception& e )
          {
@@ -412,6 +469,7 @@ namespace detail {
       virtual bool handle_block(const graphene::net::block_message& blk_msg, bool sync_mode,
                                 std::vector<fc::uint160_t>& contained_transaction_message_ids) override
       { try {
+         prevalidated_block_ptr prevalidated = take_prevalidated_block( blk_msg );
 
          if (sync_mode && blk_msg.block.block_num() % 10000 == 0)
          {
@@ -431,7 +489,9 @@ namespace detail {
             // you can help the network code out by throwing a block_older_than_undo_history exception.
             // when the net code sees that, it will stop trying to push blocks from that chain, but
             // leave that peer connected so that they can get sync blocks from us
-            bool result = _chain_db->push_block(blk_msg.block, (_is_block_producer | _force_validate) ? database::skip_nothing : database::skip_transaction_signatures);
+            const uint32_t skip = (_is_block_producer | _force_validate) ? database::skip_nothing : database::skip_transaction_signatures;
+            bool result = prevalidated ? _chain_db->push_block(prevalidated->precomputed, skip)
+                                       : _chain_db->push_block(blk_msg.block, skip);
 
             if( !sync_mode )
             {
@@ -461,6 +521,64 @@ namespace detail {
          }
       } FC_CAPTURE_AND_RETHROW( (blk_msg)(sync_mode) ) }
 
+      /**
+       * Hashes the transactions, the merkle root and recovers the witness signature of a sync block
+       * on a worker thread, so that handle_block only has to compare them.  Called from the p2p thread.
+       * The workers are started with the first sync block, nodes that are in sync never start them.
+       */
+      virtual void prevalidate_block(const graphene::net::block_message& blk_msg) override
+      {
+         if( _prevalidation_threads == 0 )
+            return;
+         while( _prevalidation_workers.size() < _prevalidation_threads )
+            _prevalidation_workers.emplace_back( new fc::thread( "prevalidate_" + fc::to_string( uint64_t(_prevalidation_workers.size()) ) ) );
+
+         std::lock_guard<std::mutex> lock( _prevalidated_blocks_mutex );
+         if( _prevalidated_blocks.size() >= max_prevalidated_blocks || _prevalidated_blocks.count( blk_msg.block_id ) )
+            return;
+         auto block = std::make_shared<prevalidated_block>( blk_msg.block );
+         fc::thread& worker = *_prevalidation_workers[ _next_prevalidation_worker++ % _prevalidation_workers.size() ];
+         _prevalidated_blocks[ blk_msg.block_id ] = worker.async( [block]() {
+            block->precomputed.precompute();
+            return block;
+         }, "prevalidate_block" );
+      }
+
+      /**
+       * Removes and returns the prevalidated copy of the block, or null if there is none.  Entries
+       * for this and lower block numbers are dropped, they belong to blocks that were already applied
+       * or to forks that were not.
+       */
+      prevalidated_block_ptr take_prevalidated_block(const graphene::net::block_message& blk_msg)
+      {
+         fc::future<prevalidated_block_ptr> pending;
+         {
+            std::lock_guard<std::mutex> lock( _prevalidated_blocks_mutex );
+            auto itr = _prevalidated_blocks.find( blk_msg.block_id );
+            if( itr != _prevalidated_blocks.end() )
+               pending = itr->second;
+            const uint32_t block_num = blk_msg.block.block_num();
+            for( itr = _prevalidated_blocks.begin(); itr != _prevalidated_blocks.end(); )
+            {
+               if( block_header::num_from_id( itr->first ) <= block_num )
+                  itr = _prevalidated_blocks.erase( itr );
+               else
+                  ++itr;
+            }
+         }
+         if( !pending.valid() )
+            return prevalidated_block_ptr();
+         try
+         {
+            return pending.wait();
+         }
+         catch( const fc::exception& e )
+         {
+            wlog( "Prevalidation of block ${id} failed: ${e}", ("id", blk_msg.block_id)("e", e.to_detail_string()) );
+         }
+         return prevalidated_block_ptr();
+      }
+
       virtual void handle_transaction(const graphene::net::trx_message& transaction_message) override
       { try {
          _chain_db->push_transaction( transaction_message.trx );
@@ -552,6 +670,15 @@ namespace detail {
          return trx_message( _chain_db->get_recent_transaction( id.item_hash ) );
       } FC_CAPTURE_AND_RETHROW( (id) ) }
 
+      virtual std::vector<fc::optional<chain::signed_transaction>> get_transactions( const std::vector<chain::transaction_id_type>& ids ) override
+      { try {
+         std::vector<fc::optional<chain::signed_transaction>> result;
+         result.reserve( ids.size() );
+         for( const auto& id : ids )
+            result.push_back( _chain_db->find_recent_transaction( id ) );
+         return result;
+      } FC_CAPTURE_AND_RETHROW( (ids.size()) ) }
+
       /**
        * Returns a synopsis of the blockchain used for syncing.  This consists of a list of
        * block hashes at intervals exponentially increasing towards the genesis block.
@@ -789,6 +916,53 @@ namespace detail {
          // notify GUI or something cool
       }
 
+      virtual graphene::net::state_snapshot_manifest_message get_state_snapshot_manifest() override
+      { try {
+         const chain::state_snapshot_info& info = _chain_db->get_state_snapshot_info();
+         if( info.block_num == 0 )
+            return graphene::net::state_snapshot_manifest_message();
+
+         // hashed by the database when it wrote the snapshot
+         graphene::net::state_snapshot_manifest_message manifest;
+         manifest.block_id = info.block_id;
+         manifest.size = info.size;
+         manifest.hash = info.hash;
+         manifest.chunk_size = info.chunk_size;
+         manifest.chunk_hashes = info.chunk_hashes;
+         return manifest;
+      } FC_CAPTURE_AND_RETHROW() }
+
+      virtual std::vector<char> get_state_snapshot_chunk(const block_id_type& block_id, uint32_t chunk_index) override
+      { try {
+         const chain::state_snapshot_info& info = _chain_db->get_state_snapshot_info();
+         FC_ASSERT( info.block_num != 0 && info.block_id == block_id, "We no longer offer the state snapshot at this block" );
+         const uint64_t offset = uint64_t( chunk_index ) * info.chunk_size;
+         FC_ASSERT( offset < info.size, "Chunk is beyond the end of the state snapshot" );
+
+         std::vector<char> chunk( size_t( std::min<uint64_t>( info.chunk_size, info.size - offset ) ) );
+         std::ifstream in( info.file.string().c_str(), std::ios::in | std::ios::binary );
+         in.seekg( offset );
+         in.read( chunk.data(), chunk.size() );
+         FC_ASSERT( in, "Unable to read the state snapshot ${f}", ("f",info.file) );
+         return chunk;
+      } FC_CAPTURE_AND_RETHROW( (block_id)(chunk_index) ) }
+
+      virtual void load_state_snapshot(const fc::path& file, const block_id_type& block_id) override
+      { try {
+         try
+         {
+            _chain_db->load_state_snapshot( file, block_id );
+         }
+         catch( const fc::exception& e )
+         {
+            // the state may be partially replaced, start over from genesis before syncing blocks
+            elog( "Unable to load the state snapshot, wiping the database: ${e}", ("e",e.to_detail_string()) );
+            _chain_db->wipe( _data_dir / "blockchain", true );
+            _chain_db->open( _data_dir / "blockchain", _initial_state, GRAPHENE_CURRENT_DB_VERSION );
+            throw;
+         }
+      } FC_CAPTURE_AND_RETHROW( (file)(block_id) ) }
+
       application* _self;
 
       fc::path _data_dir;
@@ -808,6 +982,14 @@ namespace detail {
 
       bool _is_finished_syncing = false;
       uint32_t allow_future_time = 5;
+
+      uint32_t                                                       _prevalidation_threads = 0;
+      std::vector< std::unique_ptr<fc::thread> >                     _prevalidation_workers; ///< started by the first prevalidate_block
+      uint32_t                                                       _next_prevalidation_worker = 0;
+      std::mutex                                                     _prevalidated_blocks_mutex;
+      std::map< block_id_type, fc::future<prevalidated_block_ptr> >  _prevalidated_blocks;
+
+      genesis_state_type                                             _initial_state; ///< the chain was opened with, to start over after a failed snapshot load
    };
 
 }
@@ -866,6 +1048,16 @@ void application::set_program_options(boost::program_options::options_descriptio
          ("server-pem-password,P", bpo::value<string>()->implicit_value(""), "Password for this certificate")
          ("dbg-init-key", bpo::value<string>(), "Block signing key to use for init witnesses, overrides genesis file")
          ("genesis-json", bpo::value<boost::filesystem::path>(), "File to read Genesis State from")
+         ("block-log-mmap", bpo::value<bool>()->default_value(false), "Serve block log reads from memory mapped files, allows concurrent block lookups from API threads")
+         ("block-log-compression", bpo::value<bool>()->default_value(false), "Compress blocks appended to the block log, existing blocks stay readable either way")
+         ("signature-threads", bpo::value<uint32_t>(), "Number of threads recovering transaction signatures before a block is applied, defaults to the number of cores less one, 1 disables")
+         ("sync-prevalidation-threads", bpo::value<uint32_t>(), "Number of threads hashing and checking the signatures of blocks received during sync before the chain thread applies them, started when the first sync block arrives, defaults to the number of cores less one, 0 disables")
+         ("signature-cache-size", bpo::value<uint32_t>()->default_value(100000), "Number of transactions whose recovered signing keys are kept, so that pending and block transactions are not recovered twice. 0 disables")
+         ("state-checkpoint-interval", bpo::value<uint32_t>()->default_value(0), "Persist changed objects every N blocks once they are irreversible, so that restarting after a crash does not replay from the last full save. 0 disables")
+         ("state-snapshot-interval", bpo::value<uint32_t>()->default_value(0), "Write the complete state every N blocks once it is irreversible and offer it to peers syncing from a state snapshot. Every N-th block is delayed by packing all objects while it is pushed. 0 disables")
+         ("sync-from-state-snapshot", bpo::value<bool>()->default_value(false), "When starting without blocks, download the state snapshot offered by peers instead of applying all blocks from genesis. Such a node cannot replay")
+         ("state-snapshot-block-id", bpo::value<string>(), "Only accept a state snapshot taken at this block id when syncing from a state snapshot")
+         ("state-snapshot-hash", bpo::value<string>(), "The sha256 hash of the state snapshot file to accept, as logged by a trusted node that wrote it. Required by sync-from-state-snapshot")
          ("api-user", bpo::value< vector<string> >()->composing(), "API user specification, may be specified multiple times")
          ("public-api", bpo::value< vector<string> >()->composing()->default_value(default_apis, str_default_apis), "Set an API to be publicly available, may be specified multiple times")
          ("enable-plugin", bpo::value< vector<string> >()->composing()->default_value(default_plugins, str_default_plugins), "Plugin(s) to enable, may be specified multiple times")
@@ -875,6 +1067,7 @@ void application::set_program_options(boost::program_options::options_descriptio
          ("replay-blockchain", "Rebuild object graph by replaying all blocks")
          ("resync-blockchain", "Delete all blocks and re-sync with network from scratch")
          ("force-validate", "Force validation of all transactions")
+         ("replay-threads", bpo::value<uint32_t>(), "Number of threads decoding blocks ahead of the chain thread during replay, defaults to the number of cores less one")
          ;
    command_line_options.add(_cli_options);
    configuration_file_options.add(_cfg_options);
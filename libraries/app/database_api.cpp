@@ -42,6 +42,8 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       // Blocks and transactions
       optional<block_header> get_block_header(uint32_t block_num)const;
       optional<signed_block> get_block(uint32_t block_num)const;
+      block_id_index_stats get_block_id_index_stats()const;
+      signature_cache_stats get_signature_cache_stats()const;
       vector<proposal_object> get_proposed_transactions( string id )const;
 
       // Globals
@@ -241,6 +243,26 @@ optional<signed_block> database_api_impl::get_block(uint32_t block_num)const
    return _db.fetch_block_by_number(block_num);
 }
 
+block_id_index_stats database_api::get_block_id_index_stats()const
+{
+   return my->get_block_id_index_stats();
+}
+
+block_id_index_stats database_api_impl::get_block_id_index_stats()const
+{
+   return _db.get_block_log().get_id_index_stats();
+}
+
+signature_cache_stats database_api::get_signature_cache_stats()const
+{
+   return my->get_signature_cache_stats();
+}
+
+signature_cache_stats database_api_impl::get_signature_cache_stats()const
+{
+   return _db.get_signature_cache_stats();
+}
+
 //////////////////////////////////////////////////////////////////////
 //                                                                  //
 // Globals                                                          //
@@ -290,6 +290,18 @@ class database_api
        *  @ingroup db_api
        */
       vector<proposal_object> get_proposed_transactions( string id )const;
+
+      /**
+       * @brief Retrieve the counters of the in-memory block id index of the block log
+       * @ingroup db_api
+       */
+      block_id_index_stats get_block_id_index_stats()const;
+
+      /**
+       * @brief Retrieve the size and hit/miss counters of the recovered signature cache
+       * @ingroup db_api
+       */
+      signature_cache_stats get_signature_cache_stats()const;
             
       /////////////
       // Globals //
@@ -563,6 +575,8 @@ FC_API(muse::app::database_api,
    // Blocks and transactions
    (get_block_header)
    (get_block)
+   (get_block_id_index_stats)
+   (get_signature_cache_stats)
 //   (get_state)
 
    (get_proposed_transactions)
@@ -4,6 +4,9 @@
 
 #include <fc/uint128.hpp>
 
+#include <algorithm>
+#include <iterator>
+
 namespace muse { namespace chain {
 
 
@@ -123,6 +126,164 @@ void account_member_index::object_modified( const object& after )
     }
 }
 
+/** the contribution of a friend or second level account, computed in 32 bits like database::get_scoring does */
+static uint64_t level_term( uint32_t root, uint16_t percentage )
+{
+   return root * percentage / 100;
+}
+
+void account_score_index::object_inserted( const object& obj )
+{
+   assert( dynamic_cast< const account_object* >( &obj ) ); // for debug only
+   const account_object& a = static_cast< const account_object& >( obj );
+   set_vesting( a.id, a.get_scoring_vesting() );
+   set_edges( a.id, a.friends, a.second_level );
+}
+
+void account_score_index::object_removed( const object& obj )
+{
+   assert( dynamic_cast< const account_object* >( &obj ) ); // for debug only
+   const account_object& a = static_cast< const account_object& >( obj );
+   set_edges( a.id, flat_set< account_id_type >(), flat_set< account_id_type >() );
+   set_vesting( a.id, 0 );
+}
+
+void account_score_index::object_modified( const object& after )
+{
+   assert( dynamic_cast< const account_object* >( &after ) ); // for debug only
+   const account_object& a = static_cast< const account_object& >( after );
+   set_vesting( a.id, a.get_scoring_vesting() );
+   if( ( _edges_changed.valid() && *_edges_changed == a.get_id() ) || ( _undo_db != nullptr && _undo_db->rolling_back() ) )
+   {
+      _edges_changed.reset();
+      set_edges( a.id, a.friends, a.second_level );
+   }
+   else if( !same_edges( a ) )
+   {
+      // friends and second_level should be changed through database::modify_social_graph
+      elog( "friends or second_level of account ${a} changed without database::modify_social_graph", ("a",a.name) );
+      set_edges( a.id, a.friends, a.second_level );
+   }
+}
+
+uint64_t account_score_index::get_score( account_id_type account )const
+{
+   if( account.instance.value >= _nodes.size() )
+      return 0;
+   return _nodes[account.instance.value].score;
+}
+
+vector< account_id_type > account_score_index::get_dependents( account_id_type account )const
+{
+   vector< account_id_type > result;
+   if( account.instance.value >= _nodes.size() || !_nodes[account.instance.value].graph )
+      return result;
+   const edges& e = *_nodes[account.instance.value].graph;
+   result.reserve( e.friend_of.size() + e.second_level_of.size() );
+   std::set_union( e.friend_of.begin(), e.friend_of.end(), e.second_level_of.begin(), e.second_level_of.end(),
+                   std::back_inserter( result ) );
+   return result;
+}
+
+void account_score_index::set_vesting( account_id_type account, uint64_t vesting )
+{
+   if( account.instance.value >= _nodes.size() )
+      _nodes.resize( account.instance.value + 1 );
+   node& n = _nodes[account.instance.value];
+   if( n.vesting == vesting )
+      return;
+   n.vesting = vesting;
+
+   const uint32_t old_root = n.root;
+   const uint32_t new_root = detail::isqrt( vesting );
+   if( old_root == new_root )
+      return;
+   n.root = new_root;
+
+   // scores are sums of terms, unsigned wrap around keeps every difference exact
+   n.score += uint64_t( new_root ) - old_root;
+   if( !n.graph )
+      return;
+   const uint64_t first_level_delta = level_term( new_root, MUSE_1ST_LEVEL_SCORING_PERCENTAGE )
+                                      - level_term( old_root, MUSE_1ST_LEVEL_SCORING_PERCENTAGE );
+   for( const auto& holder : n.graph->friend_of )
+      _nodes[holder.instance.value].score += first_level_delta;
+   const uint64_t second_level_delta = level_term( new_root, MUSE_2ST_LEVEL_SCORING_PERCENTAGE )
+                                       - level_term( old_root, MUSE_2ST_LEVEL_SCORING_PERCENTAGE );
+   for( const auto& holder : n.graph->second_level_of )
+      _nodes[holder.instance.value].score += second_level_delta;
+}
+
+void account_score_index::set_edges( account_id_type account, const flat_set< account_id_type >& friends,
+                                     const flat_set< account_id_type >& second_level )
+{
+   // size the nodes up front, update_level holds references into them
+   uint64_t last = account.instance.value;
+   if( !friends.empty() )
+      last = std::max( last, friends.rbegin()->instance.value );
+   if( !second_level.empty() )
+      last = std::max( last, second_level.rbegin()->instance.value );
+   if( last >= _nodes.size() )
+      _nodes.resize( last + 1 );
+
+   node& n = _nodes[account.instance.value];
+   if( !n.graph )
+   {
+      if( friends.empty() && second_level.empty() )
+         return;
+      n.graph.reset( new edges );
+   }
+   update_level( account, n.graph->friends, friends, &edges::friend_of, MUSE_1ST_LEVEL_SCORING_PERCENTAGE );
+   update_level( account, n.graph->second_level, second_level, &edges::second_level_of, MUSE_2ST_LEVEL_SCORING_PERCENTAGE );
+}
+
+bool account_score_index::same_edges( const account_object& a )const
+{
+   const node* n = a.id.instance() < _nodes.size() ? &_nodes[a.id.instance()] : nullptr;
+   if( n == nullptr || !n->graph )
+      return a.friends.empty() && a.second_level.empty();
+   return n->graph->friends.size() == a.friends.size()
+          && std::equal( a.friends.begin(), a.friends.end(), n->graph->friends.begin() )
+          && n->graph->second_level.size() == a.second_level.size()
+          && std::equal( a.second_level.begin(), a.second_level.end(), n->graph->second_level.begin() );
+}
+
+void account_score_index::update_level( account_id_type account, vector< account_id_type >& current,
+                                        const flat_set< account_id_type >& updated,
+                                        vector< account_id_type > edges::*reverse, uint16_t percentage )
+{
+   if( current.size() == updated.size() && std::equal( current.begin(), current.end(), updated.begin() ) )
+      return;
+
+   node& n = _nodes[account.instance.value];
+
+   vector< account_id_type > removed;
+   std::set_difference( current.begin(), current.end(), updated.begin(), updated.end(),
+                        std::back_inserter( removed ) );
+   for( const auto& id : removed )
+   {
+      node& other = _nodes[id.instance.value];
+      n.score -= level_term( other.root, percentage );
+      vector< account_id_type >& holders = (*other.graph).*reverse;
+      holders.erase( std::lower_bound( holders.begin(), holders.end(), account ) );
+   }
+
+   vector< account_id_type > added;
+   std::set_difference( updated.begin(), updated.end(), current.begin(), current.end(),
+                        std::back_inserter( added ) );
+   for( const auto& id : added )
+   {
+      node& other = _nodes[id.instance.value];
+      n.score += level_term( other.root, percentage );
+      if( !other.graph )
+         other.graph.reset( new edges );
+      vector< account_id_type >& holders = (*other.graph).*reverse;
+      holders.insert( std::lower_bound( holders.begin(), holders.end(), account ), account );
+   }
+
+   current.assign( updated.begin(), updated.end() );
+}
+
 
 
 } } // muse::chain
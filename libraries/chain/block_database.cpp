@@ -1,6 +1,15 @@
 #include <muse/chain/block_database.hpp>
+#include <muse/chain/config.hpp>
+#include <fc/bitutil.hpp>
 #include <fc/io/raw.hpp>
 
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <unordered_map>
+
 namespace muse { namespace chain {
 
 struct index_entry
@@ -14,38 +23,153 @@ FC_REFLECT( muse::chain::index_entry, (block_pos)(block_size)(block_id) );
 
 namespace muse { namespace chain {
 
-void block_database::open( const fc::path& dbdir )
+/**
+ * Set in index_entry::block_size for blocks stored as compressed frames. Raw
+ * blocks are far below 2GB, so files written before compression existed never
+ * have it set. A frame is the uncompressed size (uint32) followed by a zlib stream.
+ */
+static const uint32_t compressed_frame_flag = 0x80000000;
+static const size_t   frame_header_size = sizeof(uint32_t);
+
+static uint32_t stored_size( const index_entry& e )
+{
+   return e.block_size & ~compressed_frame_flag;
+}
+
+vector<char> block_database::encode_frame( const vector<char>& packed )const
+{
+   z_stream zs;
+   std::memset( &zs, 0, sizeof(zs) );
+   FC_ASSERT( deflateInit( &zs, Z_DEFAULT_COMPRESSION ) == Z_OK );
+   if( !_dictionary.empty() )
+      deflateSetDictionary( &zs, (const Bytef*)_dictionary.data(), _dictionary.size() );
+
+   vector<char> frame( frame_header_size + deflateBound( &zs, packed.size() ) );
+   const uint32_t raw_size = packed.size();
+   std::memcpy( frame.data(), (const char*)&raw_size, frame_header_size );
+   zs.next_in   = (Bytef*)packed.data();
+   zs.avail_in  = packed.size();
+   zs.next_out  = (Bytef*)frame.data() + frame_header_size;
+   zs.avail_out = frame.size() - frame_header_size;
+   const int result = deflate( &zs, Z_FINISH );
+   deflateEnd( &zs );
+   FC_ASSERT( result == Z_STREAM_END, "zlib deflate failed: ${r}", ("r", result) );
+
+   frame.resize( frame_header_size + zs.total_out );
+   if( frame.size() >= packed.size() )
+      frame.clear();
+   return frame;
+}
+
+/** Deserializes a block outside of the lock, so that concurrent readers only serialize on I/O */
+signed_block block_database::decode_block( const index_entry& e, const vector<char>& data )const
+{
+   signed_block result;
+   if( e.block_size & compressed_frame_flag )
+   {
+      FC_ASSERT( data.size() > frame_header_size );
+      uint32_t raw_size;
+      std::memcpy( (char*)&raw_size, data.data(), frame_header_size );
+      FC_ASSERT( raw_size <= MUSE_MAX_BLOCK_SIZE, "Corrupt frame header in block database" );
+
+      vector<char> raw( raw_size );
+      z_stream zs;
+      std::memset( &zs, 0, sizeof(zs) );
+      FC_ASSERT( inflateInit( &zs ) == Z_OK );
+      zs.next_in   = (Bytef*)data.data() + frame_header_size;
+      zs.avail_in  = data.size() - frame_header_size;
+      zs.next_out  = (Bytef*)raw.data();
+      zs.avail_out = raw.size();
+      int r = inflate( &zs, Z_FINISH );
+      if( r == Z_NEED_DICT && !_dictionary.empty() )
+      {
+         inflateSetDictionary( &zs, (const Bytef*)_dictionary.data(), _dictionary.size() );
+         r = inflate( &zs, Z_FINISH );
+      }
+      const bool complete = r == Z_STREAM_END && zs.total_out == raw_size;
+      inflateEnd( &zs );
+      FC_ASSERT( complete, "Unable to decompress block ${n}: ${r}", ("n", block_header::num_from_id(e.block_id))("r", r) );
+      result = fc::raw::unpack_from_vector<signed_block>( raw );
+   }
+   else
+      result = fc::raw::unpack_from_vector<signed_block>( data );
+   FC_ASSERT( result.id() == e.block_id );
+   return result;
+}
+
+template<typename Lambda>
+auto block_database::with_read_access( Lambda&& f )const -> decltype( f() )
+{
+   if( _use_mmap )
+   {
+      read_lock lock( _lock );
+      if( mappings_current() )
+         return f();
+   }
+   write_lock lock( _lock );
+   if( _use_mmap && !mappings_current() )
+      remap();
+   return f();
+}
+
+void block_database::open( const fc::path& dbdir, bool use_mmap, bool compress )
 { try {
+   write_lock lock( _lock );
    fc::create_directories(dbdir);
    _block_num_to_pos.exceptions(std::ios_base::failbit | std::ios_base::badbit);
    _blocks.exceptions(std::ios_base::failbit | std::ios_base::badbit);
 
    _index_filename = dbdir / "index";
+   _blocks_filename = dbdir / "blocks";
+   _dictionary_filename = dbdir / "dictionary";
    if( !fc::exists( _index_filename ) )
    {
      _block_num_to_pos.open( _index_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
+     _blocks.open( _blocks_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
    }
    else
    {
      _block_num_to_pos.open( _index_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+     _blocks.open( _blocks_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+   }
+
+   _index_size  = fc::file_size( _index_filename );
+   _blocks_size = fc::file_size( _blocks_filename );
+   _use_mmap = use_mmap;
+   _compress = compress;
+   _dictionary.clear();
+   if( fc::exists( _dictionary_filename ) )
+   {
+      std::ifstream in( _dictionary_filename.generic_string().c_str(), std::ios::binary );
+      _dictionary.assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
    }
-} FC_CAPTURE_AND_RETHROW( (dbdir) ) }
+   load_id_index();
+   if( _use_mmap )
+      remap();
+} FC_CAPTURE_AND_RETHROW( (dbdir)(use_mmap)(compress) ) }
 
 bool block_database::is_open()const
 {
+  read_lock lock( _lock );
   return _blocks.is_open();
 }
 
 void block_database::close()
 {
+  write_lock lock( _lock );
+  unmap();
   _blocks.close();
   _block_num_to_pos.close();
+  _index_size = 0;
+  _blocks_size = 0;
+  _dictionary.clear();
+  _id_index.clear();
+  _id_stored.clear();
 }
 
 void block_database::flush()
 {
+  write_lock lock( _lock );
   _blocks.flush();
   _block_num_to_pos.flush();
 }
@@ -59,33 +183,57 @@ void block_database::store( const block_id_type& _id, const signed_block& b )
       elog( "id argument of block_database::store() was not initialized for block ${id}", ("id", id) );
    }
    auto num = block_header::num_from_id(id);
-   _block_num_to_pos.seekp( sizeof( index_entry ) * num );
+   auto vec = fc::raw::pack_to_vector( b );
+   bool compressed = false;
+   if( _compress )
+   {
+      auto frame = encode_frame( vec );
+      if( !frame.empty() )
+      {
+         vec = std::move( frame );
+         compressed = true;
+      }
+   }
+
+   write_lock lock( _lock );
+   const uint64_t index_pos = sizeof( index_entry ) * uint64_t(num);
+   _block_num_to_pos.seekp( index_pos );
    index_entry e;
    _blocks.seekp( 0, _blocks.end );
-   auto vec = fc::raw::pack_to_vector( b );
    e.block_pos  = _blocks.tellp();
-   e.block_size = vec.size();
+   e.block_size = vec.size() | ( compressed ? compressed_frame_flag : 0 );
    e.block_id   = id;
    _blocks.write( vec.data(), vec.size() );
    _block_num_to_pos.write( (char*)&e, sizeof(e) );
+   set_id_index_entry( num, id, true );
+
+   _blocks_size = e.block_pos + vec.size();
+   _index_size = std::max( _index_size, index_pos + uint64_t( sizeof(e) ) );
+
+   // the mappings only see what has reached the file, readers remap once it outgrows them
+   if( _use_mmap )
+   {
+      _blocks.flush();
+      _block_num_to_pos.flush();
+   }
 }
 
 void block_database::remove( const block_id_type& id )
 { try {
+   write_lock lock( _lock );
    index_entry e;
-   auto index_pos = sizeof(e)*block_header::num_from_id(id);
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( (size_t)_block_num_to_pos.tellg() <= index_pos )
+   const uint32_t block_num = block_header::num_from_id(id);
+   if( !read_index_entry( block_num, e ) )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block ${id} not contained in block database", ("id", id));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
    if( e.block_id == id )
    {
       e.block_size = 0;
-      _block_num_to_pos.seekp( sizeof(e)*block_header::num_from_id(id) );
+      _block_num_to_pos.seekp( sizeof(e)*uint64_t(block_num) );
       _block_num_to_pos.write( (char*)&e, sizeof(e) );
+      set_id_index_entry( block_num, id, false );
+      if( _use_mmap )
+         _block_num_to_pos.flush();
    }
 } FC_CAPTURE_AND_RETHROW( (id) ) }
 
@@ -94,55 +242,47 @@ bool block_database::contains( const block_id_type& id )const
    if( id == block_id_type() )
       return false;
 
-   index_entry e;
-   auto index_pos = sizeof(e)*block_header::num_from_id(id);
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( (size_t)_block_num_to_pos.tellg() < index_pos + sizeof(e) )
-      return false;
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-   return e.block_id == id && e.block_size > 0;
+   read_lock lock( _lock );
+   const bool found = id_index_contains( id );
+   ++( found ? _id_hits : _id_misses );
+   return found;
 }
 
 block_id_type block_database::fetch_block_id( uint32_t block_num )const
 {
    assert( block_num != 0 );
-   index_entry e;
-   auto index_pos = sizeof(e)*block_num;
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= int64_t(index_pos) )
+   read_lock lock( _lock );
+   if( block_num >= _id_index.size() )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block number ${block_num} not contained in block database", ("block_num", block_num));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-   FC_ASSERT( e.block_id != block_id_type(), "Empty block_id in block_database (maybe corrupt on disk?)" );
-   return e.block_id;
+   const id_suffix& suffix = _id_index[block_num];
+   FC_ASSERT( suffix.hash[0] != 0 || suffix.hash[1] != 0 || suffix.hash[2] != 0 || suffix.hash[3] != 0,
+              "Empty block_id in block_database (maybe corrupt on disk?)" );
+   block_id_type id;
+   id._hash[0] = fc::endian_reverse_u32( block_num );
+   std::memcpy( (char*)&id._hash[1], (const char*)suffix.hash, sizeof(suffix.hash) );
+   return id;
 }
 
 optional<signed_block> block_database::fetch_optional( const block_id_type& id )const
 {
+   {
+      read_lock lock( _lock );
+      const bool known = id_index_contains( id );
+      ++( known ? _id_hits : _id_misses );
+      if( !known )
+         return optional<signed_block>();
+   }
    try
    {
       index_entry e;
-      auto index_pos = sizeof(e)*block_header::num_from_id(id);
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( (size_t)_block_num_to_pos.tellg() <= index_pos )
-         return {};
-
-      _block_num_to_pos.seekg( index_pos );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-      if( e.block_id != id ) return optional<signed_block>();
-
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      if (e.block_size)
-         _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack_from_vector<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
-      return result;
+      vector<char> data;
+      bool found = with_read_access( [this,&id,&e,&data]() {
+         return read_index_entry( block_header::num_from_id(id), e ) && e.block_id == id
+                && read_block_data( e, data );
+      });
+      if( found )
+         return decode_block( e, data );
    }
    catch (const fc::exception&)
    {
@@ -158,20 +298,12 @@ optional<signed_block> block_database::fetch_by_number( uint32_t block_num )cons
    try
    {
       index_entry e;
-      auto index_pos = sizeof(e)*block_num;
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( (size_t)_block_num_to_pos.tellg() <= index_pos )
-         return {};
-
-      _block_num_to_pos.seekg( index_pos, _block_num_to_pos.beg );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack_from_vector<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
-      return result;
+      vector<char> data;
+      bool found = with_read_access( [this,block_num,&e,&data]() {
+         return read_index_entry( block_num, e ) && read_block_data( e, data );
+      });
+      if( found )
+         return decode_block( e, data );
    }
    catch (const fc::exception&)
    {
@@ -183,37 +315,23 @@ optional<signed_block> block_database::fetch_by_number( uint32_t block_num )cons
 }
 
 optional<index_entry> block_database::last_index_entry()const {
+   write_lock lock( _lock );
    try
    {
-      index_entry e;
-
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      std::streampos pos = _block_num_to_pos.tellg();
-      if( (size_t)pos < sizeof(index_entry) )
-         return optional<index_entry>();
-
-      pos -= pos % sizeof(index_entry);
-
-      _blocks.seekg( 0, _block_num_to_pos.end );
-      const std::streampos blocks_size = _blocks.tellg();
+      uint64_t pos = _index_size - _index_size % sizeof(index_entry);
       while( pos > 0 )
       {
+         if( _use_mmap && !mappings_current() )
+            remap();
+
          pos -= sizeof(index_entry);
-         _block_num_to_pos.seekg( pos );
-         _block_num_to_pos.read( (char*)&e, sizeof(e) );
-         if( _block_num_to_pos.gcount() == sizeof(e) && e.block_size > 0
-                && e.block_pos + e.block_size <= (size_t)blocks_size )
+         index_entry e;
+         vector<char> data;
+         if( read_index_entry( pos / sizeof(index_entry), e ) && read_block_data( e, data ) )
             try
             {
-               vector<char> data( e.block_size );
-               _blocks.seekg( e.block_pos );
-               _blocks.read( data.data(), e.block_size );
-               if( _blocks.gcount() == e.block_size )
-               {
-                  const signed_block block = fc::raw::unpack_from_vector<signed_block>(data);
-                  if( block.id() == e.block_id )
-                     return e;
-               }
+               decode_block( e, data );
+               return e;
             }
             catch (const fc::exception&)
             {
@@ -221,7 +339,11 @@ optional<index_entry> block_database::last_index_entry()const {
             catch (const std::exception&)
             {
             }
+         unmap();
          fc::resize_file( _index_filename, pos );
+         _index_size = pos;
+         _id_index.resize( pos / sizeof(index_entry) );
+         _id_stored.resize( pos / sizeof(index_entry) );
       }
    }
    catch (const fc::exception&)
@@ -247,4 +369,188 @@ optional<block_id_type> block_database::last_id()const
    return optional<block_id_type>();
 }
 
+bool block_database::read_index_entry( uint32_t block_num, index_entry& e )const
+{
+   const uint64_t index_pos = sizeof(e) * uint64_t(block_num);
+   if( _index_size < index_pos + sizeof(e) )
+      return false;
+
+   if( _use_mmap )
+      std::memcpy( (char*)&e, (const char*)_index_region->get_address() + index_pos, sizeof(e) );
+   else
+   {
+      _block_num_to_pos.seekg( index_pos );
+      _block_num_to_pos.read( (char*)&e, sizeof(e) );
+   }
+   return true;
+}
+
+bool block_database::read_block_data( const index_entry& e, vector<char>& data )const
+{
+   const uint32_t size = stored_size( e );
+   if( size == 0 || e.block_pos + size > _blocks_size )
+      return false;
+
+   data.resize( size );
+   if( _use_mmap )
+      std::memcpy( data.data(), (const char*)_blocks_region->get_address() + e.block_pos, size );
+   else
+   {
+      _blocks.seekg( e.block_pos );
+      _blocks.read( data.data(), size );
+   }
+   return true;
+}
+
+/**
+ *  Files are mapped with headroom past their end. The mappings are shared, so
+ *  data appended through the fstreams becomes visible in them once flushed,
+ *  and readers only remap after a file has outgrown its mapping. Reads never
+ *  go past the tracked file sizes, so the pages beyond the end are not touched.
+ */
+static uint64_t mapping_size_for( uint64_t file_size )
+{
+   const uint64_t min_headroom = 64 * 1024 * 1024;
+   return file_size + std::max( file_size / 8, min_headroom );
+}
+
+bool block_database::mappings_current()const
+{
+   const uint64_t mapped_index  = _index_region  ? _index_region->get_size()  : 0;
+   const uint64_t mapped_blocks = _blocks_region ? _blocks_region->get_size() : 0;
+   return mapped_index >= _index_size && mapped_blocks >= _blocks_size;
+}
+
+void block_database::remap()const
+{
+   unmap();
+   if( _index_size > 0 )
+   {
+      _index_mapping.reset( new fc::file_mapping( _index_filename.generic_string().c_str(), fc::read_only ) );
+      _index_region.reset( new fc::mapped_region( *_index_mapping, fc::read_only, 0, mapping_size_for( _index_size ) ) );
+   }
+   if( _blocks_size > 0 )
+   {
+      _blocks_mapping.reset( new fc::file_mapping( _blocks_filename.generic_string().c_str(), fc::read_only ) );
+      _blocks_region.reset( new fc::mapped_region( *_blocks_mapping, fc::read_only, 0, mapping_size_for( _blocks_size ) ) );
+   }
+}
+
+void block_database::unmap()const
+{
+   _index_region.reset();
+   _index_mapping.reset();
+   _blocks_region.reset();
+   _blocks_mapping.reset();
+}
+
+void block_database::set_dictionary( const vector<char>& dictionary )
+{ try {
+   write_lock lock( _lock );
+   FC_ASSERT( _blocks.is_open() && _blocks_size == 0, "The dictionary can only be set on an empty block database" );
+   std::ofstream out( _dictionary_filename.generic_string().c_str(), std::ios::binary | std::ios::trunc );
+   out.write( dictionary.data(), dictionary.size() );
+   out.close();
+   FC_ASSERT( out.good(), "Unable to write ${f}", ("f", _dictionary_filename) );
+   _dictionary = dictionary;
+} FC_CAPTURE_AND_RETHROW( (dictionary.size()) ) }
+
+vector<char> block_database::train_dictionary( const vector< vector<char> >& samples, size_t max_size )
+{
+   const size_t segment = 32;
+   const size_t step    = 8;
+
+   // count in how many samples each segment occurs
+   std::unordered_map< string, uint32_t > counts;
+   for( const auto& sample : samples )
+   {
+      std::unordered_map< string, bool > seen;
+      for( size_t pos = 0; pos + segment <= sample.size(); pos += step )
+      {
+         string s( sample.data() + pos, segment );
+         if( seen.emplace( s, true ).second )
+            ++counts[s];
+      }
+   }
+
+   vector< std::pair< uint32_t, const string* > > ranked;
+   for( const auto& c : counts )
+      if( c.second > 1 )
+         ranked.emplace_back( c.second, &c.first );
+   std::sort( ranked.begin(), ranked.end(), []( const std::pair< uint32_t, const string* >& a,
+                                                const std::pair< uint32_t, const string* >& b ) {
+      return a.first > b.first || ( a.first == b.first && *a.second < *b.second );
+   });
+
+   // most frequent first, skipping what is already covered, then reverse the order of the segments
+   vector< const string* > chosen;
+   string covered;
+   for( const auto& r : ranked )
+   {
+      if( covered.size() + segment > max_size )
+         break;
+      if( covered.find( *r.second ) != string::npos )
+         continue;
+      covered += *r.second;
+      chosen.push_back( r.second );
+   }
+
+   vector<char> dictionary;
+   dictionary.reserve( covered.size() );
+   for( auto itr = chosen.rbegin(); itr != chosen.rend(); ++itr )
+      dictionary.insert( dictionary.end(), (*itr)->begin(), (*itr)->end() );
+   return dictionary;
+}
+
+block_id_index_stats block_database::get_id_index_stats()const
+{
+   block_id_index_stats stats;
+   {
+      read_lock lock( _lock );
+      stats.index_size = _id_index.size();
+   }
+   stats.hits = _id_hits;
+   stats.misses = _id_misses;
+   return stats;
+}
+
+void block_database::load_id_index()
+{
+   const uint64_t count = _index_size / sizeof(index_entry);
+   _id_index.assign( count, id_suffix() );
+   _id_stored.assign( count, false );
+
+   const uint64_t batch = 4096;
+   vector<index_entry> entries;
+   _block_num_to_pos.seekg( 0 );
+   for( uint64_t first = 0; first < count; first += batch )
+   {
+      entries.resize( std::min( batch, count - first ) );
+      _block_num_to_pos.read( (char*)entries.data(), entries.size() * sizeof(index_entry) );
+      for( uint64_t i = 0; i < entries.size(); ++i )
+      {
+         std::memcpy( (char*)_id_index[first + i].hash, (const char*)&entries[i].block_id._hash[1], sizeof(id_suffix::hash) );
+         _id_stored[first + i] = entries[i].block_size > 0;
+      }
+   }
+}
+
+void block_database::set_id_index_entry( uint32_t block_num, const block_id_type& id, bool stored )
+{
+   if( block_num >= _id_index.size() )
+   {
+      _id_index.resize( block_num + 1 );
+      _id_stored.resize( block_num + 1, false );
+   }
+   std::memcpy( (char*)_id_index[block_num].hash, (const char*)&id._hash[1], sizeof(id_suffix::hash) );
+   _id_stored[block_num] = stored;
+}
+
+bool block_database::id_index_contains( const block_id_type& id )const
+{
+   const uint32_t block_num = block_header::num_from_id( id );
+   return block_num < _id_index.size() && _id_stored[block_num]
+          && std::memcmp( (const char*)_id_index[block_num].hash, (const char*)&id._hash[1], sizeof(id_suffix::hash) ) == 0;
+}
+
 } }
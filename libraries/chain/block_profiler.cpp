@@ -0,0 +1,114 @@
+#include <muse/chain/block_profiler.hpp>
+#include <muse/chain/protocol/operations.hpp>
+
+#include <algorithm>
+
+namespace muse { namespace chain {
+
+static const size_t histogram_buckets = 24;
+
+static const char* const stage_names[ block_profiler::stage_count ] = {
+   "validate_block",
+   "apply_transactions",
+   "update_global_dynamic_data",
+   "update_signing_witness",
+   "update_last_irreversible_block",
+   "create_block_summary",
+   "clear_expired_objects",
+   "update_witness_schedule",
+   "update_median_feed",
+   "update_virtual_supply",
+   "process_funds",
+   "process_conversions",
+   "process_content_cashout",
+   "adjust_funds",
+   "process_vesting_withdrawals",
+   "account_recovery_processing",
+   "process_hardforks",
+   "applied_block_observers",
+   "notify_changed_objects"
+};
+
+struct operation_name_visitor
+{
+   typedef string result_type;
+
+   template< typename Type >
+   result_type operator()( const Type& op )const
+   {
+      string name = fc::get_typename< Type >::name();
+      size_t p = name.rfind( ':' );
+      if( p != string::npos )
+         name = name.substr( p + 1 );
+      return name;
+   }
+};
+
+void timing_stats::add( int64_t us )
+{
+   const uint64_t value = us > 0 ? uint64_t( us ) : 0;
+   if( histogram.empty() )
+      histogram.resize( histogram_buckets );
+   size_t bucket = 0;
+   while( bucket + 1 < histogram_buckets && value >= ( uint64_t( 1 ) << bucket ) )
+      ++bucket;
+   ++histogram[bucket];
+   ++count;
+   total_us += value;
+   max_us = std::max( max_us, value );
+}
+
+void block_profiler::record( stage s, const fc::microseconds& elapsed )
+{
+   _stages[s].add( elapsed.count() );
+}
+
+void block_profiler::record_operation( int which, const fc::microseconds& elapsed )
+{
+   if( which < 0 )
+      return;
+   if( size_t( which ) >= _operations.size() )
+      _operations.resize( which + 1 );
+   _operations[which].add( elapsed.count() );
+}
+
+void block_profiler::block_applied()
+{
+   if( !_enabled )
+      return;
+   ++_blocks;
+   if( _block_callback )
+      _block_callback( *this );
+}
+
+block_profile block_profiler::get_profile()const
+{
+   block_profile result;
+   result.blocks = _blocks;
+   for( size_t s = 0; s < stage_count; ++s )
+   {
+      result.stages.push_back( _stages[s] );
+      result.stages.back().name = stage_names[s];
+   }
+   operation_name_visitor visitor;
+   for( size_t which = 0; which < _operations.size(); ++which )
+   {
+      if( _operations[which].count == 0 )
+         continue;
+      operation op;
+      op.set_which( which );
+      result.operations.push_back( _operations[which] );
+      result.operations.back().name = op.visit( visitor );
+   }
+   return result;
+}
+
+void block_profiler::reset()
+{
+   _blocks = 0;
+   for( auto& s : _stages )
+      s = timing_stats();
+   _operations.clear();
+}
+
+} }
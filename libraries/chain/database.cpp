@@ -22,10 +22,45 @@
 
 #include <fc/io/fstream.hpp>
 
+#include <fc/thread/thread.hpp>
+
 #include <cstdint>
 #include <deque>
 #include <fstream>
 #include <functional>
+#include <map>
+#include <thread>
+
+namespace muse { namespace chain {
+
+/** The objects changed between two blocks, written by database::update_state_checkpoints() */
+struct state_checkpoint
+{
+   uint32_t                      base_block_num = 0; ///< head block of the state the changes apply to
+   uint32_t                      block_num = 0;
+   block_id_type                 block_id;
+   graphene::db::object_changes  changes;
+};
+
+/**
+ *  The complete state at an irreversible block, written by database::update_state_snapshots().
+ *  The block is included so that the loading node can continue with the blocks following it.
+ *  The objects can only be unpacked by a node with the same object layouts, db_version names them.
+ */
+struct state_snapshot
+{
+   std::string                   db_version;
+   chain_id_type                 chain_id;
+   block_id_type                 block_id;
+   signed_block                  block;
+   graphene::db::object_changes  objects;
+};
+
+} }
+FC_REFLECT( muse::chain::state_checkpoint, (base_block_num)(block_num)(block_id)(changes) )
+FC_REFLECT( muse::chain::state_snapshot, (db_version)(chain_id)(block_id)(block)(objects) )
+// the file and block_num follow from the block id
+FC_REFLECT( muse::chain::state_snapshot_info, (block_id)(size)(hash)(chunk_size)(chunk_hashes) )
 
 #define VIRTUAL_SCHEDULE_LAP_LENGTH  ( fc::uint128(uint64_t(-1)) )
 #define VIRTUAL_SCHEDULE_LAP_LENGTH2 ( fc::uint128::max_value() )
@@ -109,16 +144,29 @@ void database::open( const fc::path& data_dir, const genesis_state_type& initial
          version_file.close();
       }
 
+      _db_version = db_version;
       genesis_json_hash = initial_allocation.json_hash;
       ilog( "genesis.json hash is " + fc::string( genesis_json_hash ) );
 
       object_database::open(data_dir);
 
-      _block_id_to_block.open(data_dir / "database" / "block_num_to_block");
+      _block_id_to_block.open( data_dir / "database" / "block_num_to_block", _block_log_mmap, _block_log_compression );
 
       if( !find(dynamic_global_property_id_type()) )
          init_genesis( initial_allocation );
 
+      if( !load_state_checkpoints() )
+      {
+         // a checkpoint was applied partially, start over from the last full save
+         object_database::unload_all_objects();
+         object_database::open( data_dir );
+         if( !find(dynamic_global_property_id_type()) )
+            init_genesis( initial_allocation );
+      }
+      reset_state_checkpoints();
+      object_database::set_track_changes( _state_checkpoint_interval > 0 );
+      load_state_snapshot_info();
+
       init_hardforks();
 
       fc::optional<block_id_type> last_block = _block_id_to_block.last_id();
@@ -151,27 +199,140 @@ static void cutoff_blocks( block_database& blocks, uint32_t until )
    wlog( "Dropped ${n} blocks from after the gap", ("n", count) );
 }
 
+/** A run of consecutive blocks read and decoded by a replay worker ahead of the apply stage */
+struct replay_chunk
+{
+   vector<signed_block> blocks;
+   vector<bool>         merkle_verified;
+   bool                 gap = false;  ///< true if the chunk ends early because a block is missing
+   fc::microseconds     decode_time;
+};
+typedef std::shared_ptr<replay_chunk> replay_chunk_ptr;
+
+/** Throughput counters of the replay pipeline stages */
+struct replay_stats
+{
+   uint64_t         blocks = 0;
+   fc::microseconds decode_time; ///< summed over all workers
+   fc::microseconds apply_time;
+   fc::microseconds wait_time;   ///< time the apply stage spent waiting for decoded blocks
+
+   static double per_second( uint64_t count, const fc::microseconds& t )
+   {
+      return t.count() > 0 ? double(count) * 1000000.0 / t.count() : 0.0;
+   }
+};
+
+static replay_chunk_ptr decode_replay_chunk( const block_database& blocks, uint32_t first, uint32_t last )
+{
+   auto start = fc::time_point::now();
+   auto chunk = std::make_shared<replay_chunk>();
+   chunk->blocks.reserve( last - first + 1 );
+   chunk->merkle_verified.reserve( last - first + 1 );
+   for( uint32_t i = first; i <= last; ++i )
+   {
+      fc::optional< signed_block > block = blocks.fetch_by_number(i);
+      if( !block.valid() )
+      {
+         chunk->gap = true;
+         break;
+      }
+      chunk->merkle_verified.push_back( block->transaction_merkle_root == block->calculate_merkle_root() );
+      chunk->blocks.emplace_back( std::move( *block ) );
+   }
+   chunk->decode_time = fc::time_point::now() - start;
+   return chunk;
+}
+
 /** Reads blocks number from start_block_num until last_block_num (inclusive)
  *  from the blocks database and pushes/applies them. Returns early if a block
  *  cannot be read from blocks.
+ *
+ *  Reading, deserializing and merkle root verification run on worker threads
+ *  in chunks, ahead of the single threaded apply stage. At most two chunks per
+ *  worker are queued. push_or_apply receives skip_merkle_check for blocks whose
+ *  merkle root has already been verified.
  *  @return the number of the block following the last successfully read,
  *          usually last_block_num+1
  */
 static uint32_t reindex_range( block_database& blocks, uint32_t start_block_num, uint32_t last_block_num,
-        std::function<void( const signed_block& )> push_or_apply )
+        uint32_t worker_count, replay_stats& stats,
+        std::function<void( const signed_block&, uint32_t )> push_or_apply )
 {
-   for( uint32_t i = start_block_num; i <= last_block_num; ++i )
+   if( start_block_num > last_block_num )
+      return last_block_num + 1;
+
+   const uint32_t chunk_size = 64;
+   worker_count = std::max( worker_count, 1u );
+   const size_t max_queued = 2 * worker_count;
+
+   std::vector< std::unique_ptr<fc::thread> > workers;
+   for( uint32_t t = 0; t < worker_count; ++t )
+      workers.emplace_back( new fc::thread( "replay_" + fc::to_string( uint64_t(t) ) ) );
+
+   std::deque< fc::future<replay_chunk_ptr> > queue;
+   uint32_t next_to_schedule = start_block_num;
+   uint32_t scheduled = 0;
+   auto schedule = [&]() {
+      while( queue.size() < max_queued && next_to_schedule <= last_block_num )
+      {
+         const uint32_t first = next_to_schedule;
+         const uint32_t last = first + std::min( chunk_size - 1, last_block_num - first );
+         next_to_schedule = last + 1;
+         fc::thread& worker = *workers[ scheduled++ % workers.size() ];
+         const block_database& source = blocks;
+         queue.push_back( worker.async( [&source,first,last]() {
+            return decode_replay_chunk( source, first, last );
+         }, "replay_decode" ) );
+      }
+   };
+   auto drain = [&queue]() {
+      for( auto& f : queue )
+         try { f.wait(); } catch( ... ) {}
+      queue.clear();
+   };
+
+   uint32_t i = start_block_num;
+   try
    {
-      if( i % 100000 == 0 )
-         ilog( "${pct}%   ${i} of ${n}", ("pct",double(i*100)/last_block_num)("i",i)("n",last_block_num) );
-      fc::optional< signed_block > block = blocks.fetch_by_number(i);
-      if( !block.valid() )
+      schedule();
+      while( !queue.empty() )
       {
-         wlog( "Reindexing terminated due to gap:  Block ${i} does not exist!", ("i", i) );
-         cutoff_blocks( blocks, i );
-         return i;
+         auto wait_start = fc::time_point::now();
+         replay_chunk_ptr chunk = queue.front().wait();
+         queue.pop_front();
+         stats.wait_time += fc::time_point::now() - wait_start;
+         stats.decode_time += chunk->decode_time;
+         schedule();
+
+         for( size_t k = 0; k < chunk->blocks.size(); ++k, ++i )
+         {
+            if( i % 100000 == 0 )
+               ilog( "${pct}%   ${i} of ${n}   decode: ${d} blocks/s per worker, apply: ${a} blocks/s, apply stage idle: ${w} sec",
+                     ("pct",double(i*100)/last_block_num)("i",i)("n",last_block_num)
+                     ("d",uint64_t(replay_stats::per_second( stats.blocks, stats.decode_time )))
+                     ("a",uint64_t(replay_stats::per_second( stats.blocks, stats.apply_time )))
+                     ("w",stats.wait_time.count() / 1000000) );
+            auto apply_start = fc::time_point::now();
+            push_or_apply( chunk->blocks[k], chunk->merkle_verified[k] ? database::skip_merkle_check
+                                                                       : database::skip_nothing );
+            stats.apply_time += fc::time_point::now() - apply_start;
+            ++stats.blocks;
+         }
+
+         if( chunk->gap )
+         {
+            drain();
+            wlog( "Reindexing terminated due to gap:  Block ${i} does not exist!", ("i", i) );
+            cutoff_blocks( blocks, i );
+            return i;
+         }
       }
-      push_or_apply( *block );
+   }
+   catch( ... )
+   {
+      drain();
+      throw;
    }
    return last_block_num + 1;
 };
@@ -189,32 +350,42 @@ void database::reindex( fc::path data_dir )
       }
       if( last_block->block_num() <= head_block_num()) return;
 
-      ilog( "Replaying blocks..." );
+      uint32_t worker_count = _replay_threads;
+      if( worker_count == 0 )
+      {
+         const uint32_t cores = std::thread::hardware_concurrency();
+         worker_count = cores > 1 ? cores - 1 : 1;
+      }
+      ilog( "Replaying blocks with ${n} decoding threads...", ("n",worker_count) );
       _undo_db.disable();
 
       auto start = fc::time_point::now();
       const uint32_t last_block_num_in_file = last_block->block_num();
       const uint32_t initial_undo_blocks = MUSE_MAX_UNDO_HISTORY;
+      replay_stats stats;
 
       uint32_t first = head_block_num() + 1;
       if( last_block_num_in_file > 2 * initial_undo_blocks
           && first < last_block_num_in_file - 2 * initial_undo_blocks )
       {
          first = reindex_range( _block_id_to_block, first, last_block_num_in_file - 2 * initial_undo_blocks,
-            [this]( const signed_block& block ) {
-                apply_block( block, skip_witness_signature |
+            worker_count, stats,
+            [this]( const signed_block& block, uint32_t precomputed ) {
+                apply_block( precomputed_block( block ), skip_witness_signature |
                                     skip_transaction_signatures |
                                     skip_transaction_dupe_check |
                                     skip_tapos_check |
                                     skip_witness_schedule_check |
                                     skip_authority_check |
                                     skip_validate | /// no need to validate operations
-                                    skip_validate_invariants );
+                                    skip_validate_invariants |
+                                    precomputed );
             } );
          if( first > last_block_num_in_file - 2 * initial_undo_blocks )
          {
             ilog( "Writing database to disk at block ${i}", ("i",first-1) );
             flush();
+            reset_state_checkpoints();
             ilog( "Done" );
          }
       }
@@ -222,28 +393,35 @@ void database::reindex( fc::path data_dir )
           && first < last_block_num_in_file - initial_undo_blocks )
       {
          first = reindex_range( _block_id_to_block, first, last_block_num_in_file - initial_undo_blocks,
-            [this]( const signed_block& block ) {
-                apply_block( block, skip_witness_signature |
+            worker_count, stats,
+            [this]( const signed_block& block, uint32_t precomputed ) {
+                apply_block( precomputed_block( block ), skip_witness_signature |
                                     skip_transaction_signatures |
                                     skip_transaction_dupe_check |
                                     skip_tapos_check |
                                     skip_witness_schedule_check |
                                     skip_authority_check |
                                     skip_validate | /// no need to validate operations
-                                    skip_validate_invariants );
+                                    skip_validate_invariants |
+                                    precomputed );
             } );
       }
       if( first > 1 )
          _fork_db.start_block( *_block_id_to_block.fetch_by_number( first - 1 ) );
       _undo_db.enable();
 
-      reindex_range( _block_id_to_block, first, last_block_num_in_file,
-            [this]( const signed_block& block ) {
-                push_block( block, skip_nothing );
+      reindex_range( _block_id_to_block, first, last_block_num_in_file, worker_count, stats,
+            [this]( const signed_block& block, uint32_t precomputed ) {
+                push_block( block, skip_nothing | precomputed );
             } );
 
       auto end = fc::time_point::now();
       ilog( "Done reindexing, elapsed time: ${t} sec", ("t",double((end-start).count())/1000000.0 ) );
+      ilog( "Replayed ${b} blocks, decode: ${d} blocks/s per worker, apply: ${a} blocks/s, apply stage idle: ${w} sec",
+            ("b",stats.blocks)
+            ("d",uint64_t(replay_stats::per_second( stats.blocks, stats.decode_time )))
+            ("a",uint64_t(replay_stats::per_second( stats.blocks, stats.apply_time )))
+            ("w",double(stats.wait_time.count())/1000000.0) );
    }
    FC_CAPTURE_AND_RETHROW( (data_dir) )
 
@@ -293,9 +471,11 @@ void database::close(bool rewind)
       // we have to clear_pending() after we're done popping to get a clean
       // DB state (issue #336).
       clear_pending();
+      finish_state_snapshot_write( true );
 
       object_database::flush();
       object_database::close();
+      reset_state_checkpoints();
 
       if( _block_id_to_block.is_open() )
          _block_id_to_block.close();
@@ -307,6 +487,417 @@ void database::close(bool rewind)
    FC_CAPTURE_AND_RETHROW()
 }
 
+static fc::path state_checkpoint_dir( const fc::path& data_dir )
+{
+   return data_dir / "object_database" / "checkpoints";
+}
+
+/** Once this many checkpoints have been written since the last flush, they are folded into one */
+static const size_t max_state_checkpoints = 16;
+
+/** The checkpoint files in dir by block number */
+static std::map< uint32_t, fc::path > state_checkpoint_files( const fc::path& dir )
+{
+   std::map< uint32_t, fc::path > files;
+   for( fc::directory_iterator itr( dir ); itr != fc::directory_iterator(); ++itr )
+   {
+      const std::string name = itr->filename().generic_string();
+      if( !name.empty() && name.find_first_not_of( "0123456789" ) == std::string::npos )
+         files[ std::stoul( name ) ] = *itr;
+   }
+   return files;
+}
+
+static state_checkpoint read_state_checkpoint( const fc::path& file )
+{
+   std::string data;
+   fc::read_file_contents( file, data );
+   return fc::raw::unpack_from_vector<state_checkpoint>( vector<char>( data.begin(), data.end() ) );
+}
+
+/** Writes checkpoint to a temporary file first and renames it, so that a file named by its block is complete */
+static void write_state_checkpoint( const fc::path& dir, const state_checkpoint& checkpoint )
+{
+   const fc::path tmp = dir / "pending";
+   fc::create_directories( dir );
+   {
+      std::ofstream out( tmp.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+      FC_ASSERT( out );
+      fc::raw::pack( out, checkpoint );
+      out.flush();
+      FC_ASSERT( out );
+   }
+   fc::rename( tmp, dir / fc::to_string( checkpoint.block_num ) );
+}
+
+/**
+ *  Applies the checkpoints written since the last flush in order, each one
+ *  must build on the state left by its predecessor and its block must still
+ *  be part of the block log. Checkpoints that cannot be applied are removed.
+ *
+ *  @return false if a checkpoint did not lead to its block, then all
+ *  checkpoints are removed and the state must be reloaded from the last flush
+ */
+bool database::load_state_checkpoints()
+{ try {
+   const fc::path dir = state_checkpoint_dir( get_data_dir() );
+   if( !fc::exists( dir ) )
+      return true;
+
+   const std::map< uint32_t, fc::path > files = state_checkpoint_files( dir );
+
+   uint32_t applied = 0;
+   for( const auto& file : files )
+   {
+      optional<state_checkpoint> checkpoint;
+      try
+      {
+         checkpoint = read_state_checkpoint( file.second );
+      }
+      catch( const fc::exception& e )
+      {
+         wlog( "Unable to read state checkpoint ${f}: ${e}", ("f",file.second)("e",e.to_detail_string()) );
+      }
+
+      if( checkpoint.valid() && checkpoint->base_block_num == head_block_num()
+          && _block_id_to_block.contains( checkpoint->block_id ) )
+      {
+         try
+         {
+            apply_changes( checkpoint->changes );
+            FC_ASSERT( head_block_id() == checkpoint->block_id, "state checkpoint ${n} is inconsistent",
+                       ("n",checkpoint->block_num) );
+         }
+         catch( const fc::exception& e )
+         {
+            wlog( "Discarding all state checkpoints, unable to apply ${f}: ${e}",
+                  ("f",file.second)("e",e.to_detail_string()) );
+            fc::remove_all( dir );
+            return false;
+         }
+         ++applied;
+      }
+      else
+         fc::remove( file.second );
+   }
+   if( applied > 0 )
+      ilog( "Applied ${n} state checkpoints, database is at block ${b}", ("n",applied)("b",head_block_num()) );
+   return true;
+} FC_CAPTURE_AND_RETHROW() }
+
+/**
+ *  Called after every block pushed. Writes the pending checkpoint once its
+ *  block has become irreversible, and captures a new one when the head has
+ *  advanced by the checkpoint interval.
+ */
+void database::update_state_checkpoints()
+{
+   if( _state_checkpoint_interval == 0 )
+      return;
+
+   const uint32_t last_irreversible = get_dynamic_global_properties().last_irreversible_block_num;
+   if( _pending_state_checkpoint && last_irreversible >= _pending_state_checkpoint->block_num )
+   {
+      unique_ptr<state_checkpoint> checkpoint = std::move( _pending_state_checkpoint );
+      bool written = false;
+      if( _block_id_to_block.contains( checkpoint->block_id ) )
+      {
+         try
+         {
+            write_state_checkpoint( state_checkpoint_dir( get_data_dir() ), *checkpoint );
+            _state_checkpoint_base = checkpoint->block_num;
+            written = true;
+         }
+         catch( const fc::exception& e )
+         {
+            elog( "Unable to write state checkpoint at block ${n}: ${e}",
+                  ("n",checkpoint->block_num)("e",e.to_detail_string()) );
+         }
+      }
+      // the objects will be picked up again by the next checkpoint
+      if( !written )
+         restore_changes( checkpoint->changes );
+      else
+         fold_state_checkpoints();
+   }
+
+   if( !_pending_state_checkpoint && head_block_num() >= _state_checkpoint_base + _state_checkpoint_interval )
+   {
+      _pending_state_checkpoint.reset( new state_checkpoint );
+      _pending_state_checkpoint->base_block_num = _state_checkpoint_base;
+      _pending_state_checkpoint->block_num = head_block_num();
+      _pending_state_checkpoint->block_id = head_block_id();
+      _pending_state_checkpoint->changes = take_changes();
+   }
+}
+
+/**
+ *  Checkpoints are only removed by the next flush. Once max_state_checkpoints have piled up they
+ *  are merged into a single checkpoint from the flushed state to the newest one, so that their
+ *  number stays bounded and their size by the number of objects changed since the flush.
+ *
+ *  The folded checkpoint replaces the newest file before the older ones are removed. If that is
+ *  interrupted, load_state_checkpoints() applies the older files and discards the folded one.
+ */
+void database::fold_state_checkpoints()
+{
+   const fc::path dir = state_checkpoint_dir( get_data_dir() );
+   try
+   {
+      const std::map< uint32_t, fc::path > files = state_checkpoint_files( dir );
+      if( files.size() < max_state_checkpoints )
+         return;
+
+      auto itr = files.begin();
+      state_checkpoint folded = read_state_checkpoint( itr->second );
+      for( ++itr; itr != files.end(); ++itr )
+      {
+         state_checkpoint next = read_state_checkpoint( itr->second );
+         FC_ASSERT( next.base_block_num == folded.block_num, "state checkpoint ${n} does not follow ${p}",
+                    ("n",next.block_num)("p",folded.block_num) );
+         object_database::fold_changes( folded.changes, next.changes );
+         folded.block_num = next.block_num;
+         folded.block_id = next.block_id;
+      }
+      write_state_checkpoint( dir, folded );
+      for( const auto& file : files )
+         if( file.first != folded.block_num )
+            fc::remove( file.second );
+      ilog( "Folded ${n} state checkpoints into one at block ${b}", ("n",files.size())("b",folded.block_num) );
+   }
+   catch( const fc::exception& e )
+   {
+      // the checkpoints are left as they are, folding is tried again after the next one
+      elog( "Unable to fold state checkpoints: ${e}", ("e",e.to_detail_string()) );
+   }
+}
+
+/** The state on disk has been brought up to the head block, checkpoints start over from there */
+void database::reset_state_checkpoints()
+{
+   _pending_state_checkpoint.reset();
+   _state_checkpoint_base = head_block_num();
+}
+
+static fc::path state_snapshot_dir( const fc::path& data_dir )
+{
+   return data_dir / "state_snapshot";
+}
+
+/**
+ *  Runs on the state snapshot writer thread. The snapshot is written to a file named after its
+ *  block and hashed, only then does the info file name it as the newest snapshot.
+ */
+static state_snapshot_info write_state_snapshot( const fc::path& dir, const state_snapshot& snapshot, uint32_t chunk_size )
+{
+   FC_ASSERT( chunk_size > 0 );
+   state_snapshot_info info;
+   info.block_num  = block_header::num_from_id( snapshot.block_id );
+   info.block_id   = snapshot.block_id;
+   info.file       = dir / fc::to_string( info.block_num );
+   info.chunk_size = chunk_size;
+
+   fc::create_directories( dir );
+   const fc::path tmp = dir / "pending";
+   {
+      std::ofstream out( tmp.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+      FC_ASSERT( out );
+      fc::raw::pack( out, snapshot );
+      out.flush();
+      FC_ASSERT( out );
+   }
+   fc::rename( tmp, info.file );
+   info.size = fc::file_size( info.file );
+
+   // hashed once here, peers are served the hashes with every manifest
+   {
+      std::ifstream in( info.file.generic_string(), std::ifstream::binary );
+      vector<char> chunk( chunk_size );
+      fc::sha256::encoder enc;
+      for( uint64_t offset = 0; offset < info.size; offset += chunk_size )
+      {
+         const size_t length = size_t( std::min<uint64_t>( chunk_size, info.size - offset ) );
+         in.read( chunk.data(), length );
+         FC_ASSERT( in, "unable to read back ${f}", ("f",info.file) );
+         info.chunk_hashes.push_back( fc::sha256::hash( chunk.data(), length ) );
+         enc.write( chunk.data(), length );
+      }
+      info.hash = enc.result();
+   }
+
+   const fc::path info_tmp = dir / "info.pending";
+   {
+      std::ofstream out( info_tmp.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+      FC_ASSERT( out );
+      fc::raw::pack( out, info );
+      out.flush();
+      FC_ASSERT( out );
+   }
+   fc::rename( info_tmp, dir / "info" );
+   return info;
+}
+
+/** Finds the snapshot written before the last shutdown and the hashes computed when it was written */
+void database::load_state_snapshot_info()
+{
+   _state_snapshot_info = state_snapshot_info();
+   const fc::path dir = state_snapshot_dir( get_data_dir() );
+   if( _state_snapshot_interval == 0 || !fc::exists( dir / "info" ) )
+      return;
+   try
+   {
+      std::string data;
+      fc::read_file_contents( dir / "info", data );
+      state_snapshot_info info = fc::raw::unpack_from_vector<state_snapshot_info>( vector<char>( data.begin(), data.end() ) );
+      info.block_num = block_header::num_from_id( info.block_id );
+      info.file      = dir / fc::to_string( info.block_num );
+      FC_ASSERT( fc::exists( info.file ) && fc::file_size( info.file ) == info.size, "${f} is missing or truncated", ("f",info.file) );
+      if( info.chunk_size != _state_snapshot_chunk_size )
+      {
+         ilog( "Not offering the state snapshot at block ${n}, it was hashed in chunks of ${c} bytes",
+               ("n",info.block_num)("c",info.chunk_size) );
+         return;
+      }
+      _state_snapshot_info = std::move( info );
+   }
+   catch( const fc::exception& e )
+   {
+      wlog( "Ignoring unreadable state snapshot in ${d}: ${e}", ("d",dir)("e",e.to_detail_string()) );
+      _state_snapshot_info = state_snapshot_info();
+   }
+}
+
+/**
+ *  Called after every block pushed. Hands the pending snapshot to the writer thread once its
+ *  block has become irreversible, and captures a new one at every block whose number is a
+ *  multiple of the snapshot interval. The snapshot is offered once it has been written.
+ */
+void database::update_state_snapshots()
+{
+   if( _state_snapshot_interval == 0 )
+      return;
+
+   finish_state_snapshot_write( false );
+
+   const uint32_t last_irreversible = get_dynamic_global_properties().last_irreversible_block_num;
+   if( _pending_state_snapshot && !_state_snapshot_written.valid() &&
+       last_irreversible >= block_header::num_from_id( _pending_state_snapshot->block_id ) )
+   {
+      std::shared_ptr<state_snapshot> snapshot( std::move( _pending_state_snapshot ) );
+      // a snapshot of a block we switched away from is dropped
+      if( _block_id_to_block.contains( snapshot->block_id ) )
+      {
+         if( !_state_snapshot_writer )
+            _state_snapshot_writer.reset( new fc::thread( "state_snapshot" ) );
+         const fc::path dir = state_snapshot_dir( get_data_dir() );
+         const uint32_t chunk_size = _state_snapshot_chunk_size;
+         _state_snapshot_written = _state_snapshot_writer->async( [dir,snapshot,chunk_size]() {
+            return write_state_snapshot( dir, *snapshot, chunk_size );
+         }, "write_state_snapshot" );
+      }
+   }
+
+   if( !_pending_state_snapshot && head_block_num() % _state_snapshot_interval == 0 )
+   {
+      optional<signed_block> head = fetch_block_by_id( head_block_id() );
+      if( head.valid() )
+      {
+         _pending_state_snapshot.reset( new state_snapshot );
+         _pending_state_snapshot->db_version = _db_version;
+         _pending_state_snapshot->chain_id = get_chain_id();
+         _pending_state_snapshot->block_id = head_block_id();
+         _pending_state_snapshot->block = std::move( *head );
+         _pending_state_snapshot->objects = snapshot_objects();
+      }
+   }
+}
+
+/** Offers the snapshot the writer thread has finished, and removes the one offered before */
+void database::finish_state_snapshot_write( bool wait )
+{
+   if( !_state_snapshot_written.valid() || ( !wait && !_state_snapshot_written.ready() ) )
+      return;
+   fc::future<state_snapshot_info> written = _state_snapshot_written;
+   _state_snapshot_written = fc::future<state_snapshot_info>();
+   try
+   {
+      _state_snapshot_info = written.wait();
+      ilog( "Wrote state snapshot at block ${n}, ${s} bytes, sha256 ${h}",
+            ("n",_state_snapshot_info.block_num)("s",_state_snapshot_info.size)("h",_state_snapshot_info.hash) );
+   }
+   catch( const fc::exception& e )
+   {
+      elog( "Unable to write state snapshot: ${e}", ("e",e.to_detail_string()) );
+   }
+
+   const fc::path dir = state_snapshot_dir( get_data_dir() );
+   if( !fc::exists( dir ) )
+      return;
+   const std::string offered = _state_snapshot_info.file.filename().generic_string();
+   for( fc::directory_iterator itr( dir ); itr != fc::directory_iterator(); ++itr )
+   {
+      const std::string name = itr->filename().generic_string();
+      if( !name.empty() && name.find_first_not_of( "0123456789" ) == std::string::npos && name != offered )
+         try
+         {
+            fc::remove( *itr );
+         }
+         catch( const fc::exception& e )
+         {
+            wlog( "Unable to remove old state snapshot ${f}: ${e}", ("f",*itr)("e",e.to_detail_string()) );
+         }
+   }
+}
+
+void database::load_state_snapshot( const fc::path& file, const block_id_type& expected_block_id )
+{ try {
+   FC_ASSERT( head_block_num() == 0 && !_block_id_to_block.last_id().valid(),
+              "a state snapshot can only be loaded by a database that has not applied any block" );
+
+   // read in the order of state_snapshot, without holding all objects in memory at once
+   std::ifstream in( file.generic_string(), std::ifstream::binary );
+   FC_ASSERT( in, "unable to open ${f}", ("f",file) );
+   std::string db_version;
+   chain_id_type chain_id;
+   block_id_type block_id;
+   signed_block block;
+   fc::raw::unpack( in, db_version );
+   FC_ASSERT( in && db_version == _db_version, "state snapshot has objects of version ${v}, we have ${ours}",
+              ("v",db_version)("ours",_db_version) );
+   fc::raw::unpack( in, chain_id );
+   FC_ASSERT( in && chain_id == get_chain_id(), "state snapshot is of chain ${c}", ("c",chain_id) );
+   fc::raw::unpack( in, block_id );
+   FC_ASSERT( in && block_id == expected_block_id, "state snapshot is at block ${id}", ("id",block_id) );
+   fc::raw::unpack( in, block );
+   FC_ASSERT( in && block.id() == block_id, "the block of the state snapshot does not match its id" );
+
+   clear_pending();
+   _pending_state_checkpoint.reset();
+   _pending_state_snapshot.reset();
+
+   object_database::unload_all_objects();
+   fc::unsigned_int number_of_indexes;
+   fc::raw::unpack( in, number_of_indexes );
+   graphene::db::object_changes objects( 1 );
+   for( uint32_t i = 0; i < number_of_indexes.value; ++i )
+   {
+      objects.front() = graphene::db::index_changes();
+      fc::raw::unpack( in, objects.front() );
+      FC_ASSERT( in, "state snapshot is truncated" );
+      apply_changes( objects );
+   }
+   FC_ASSERT( head_block_id() == block_id, "state snapshot is inconsistent" );
+
+   _block_id_to_block.store( block_id, block );
+   _fork_db.reset();
+   _fork_db.start_block( block );
+
+   // put the state on disk right away, so that a restart does not fall back to genesis
+   object_database::flush();
+   reset_state_checkpoints();
+   ilog( "Loaded state snapshot at block ${n}", ("n",head_block_num()) );
+} FC_CAPTURE_AND_RETHROW( (file)(expected_block_id) ) }
+
 bool database::is_known_block( const block_id_type& id )const
 {
    return _fork_db.is_known_block(id) || _block_id_to_block.contains(id);
@@ -350,12 +941,30 @@ optional<signed_block> database::fetch_block_by_number( uint32_t num )const
    return optional<signed_block>();
 }
 
-const signed_transaction& database::get_recent_transaction(const transaction_id_type& trx_id) const
+signed_transaction database::get_recent_transaction(const transaction_id_type& trx_id) const
+{
+   optional<signed_transaction> trx = find_recent_transaction( trx_id );
+   FC_ASSERT( trx.valid(), "transaction ${id} is neither pending nor in a recent block", ("id",trx_id) );
+   return *trx;
+}
+
+optional<signed_transaction> database::find_recent_transaction(const transaction_id_type& trx_id) const
 {
    auto& index = get_index_type<transaction_index>().indices().get<by_trx_id>();
    auto itr = index.find(trx_id);
-   FC_ASSERT(itr != index.end());
-   return itr->trx;
+   if( itr == index.end() )
+      return optional<signed_transaction>();
+   if( itr->block_num == 0 )
+   {
+      auto pending = _pending_tx_index.find( trx_id );
+      if( pending == _pending_tx_index.end() )
+         return optional<signed_transaction>();
+      return _pending_tx[pending->second].get();
+   }
+   optional<signed_block> block = fetch_block_by_id( get_block_id_for_num( itr->block_num ) );
+   if( !block.valid() || itr->trx_in_block >= block->transactions.size() )
+      return optional<signed_transaction>();
+   return block->transactions[itr->trx_in_block];
 }
 
 std::vector<block_id_type> database::get_block_ids_on_fork(block_id_type head_of_fork) const
@@ -388,7 +997,7 @@ const fc::sha256& database::get_genesis_json_hash()const
 
 const account_object& database::get_account( const string& name )const
 {
-   const auto& accounts_by_name = get_index_type<account_index>().indices().get<by_name>();
+   const auto& accounts_by_name = get_index_type<account_index>().indices().get<by_name_hash>();
    auto itr = accounts_by_name.find(name);
    FC_ASSERT(itr != accounts_by_name.end(),
              "Unable to find account '${acct}'. Did you forget to add a record for it?",
@@ -423,7 +1032,7 @@ const limit_order_object& database::get_limit_order( const string& name, uint32_
 
 const witness_object& database::get_witness( const string& name ) const
 {
-   const auto& witnesses_by_name = get_index_type< witness_index >().indices().get< by_name >();
+   const auto& witnesses_by_name = get_index_type< witness_index >().indices().get< by_name_hash >();
    auto itr = witnesses_by_name.find( name );
    FC_ASSERT( itr != witnesses_by_name.end(),
               "Unable to find witness account '${wit}'. Did you forget to add a record for it?",
@@ -433,7 +1042,7 @@ const witness_object& database::get_witness( const string& name ) const
 
 const witness_object* database::find_witness( const string& name ) const
 {
-   const auto& witnesses_by_name = get_index_type< witness_index >().indices().get< by_name >();
+   const auto& witnesses_by_name = get_index_type< witness_index >().indices().get< by_name_hash >();
    auto itr = witnesses_by_name.find( name );
    if( itr == witnesses_by_name.end() ) return nullptr;
    return &*itr;
@@ -441,7 +1050,7 @@ const witness_object* database::find_witness( const string& name ) const
 
 const streaming_platform_object& database::get_streaming_platform( const string& name ) const
 {
-   const auto& streaming_platform_by_name = get_index_type< streaming_platform_index >().indices().get< by_name >();
+   const auto& streaming_platform_by_name = get_index_type< streaming_platform_index >().indices().get< by_name_hash >();
    auto itr = streaming_platform_by_name.find( name );
    FC_ASSERT( itr != streaming_platform_by_name.end(),
               "Unable to find streaming_platform account '${wit}'. Did you forget to add a record for it?",
@@ -451,7 +1060,7 @@ const streaming_platform_object& database::get_streaming_platform( const string&
 
 const streaming_platform_object* database::find_streaming_platform( const string& name ) const
 {
-   const auto& streaming_platform_by_name = get_index_type< streaming_platform_index >().indices().get< by_name >();
+   const auto& streaming_platform_by_name = get_index_type< streaming_platform_index >().indices().get< by_name_hash >();
    auto itr = streaming_platform_by_name.find( name );
    if( itr == streaming_platform_by_name.end() ) return nullptr;
    return &*itr;
@@ -460,7 +1069,7 @@ const streaming_platform_object* database::find_streaming_platform( const string
 const content_object& database::get_content( const string& url )const
 {
    try{
-      const auto& by_url_idx = get_index_type< content_index >().indices().get< by_url >();
+      const auto& by_url_idx = get_index_type< content_index >().indices().get< by_url_hash >();
       auto itr = by_url_idx.find(url);
       FC_ASSERT( itr != by_url_idx.end() );
       return *itr;
@@ -598,6 +1207,16 @@ bool database::before_last_checkpoint()const
  */
 bool database::push_block(const signed_block& new_block, uint32_t skip)
 {
+   return push_block( precomputed_block( new_block ), skip );
+}
+
+bool database::push_block(const precomputed_block& new_block, uint32_t skip)
+{
+   // may yield to other tasks, so it happens before pending transactions are undone
+   vector< optional< flat_set<public_key_type> > > signature_keys;
+   if( !(skip & (skip_transaction_signatures | skip_authority_check)) )
+      signature_keys = recover_signature_keys( new_block.get() );
+
    bool result;
    detail::with_skip_flags( *this, skip, [&]()
    {
@@ -606,20 +1225,27 @@ bool database::push_block(const signed_block& new_block, uint32_t skip)
       {
          try
          {
+            _recovered_keys_block_id = new_block.id();
+            _recovered_keys = std::move( signature_keys );
             result = _push_block(new_block);
+            _recovered_keys_block_id = block_id_type();
+            _recovered_keys.clear();
+            // before pending transactions are applied again, so that they are not captured
+            update_state_checkpoints();
+            update_state_snapshots();
          }
-         FC_CAPTURE_AND_RETHROW( (new_block) )
+         FC_CAPTURE_AND_RETHROW( (new_block.get()) )
       });
    });
    return result;
 }
 
-bool database::_push_block(const signed_block& new_block)
+bool database::_push_block(const precomputed_block& new_block)
 {
    uint32_t skip = get_node_properties().skip_flags;
    if( !(skip&skip_fork_db) )
    {
-      shared_ptr<fork_item> new_head = _fork_db.push_block(new_block);
+      shared_ptr<fork_item> new_head = _fork_db.push_block(new_block.get());
       //If the head block from the longest chain does not build off of the current head, we need to switch forks.
       if( new_head->data.previous != head_block_id() )
       {
@@ -645,7 +1271,7 @@ bool database::_push_block(const signed_block& new_block)
                 try
                 {
                    undo_database::session session = _undo_db.start_undo_session();
-                   apply_block( (*ritr)->data, skip );
+                   apply_block( precomputed_block( (*ritr)->data ), skip );
                    _block_id_to_block.store( (*ritr)->id, (*ritr)->data );
                    session.commit();
                 }
@@ -675,7 +1301,7 @@ bool database::_push_block(const signed_block& new_block)
                    {
                       ilog( "pushing block #${n} ${id}", ("n",(*ritr2)->data.block_num())("id",(*ritr2)->id) );
                       auto session = _undo_db.start_undo_session();
-                      apply_block( (*ritr2)->data, skip );
+                      apply_block( precomputed_block( (*ritr2)->data ), skip );
                       _block_id_to_block.store( (*ritr2)->id, (*ritr2)->data );
                       session.commit();
                    }
@@ -694,7 +1320,7 @@ bool database::_push_block(const signed_block& new_block)
    {
       auto session = _undo_db.start_undo_session();
       apply_block(new_block, skip);
-      _block_id_to_block.store(new_block.id(), new_block);
+      _block_id_to_block.store(new_block.id(), new_block.get());
       session.commit();
    }
    catch( const fc::exception& e )
@@ -717,12 +1343,17 @@ bool database::_push_block(const signed_block& new_block)
  * queues.
  */
 void database::push_transaction( const signed_transaction& trx, uint32_t skip )
+{
+   push_transaction( precomputed_transaction( trx ), skip );
+}
+
+void database::push_transaction( const precomputed_transaction& trx, uint32_t skip )
 {
    try
    {
       try
       {
-         FC_ASSERT( fc::raw::pack_size(trx) <= (get_dynamic_global_properties().maximum_block_size - 256) );
+         FC_ASSERT( trx.packed_size() <= (get_dynamic_global_properties().maximum_block_size - 256) );
          set_producing( true );
          detail::with_skip_flags( *this, skip, [&]() { _push_transaction( trx ); } );
          set_producing(false);
@@ -733,10 +1364,10 @@ void database::push_transaction( const signed_transaction& trx, uint32_t skip )
          throw;
       }
    }
-   FC_CAPTURE_AND_RETHROW( (trx) )
+   FC_CAPTURE_AND_RETHROW( (trx.get()) )
 }
 
-void database::_push_transaction( const signed_transaction& trx )
+void database::_push_transaction( const precomputed_transaction& trx )
 {
    // If this is the first transaction pushed after applying a block, start a new undo session.
    // This allows us to quickly rewind to the clean state of the head block, in case a new block arrives.
@@ -750,6 +1381,14 @@ void database::_push_transaction( const signed_transaction& trx )
 
    auto temp_session = _undo_db.start_undo_session();
    _apply_transaction( trx );
+   // hash the transaction for the merkle root now rather than when the block is produced
+   trx.merkle_digest();
+   const uint32_t skip = get_node_properties().skip_flags & transaction_skip_flags;
+   if( _pending_tx.empty() )
+      _pending_tx_skip_flags = skip;
+   else if( _pending_tx_skip_flags.valid() && *_pending_tx_skip_flags != skip )
+      _pending_tx_skip_flags.reset();
+   _pending_tx_index[ trx.id() ] = _pending_tx.size();
    _pending_tx.push_back( trx );
 
    notify_changed_objects();
@@ -757,7 +1396,7 @@ void database::_push_transaction( const signed_transaction& trx )
    temp_session.merge();
 
    // notify anyone listening to pending transactions
-   on_pending_transaction( trx );
+   on_pending_transaction( trx.get() );
 }
 
 signed_block database::generate_block(
@@ -849,60 +1488,118 @@ signed_block database::_generate_block(
    size_t total_block_size = fc::raw::pack_size( pending_block ) + 4;
    auto maximum_block_size = get_dynamic_global_properties().maximum_block_size;
 
-   //
-   // The following code throws away existing pending_tx_session and
-   // rebuilds it by re-applying pending transactions.
-   //
-   // This rebuild is necessary because pending transactions' validity
-   // and semantics may have changed since they were received, because
-   // time-based semantics are evaluated based on the current block
-   // time.  These changes can only be reflected in the database when
-   // the value of the "when" variable is known, which means we need to
-   // re-apply pending transactions in this method.
-   //
-   _pending_tx_session.reset();
-   _pending_tx_session = _undo_db.start_undo_session();
-
-   uint64_t postponed_tx_count = 0;
-   // pop pending state (reset to head block state)
-   for( const signed_transaction& tx : _pending_tx )
+   vector<precomputed_transaction> included_tx;
+   vector<digest_type> included_digests;
+
+   // _pending_tx_session is the result of applying _pending_tx on top of the
+   // head block, and the head block does not change before the new block is
+   // pushed. If all pending transactions were applied with the transaction
+   // skip flags used here, any prefix of them applies again with the same
+   // results. The longest prefix that fits is the candidate block and the
+   // rest is postponed, so the rebuild below is only needed when a candidate
+   // has expired or a transaction does not fit into any block. The soft forks
+   // checked before hardfork 0.6 depend on the wall clock and always take the
+   // rebuild.
+   bool use_candidate = has_hardfork( MUSE_HARDFORK_0_6 )
+                        && _pending_tx_session.valid()
+                        && _pending_tx_skip_flags.valid()
+                        && *_pending_tx_skip_flags == ( skip & transaction_skip_flags );
+   size_t candidate_count = 0;
+   if( use_candidate )
    {
-      // Only include transactions that have not expired yet for currently generating block,
-      // this should clear problem transactions and allow block production to continue
-
-      if( tx.expiration < when )
-         continue;
-
-      uint64_t new_total_size = total_block_size + fc::raw::pack_size( tx );
+      uint64_t new_total_size = total_block_size;
+      for( const precomputed_transaction& tx : _pending_tx )
+      {
+         new_total_size += tx.packed_size();
+         if( new_total_size >= maximum_block_size )
+         {
+            use_candidate = total_block_size + tx.packed_size() < maximum_block_size;
+            break;
+         }
+         if( tx->expiration < when )
+         {
+            use_candidate = false;
+            break;
+         }
+         ++candidate_count;
+      }
+   }
 
-      // postpone transaction if it would make block too big
-      if( new_total_size >= maximum_block_size )
+   if( use_candidate )
+   {
+      for( size_t i = 0; i < candidate_count; ++i )
+      {
+         const precomputed_transaction& tx = _pending_tx[i];
+         total_block_size += tx.packed_size();
+         pending_block.transactions.push_back( tx.get() );
+         included_tx.push_back( tx );
+         included_digests.push_back( tx.merkle_digest() );
+      }
+      if( candidate_count < _pending_tx.size() )
       {
-         postponed_tx_count++;
-         continue;
+         wlog( "Postponed ${n} transactions due to block size limit", ("n", _pending_tx.size() - candidate_count) );
       }
+   }
+   else
+   {
+      //
+      // The following code throws away existing pending_tx_session and
+      // rebuilds it by re-applying pending transactions.
+      //
+      // This rebuild is necessary because pending transactions' validity
+      // and semantics may have changed since they were received, because
+      // time-based semantics are evaluated based on the current block
+      // time.  These changes can only be reflected in the database when
+      // the value of the "when" variable is known, which means we need to
+      // re-apply pending transactions in this method.
+      //
+      uint64_t postponed_tx_count = 0;
+      _pending_tx_session.reset();
+      _pending_tx_session = _undo_db.start_undo_session();
 
-      try
+      // pop pending state (reset to head block state)
+      for( const precomputed_transaction& tx : _pending_tx )
       {
-         if( !has_hardfork( MUSE_HARDFORK_0_6 ) ) check_soft_fork( tx );
+         // Only include transactions that have not expired yet for currently generating block,
+         // this should clear problem transactions and allow block production to continue
+
+         if( tx->expiration < when )
+            continue;
 
-         auto temp_session = _undo_db.start_undo_session();
-         _apply_transaction( tx );
-         temp_session.merge();
+         uint64_t new_total_size = total_block_size + tx.packed_size();
 
-         total_block_size += fc::raw::pack_size( tx );
-         pending_block.transactions.push_back( tx );
+         // postpone transaction if it would make block too big
+         if( new_total_size >= maximum_block_size )
+         {
+            postponed_tx_count++;
+            continue;
+         }
+
+         try
+         {
+            if( !has_hardfork( MUSE_HARDFORK_0_6 ) ) check_soft_fork( tx.get() );
+
+            auto temp_session = _undo_db.start_undo_session();
+            _apply_transaction( tx );
+            temp_session.merge();
+
+            total_block_size += tx.packed_size();
+            pending_block.transactions.push_back( tx.get() );
+            included_tx.push_back( tx );
+            included_digests.push_back( tx.merkle_digest() );
+         }
+         catch ( const fc::exception& e )
+         {
+            // Do nothing, transaction will not be re-applied
+            wlog( "Transaction was not processed while generating block due to ${e}", ("e", e) );
+            wlog( "The transaction was ${t}", ("t", tx.get()) );
+         }
       }
-      catch ( const fc::exception& e )
+      if( postponed_tx_count > 0 )
       {
-         // Do nothing, transaction will not be re-applied
-         wlog( "Transaction was not processed while generating block due to ${e}", ("e", e) );
-         wlog( "The transaction was ${t}", ("t", tx) );
+         wlog( "Postponed ${n} transactions due to block size limit", ("n", postponed_tx_count) );
       }
-   }
-   if( postponed_tx_count > 0 )
-   {
-      wlog( "Postponed ${n} transactions due to block size limit", ("n", postponed_tx_count) );
+
    }
 
    _pending_tx_session.reset();
@@ -913,18 +1610,21 @@ signed_block database::_generate_block(
    // However, the push_block() call below will re-create the
    // _pending_tx_session.
 
-   pending_block.transaction_merkle_root = pending_block.calculate_merkle_root();
+   pending_block.transaction_merkle_root = signed_block::merkle_root_of( std::move( included_digests ) );
 
    if( !(skip & skip_witness_signature) )
       pending_block.sign( block_signing_private_key );
 
+   // the transactions were serialized and hashed above already, hand them on instead of doing it again
+   precomputed_block precomputed( pending_block, std::move( included_tx ) );
+
    // TODO:  Move this to _push_block() so session is restored.
    if( !(skip & skip_block_size_check) )
    {
-      FC_ASSERT( fc::raw::pack_size(pending_block) <= MUSE_MAX_BLOCK_SIZE );
+      FC_ASSERT( precomputed.packed_size() <= MUSE_MAX_BLOCK_SIZE );
    }
 
-   push_block( pending_block, skip );
+   push_block( precomputed, skip );
 
    return pending_block;
 }
@@ -959,6 +1659,7 @@ void database::clear_pending()
    {
       assert( (_pending_tx.size() == 0) || _pending_tx_session.valid() );
       _pending_tx.clear();
+      _pending_tx_index.clear();
       _pending_tx_session.reset();
    }
    FC_CAPTURE_AND_RETHROW()
@@ -1101,7 +1802,7 @@ asset database::create_vesting( const account_object& to_account, asset muse )
       } );
 
       adjust_proxied_witness_votes( to_account, new_vesting.amount );
-      recursive_recalculate_score( to_account, new_vesting.amount);
+      recursive_recalculate_score( to_account );
       return new_vesting;
    }
    FC_CAPTURE_AND_RETHROW( (to_account.name)(muse) )
@@ -1111,47 +1812,23 @@ bool database::is_voted_streaming_platform(string streaming_platform)const
 {
    //this is simple version to check if given account has been voted in as streaming_platform AT THE MOMENT of check...
    //not sute yet if this can cause any issues, e.g. race condition. Test carefully. 
-   int count =0;
-   const auto& spidx = get_index_type<streaming_platform_index>().indices().get<by_vote_name>();
-   for ( auto itr = spidx.begin(); 
-         itr != spidx.end() && count < MUSE_MAX_VOTED_STREAMING_PLATFORMS;
-         ++itr, ++count )
-   {
-      if (itr->owner.compare(streaming_platform) == 0)
-         return true;
-   }
-   return false;
+   const streaming_platform_object* sp = find_streaming_platform( streaming_platform );
+   return sp != nullptr && is_voted_streaming_platform( streaming_platform_id_type( sp->id ) );
+}
+
+bool database::is_voted_streaming_platform( streaming_platform_id_type streaming_platform )const
+{
+   return _voted_streaming_platforms->is_voted( get_index_type<streaming_platform_index>(), streaming_platform );
 }
 
 bool database::is_streaming_platform(string streaming_platform)const
 {
-   int count =0;
-   const auto& spidx = get_index_type<streaming_platform_index>().indices().get<by_vote_name>();
-   for ( auto&& itr = spidx.begin();
-         itr != spidx.end() && count < MUSE_MAX_VOTED_STREAMING_PLATFORMS;
-         ++itr )
-   {
-      if (itr->owner.compare(streaming_platform) == 0)
-         return true;
-      count++;
-   }
-   return false;
+   return is_voted_streaming_platform( streaming_platform );
 }
 
 vector<string> database::get_voted_streaming_platforms()
 {
-   int count =0;
-   vector<string> voted_sp;
-   const auto& spidx = get_index_type<streaming_platform_index>().indices().get<by_vote_name>();
-   for ( auto itr = spidx.begin();
-         itr != spidx.end() && count < MUSE_MAX_VOTED_STREAMING_PLATFORMS;
-          ++itr, ++count ) 
-   {
-      if (itr!=spidx.end())
-         voted_sp.push_back(itr->owner);
-   }
-
-   return voted_sp;
+   return _voted_streaming_platforms->get_voted( get_index_type<streaming_platform_index>() );
 }
 
 void database::update_witness_schedule4()
@@ -1589,7 +2266,7 @@ void database::process_vesting_withdrawals()
                });
 
                adjust_proxied_witness_votes( to_account, to_deposit );
-               recursive_recalculate_score( to_account, to_deposit);
+               recursive_recalculate_score( to_account );
                push_applied_operation( fill_vesting_withdraw_operation( from_account.name, to_account.name, asset( to_deposit, VESTS_SYMBOL ), asset( to_deposit, VESTS_SYMBOL ) ) );
             }
          }
@@ -1655,7 +2332,7 @@ void database::process_vesting_withdrawals()
 
       if( to_withdraw > 0 ) {
          adjust_proxied_witness_votes(from_account, -to_withdraw);
-         recursive_recalculate_score(from_account, -to_withdraw);
+         recursive_recalculate_score( from_account );
       }
 
       push_applied_operation( fill_vesting_withdraw_operation( from_account.name, from_account.name, asset( to_convert, VESTS_SYMBOL ), converted_muse ) );
@@ -1834,6 +2511,130 @@ static void adjust_statistics( database& db, const dynamic_global_property_objec
       });
 }
 
+/**
+ * Collects the effects of the content payouts of one cashout that only need to be applied once
+ * per object: the accumulated balances and play counters of each content, and the balance of
+ * each payee. Rewards are still split report by report, so rounding is the same as when every
+ * report is paid out on its own.
+ */
+struct content_payout_batch
+{
+   struct content_state
+   {
+      const content_object*          content = nullptr;
+      asset                          accumulated_master;
+      asset                          accumulated_comp;
+      vector<const account_object*>  master_payees;
+      vector<const account_object*>  comp_payees;
+      uint32_t                       plays = 0;
+   };
+
+   struct payee_state
+   {
+      const account_object* account = nullptr;
+      optional<asset>       muse_credit;
+      optional<asset>       mbd_credit;
+   };
+
+   std::map< content_id_type, content_state > contents;
+   std::map< account_id_type, payee_state >   payees;
+   optional<asset>                            converted_muse;
+   optional<asset>                            created_mbd;
+};
+
+static void add_to( optional<asset>& total, const asset& amount )
+{
+   if( total.valid() )
+      *total += amount;
+   else
+      total = amount;
+}
+
+static content_payout_batch::content_state& get_content_state( const database& db, content_payout_batch& batch,
+                                                                const content_object& co )
+{
+   const content_id_type id( co.id );
+   auto itr = batch.contents.find( id );
+   if( itr != batch.contents.end() )
+      return itr->second;
+
+   content_payout_batch::content_state& state = batch.contents[id];
+   state.content = &co;
+   state.accumulated_master = co.accumulated_balance_master;
+   state.accumulated_comp = co.accumulated_balance_comp;
+   for( const auto& di : co.distributions_master )
+      state.master_payees.push_back( &db.get_account( di.payee ) );
+   for( const auto& di : co.distributions_comp )
+      state.comp_payees.push_back( &db.get_account( di.payee ) );
+   return state;
+}
+
+/**
+ * Same as pay_to_content_master and pay_to_content_comp, except that the accumulated balance
+ * is kept in the batch and the payees are credited by flush_content_payouts.
+ */
+static void pay_to_distributions( database& db, content_payout_batch& batch, const content_object& co,
+                                  const vector<distribution>& distributions,
+                                  const vector<const account_object*>& payees,
+                                  asset& accumulated, const asset& payout, const char* side )
+{
+   if( distributions.size() == 0 )
+   {
+      accumulated += payout;
+      return;
+   }
+
+   asset to_pay = payout;
+   if( db.has_hardfork( MUSE_HARDFORK_0_2 ) )
+      to_pay += accumulated;
+   asset total_paid = asset( 0, to_pay.asset_id );
+   const auto& median_price = db.get_feed_history().actual_median_history;
+   for( size_t i = 0; i < distributions.size(); i++ )
+   {
+      const auto& di = distributions[i];
+      asset author_reward = to_pay;
+      author_reward.amount = author_reward.amount * di.bp / 10000;
+      total_paid += author_reward;
+
+      auto mbd_muse     = author_reward;
+      auto vesting_muse = author_reward - mbd_muse;
+
+      // what create_vesting and create_mbd would return
+      auto& payee = batch.payees[ payees[i]->get_id() ];
+      payee.account = payees[i];
+      auto vest_created = vesting_muse * db.get_dynamic_global_properties().get_vesting_share_price();
+      auto mbd_created = asset( 0, MBD_SYMBOL );
+      if( mbd_muse.amount != 0 )
+      {
+         if( !median_price.is_null() )
+         {
+            // the first MBD credit of a block pays the interest due, before this payout's virtual operation
+            if( payees[i]->mbd_seconds_last_update != db.head_block_time() )
+               db.adjust_balance( *payees[i], asset( 0, MBD_SYMBOL ) );
+            mbd_created = mbd_muse * median_price;
+            add_to( payee.mbd_credit, mbd_created );
+            add_to( batch.converted_muse, mbd_muse );
+            add_to( batch.created_mbd, mbd_created );
+         }
+         else
+         {
+            mbd_created = mbd_muse;
+            add_to( payee.muse_credit, mbd_muse );
+         }
+      }
+
+      db.push_applied_operation( content_reward_operation( di.payee, co.url, mbd_created, vest_created ) );
+   }
+   if( total_paid > to_pay )
+      elog( "Paid out too much for content ${side} ${co}: ${paid} > ${to_pay}",
+            ("side",side)("co",co)("paid",total_paid)("to_pay",to_pay) );
+   to_pay -= total_paid;
+   if( !db.has_hardfork( MUSE_HARDFORK_0_2 ) )
+      accumulated += to_pay;
+   else
+      accumulated = to_pay;
+}
+
 asset database::process_content_cashout( const asset& content_reward )
 { try {
    auto now = head_block_time();
@@ -1845,9 +2646,10 @@ asset database::process_content_cashout( const asset& content_reward )
    const auto& sp_user_idx = get_index_type< streaming_platform_user_index >().indices().get< by_consumer >();
    const auto& ridx = get_index_type<report_index>().indices().get<by_created>();
    const auto& dgpo = get_dynamic_global_properties();
-   auto itr = ridx.begin();
    flat_map<streaming_platform_id_type, sp_helper> platforms;
-   while ( itr != ridx.end() && itr->created <= cashing_time )
+   content_payout_batch batch;
+   vector<const report_object*> expired;
+   for( auto itr = ridx.begin(); itr != ridx.end() && itr->created <= cashing_time; ++itr )
    {
       const streaming_platform_id_type spinner_id = itr->spinning_platform.valid()
                                                          ? *itr->spinning_platform : itr->streaming_platform;
@@ -1890,7 +2692,7 @@ asset database::process_content_cashout( const asset& content_reward )
       auto report_reward = calculate_report_reward( *this, dgpo, total_payout, itr->play_time, sp->second,
                                                     total_listening_time );
       const content_object& content = get<content_object>( itr->content );
-      auto content_payment = pay_to_content( content, report_reward, itr->streaming_platform );
+      auto content_payment = pay_to_content( content, report_reward, itr->streaming_platform, batch );
       paid += content_payment;
       if( has_hardfork( MUSE_HARDFORK_0_5 ) )
       {
@@ -1925,10 +2727,13 @@ asset database::process_content_cashout( const asset& content_reward )
       else
          sp->second.anon_listening_time += itr->play_time;
 
-      remove(*itr);
-      itr = ridx.begin();
+      expired.push_back( &*itr );
    }
 
+   flush_content_payouts( batch );
+   for( const report_object* report : expired )
+      remove( *report );
+
    adjust_statistics( *this, dgpo, platforms );
 
    return paid;
@@ -2039,7 +2844,8 @@ void database::pay_to_platform( streaming_platform_id_type platform, const asset
    push_applied_operation(playing_reward_operation(pl.owner, url, mbd_created, vest_created ));
 }FC_LOG_AND_RETHROW() }
 
-asset database::pay_to_content(const content_object& content, asset payout, streaming_platform_id_type platform)
+asset database::pay_to_content(const content_object& content, asset payout, streaming_platform_id_type platform,
+                               content_payout_batch& batch)
 {try{
    asset paid (0);
    if( !has_hardfork(MUSE_HARDFORK_0_2) )
@@ -2052,9 +2858,12 @@ asset database::pay_to_content(const content_object& content, asset payout, stre
    comp_reward.amount = comp_reward.amount * content.publishers_share / MUSE_100_PERCENT;
    asset master_reward = payout - comp_reward;
 
-   pay_to_content_master(content, master_reward);
+   auto& state = get_content_state( *this, batch, content );
+   pay_to_distributions( *this, batch, content, content.distributions_master, state.master_payees,
+                         state.accumulated_master, master_reward, "master" );
    paid += master_reward;
-   pay_to_content_comp(content, comp_reward);
+   pay_to_distributions( *this, batch, content, content.distributions_comp, state.comp_payees,
+                         state.accumulated_comp, comp_reward, "composer" );
    paid += comp_reward;
    if( !has_hardfork(MUSE_HARDFORK_0_5) )
    {
@@ -2062,13 +2871,43 @@ asset database::pay_to_content(const content_object& content, asset payout, stre
       paid += platform_reward;
    }
 
-   modify<content_object>( content, []( content_object& c ) {
-      --c.times_played_24;
-   });
+   ++state.plays;
 
    return paid;
 }FC_LOG_AND_RETHROW() }
 
+void database::flush_content_payouts( content_payout_batch& batch )
+{try{
+   for( const auto& entry : batch.contents )
+   {
+      const auto& state = entry.second;
+      modify<content_object>( *state.content, [&state]( content_object& c ) {
+         c.accumulated_balance_master = state.accumulated_master;
+         c.accumulated_balance_comp = state.accumulated_comp;
+         c.times_played_24 -= state.plays;
+      });
+   }
+
+   for( const auto& entry : batch.payees )
+   {
+      const auto& payee = entry.second;
+      // a zero deposit still brings the votes of the payee's witnesses up to date, as every single payout did
+      create_vesting( *payee.account, asset( 0, MUSE_SYMBOL ) );
+      if( payee.mbd_credit.valid() )
+         adjust_balance( *payee.account, *payee.mbd_credit );
+      if( payee.muse_credit.valid() )
+         adjust_balance( *payee.account, *payee.muse_credit );
+   }
+
+   if( batch.converted_muse.valid() )
+   {
+      adjust_supply( -*batch.converted_muse );
+      adjust_supply( *batch.created_mbd );
+   }
+
+   batch = content_payout_batch();
+}FC_LOG_AND_RETHROW() }
+
 
 
 /**
@@ -2358,8 +3197,13 @@ void database::initialize_indexes()
    //Protocol object indexes
    auto acnt_index = add_index< primary_index<account_index> >();
    acnt_index->add_secondary_index<account_member_index>();
+   acnt_index->add_secondary_index<account_score_index>();
+   _account_scores = &acnt_index->get_secondary_index<account_score_index>();
+   _account_scores->set_undo_database( _undo_db );
 
-   add_index< primary_index< streaming_platform_index > >();
+   auto spi = add_index< primary_index< streaming_platform_index > >();
+   spi->add_secondary_index<voted_streaming_platform_index>();
+   _voted_streaming_platforms = &spi->get_secondary_index<voted_streaming_platform_index>();
    add_index< primary_index< stream_report_request_index > >();
    add_index< primary_index< report_index > >();
    add_index< primary_index< witness_index > >();
@@ -2514,7 +3358,7 @@ void database::init_genesis( const genesis_state_type& initial_allocation )
       } );
 
       // Helper function to get account ID by name
-      const auto& accounts_by_name = get_index_type<account_index>().indices().get<by_name>();
+      const auto& accounts_by_name = get_index_type<account_index>().indices().get<by_name_hash>();
       auto get_account_id = [&accounts_by_name](const string& name) {
          auto itr = accounts_by_name.find(name);
          FC_ASSERT(itr != accounts_by_name.end(),
@@ -2606,7 +3450,7 @@ void database::init_genesis( const genesis_state_type& initial_allocation )
 void database::validate_transaction( const signed_transaction& trx )
 {
    auto session = _undo_db.start_undo_session();
-   _apply_transaction( trx );
+   _apply_transaction( precomputed_transaction::view( trx ) );
    FC_UNUSED(session); // will be rolled back by destructor
 }
 
@@ -2617,13 +3461,13 @@ void database::notify_changed_objects()
       const auto& head_undo = _undo_db.head();
       vector<object_id_type> changed_ids;  changed_ids.reserve(head_undo.old_values.size());
       for( const auto& item : head_undo.old_values ) changed_ids.push_back(item.first);
-      for( const auto& item : head_undo.new_ids ) changed_ids.push_back(item);
+      for( const auto& item : head_undo.new_ids ) changed_ids.push_back(item.first);
       vector<const object*> removed;
       removed.reserve( head_undo.removed.size() );
       for( const auto& item : head_undo.removed )
       {
          changed_ids.push_back( item.first );
-         removed.emplace_back( item.second.get() );
+         removed.emplace_back( item.second );
       }
       changed_objects(changed_ids);
    }
@@ -2631,9 +3475,9 @@ void database::notify_changed_objects()
 
 //////////////////// private methods ////////////////////
 
-void database::apply_block( const signed_block& next_block, uint32_t skip )
+void database::apply_block( const precomputed_block& next_block, uint32_t skip )
 {
-   auto block_num = next_block.block_num();
+   auto block_num = next_block->block_num();
    if( _checkpoints.size() && _checkpoints.rbegin()->second != block_id_type() )
    {
       auto itr = _checkpoints.find( block_num );
@@ -2662,20 +3506,22 @@ void database::apply_block( const signed_block& next_block, uint32_t skip )
    } );
 }
 
-void database::_apply_block( const signed_block& next_block )
+void database::_apply_block( const precomputed_block& precomputed )
 { try {
+   const signed_block& next_block = precomputed.get();
    uint32_t next_block_num = next_block.block_num();
    uint32_t skip = get_node_properties().skip_flags;
+   block_profiler::lap_timer timer( _profiler );
 
-   FC_ASSERT( (skip & skip_merkle_check) || next_block.transaction_merkle_root == next_block.calculate_merkle_root(), "mysterious place...", ("next_block.transaction_merkle_root",next_block.transaction_merkle_root)("calc",next_block.calculate_merkle_root())("next_block",next_block)("id",next_block.id()) );
+   FC_ASSERT( (skip & skip_merkle_check) || next_block.transaction_merkle_root == precomputed.calculate_merkle_root(), "mysterious place...", ("next_block.transaction_merkle_root",next_block.transaction_merkle_root)("calc",precomputed.calculate_merkle_root())("next_block",next_block)("id",precomputed.id()) );
 
-   const witness_object& signing_witness = validate_block_header(skip, next_block);
+   const witness_object& signing_witness = validate_block_header(skip, precomputed);
 
    _current_block_num    = next_block_num;
    _current_trx_in_block = 0;
 
    const auto& gprops = get_dynamic_global_properties();
-   auto block_size = fc::raw::pack_size( next_block );
+   auto block_size = precomputed.packed_size();
    FC_ASSERT( block_size <= gprops.maximum_block_size, "Block Size is too Big", ("next_block_num",next_block_num)("block_size", block_size)("max",gprops.maximum_block_size) );
 
 
@@ -2693,7 +3539,12 @@ void database::_apply_block( const signed_block& next_block )
 
    bool soft_fork = !has_hardfork( MUSE_HARDFORK_0_6 )
                     && next_block.timestamp >= fc::time_point::now() - fc::seconds(30);
-   for( const auto& trx : next_block.transactions )
+   // keys recovered by push_block(), other blocks recover them synchronously while applied
+   static const vector< optional< flat_set<public_key_type> > > no_keys;
+   const auto& signature_keys = _recovered_keys_block_id == precomputed.id() ? _recovered_keys : no_keys;
+   timer.lap( block_profiler::validate_block );
+
+   for( const auto& trx : precomputed.transactions() )
    {
       /* We do not need to push the undo state for each transaction
        * because they either all apply and are valid or the
@@ -2701,25 +3552,36 @@ void database::_apply_block( const signed_block& next_block )
        * for transactions when validating broadcast transactions or
        * when building a block.
        */
-      if( soft_fork ) check_soft_fork( trx );
-      apply_transaction( trx, skip );
+      if( soft_fork ) check_soft_fork( trx.get() );
+      const auto* keys = _current_trx_in_block < signature_keys.size() && signature_keys[_current_trx_in_block].valid()
+                         ? &*signature_keys[_current_trx_in_block] : nullptr;
+      apply_transaction( trx, skip, keys );
       ++_current_trx_in_block;
    }
+   timer.lap( block_profiler::apply_transactions );
 
-   update_global_dynamic_data(next_block);
+   update_global_dynamic_data(precomputed);
+   timer.lap( block_profiler::update_global_dynamic_data );
    update_signing_witness(signing_witness, next_block);
+   timer.lap( block_profiler::update_signing_witness );
 
    update_last_irreversible_block();
+   timer.lap( block_profiler::update_last_irreversible_block );
 
-   create_block_summary(next_block);
+   create_block_summary(precomputed);
+   timer.lap( block_profiler::create_block_summary );
    clear_expired_transactions();
    clear_expired_proposals();
    clear_expired_orders();
    clear_expired_delegations();
+   timer.lap( block_profiler::clear_expired_objects );
    update_witness_schedule();
+   timer.lap( block_profiler::update_witness_schedule );
 
    update_median_feed();
+   timer.lap( block_profiler::update_median_feed );
    update_virtual_supply();
+   timer.split( block_profiler::update_virtual_supply );
 
    const auto content_reward = get_content_reward();
    const auto witness_pay = get_producer_reward();
@@ -2727,20 +3589,31 @@ void database::_apply_block( const signed_block& next_block )
                                                                            : get_vesting_reward();
 
    process_funds( content_reward, witness_pay, vesting_reward );
+   timer.lap( block_profiler::process_funds );
    process_conversions();
+   timer.lap( block_profiler::process_conversions );
    asset paid_for_content = process_content_cashout( content_reward );
+   timer.lap( block_profiler::process_content_cashout );
    adjust_funds( content_reward, paid_for_content );
+   timer.lap( block_profiler::adjust_funds );
    process_vesting_withdrawals();
+   timer.lap( block_profiler::process_vesting_withdrawals );
    update_virtual_supply();
+   timer.lap( block_profiler::update_virtual_supply );
 
    account_recovery_processing();
+   timer.lap( block_profiler::account_recovery_processing );
 
    process_hardforks();
+   timer.lap( block_profiler::process_hardforks );
 
    // notify observers that the block has been applied
    applied_block( next_block ); //emit
+   timer.lap( block_profiler::applied_block_observers );
 
    notify_changed_objects();
+   timer.lap( block_profiler::notify_changed_objects );
+   _profiler.block_applied();
 }
 FC_LOG_AND_RETHROW() }
 
@@ -2855,22 +3728,69 @@ try {
    }
 } FC_CAPTURE_AND_RETHROW() }
 
-void database::apply_transaction(const signed_transaction& trx, uint32_t skip)
+vector< optional< flat_set<public_key_type> > > database::recover_signature_keys( const signed_block& b )
 {
-   detail::with_skip_flags( *this, skip, [&]() { _apply_transaction(trx); });
+   vector< optional< flat_set<public_key_type> > > result( b.transactions.size() );
+   size_t signatures = 0;
+   for( const auto& trx : b.transactions )
+      signatures += trx.signatures.size();
+
+   uint32_t worker_count = _signature_threads;
+   if( worker_count == 0 )
+      worker_count = std::max( std::thread::hardware_concurrency(), 2u ) - 1;
+   if( worker_count < 2 || signatures < 2 )
+      return result;
+
+   while( _signature_workers.size() < worker_count )
+      _signature_workers.emplace_back( new fc::thread( "signatures_" + fc::to_string( uint64_t(_signature_workers.size()) ) ) );
+
+   // contiguous ranges with about the same number of signatures each
+   const chain_id_type& chain_id = MUSE_CHAIN_ID;
+   const size_t per_worker = ( signatures + worker_count - 1 ) / worker_count;
+   std::vector< fc::future<void> > pending;
+   size_t first = 0;
+   for( uint32_t w = 0; w < worker_count && first < b.transactions.size(); ++w )
+   {
+      size_t last = first;
+      size_t assigned = 0;
+      while( last < b.transactions.size() && ( assigned < per_worker || last == first ) )
+         assigned += b.transactions[last++].signatures.size();
+      pending.push_back( _signature_workers[w]->async( [this,&b,&result,&chain_id,first,last]() {
+         for( size_t i = first; i < last; ++i )
+            try
+            {
+               result[i] = _signature_cache.get_signature_keys( b.transactions[i], chain_id );
+            }
+            catch( const fc::exception& )
+            {
+            }
+      }, "recover_signature_keys" ) );
+      first = last;
+   }
+   for( auto& f : pending )
+      f.wait();
+   return result;
+}
+
+void database::apply_transaction(const precomputed_transaction& trx, uint32_t skip,
+                                 const flat_set<public_key_type>* signature_keys)
+{
+   detail::with_skip_flags( *this, skip, [&]() { _apply_transaction( trx, signature_keys, true ); });
 }
 
-void database::_apply_transaction(const signed_transaction& trx)
+void database::_apply_transaction(const precomputed_transaction& precomputed, const flat_set<public_key_type>* signature_keys,
+                                  bool in_block)
 { try {
-   _current_trx_id = trx.id();
+   const signed_transaction& trx = precomputed.get();
+   const transaction_id_type& trx_id = precomputed.id();
+   _current_trx_id = trx_id;
    uint32_t skip = get_node_properties().skip_flags;
 
    if( !(skip&skip_validate) )   /* issue #505 explains why this skip_flag is disabled */
-      trx.validate();
+      precomputed.validate();
 
    auto& trx_idx = get_mutable_index_type<transaction_index>();
    const chain_id_type& chain_id = MUSE_CHAIN_ID;
-   auto trx_id = trx.id();
    FC_ASSERT( (skip & skip_transaction_dupe_check) ||
               trx_idx.indices().get<by_trx_id>().find(trx_id) == trx_idx.indices().get<by_trx_id>().end() );
    transaction_evaluation_state eval_state(this);
@@ -2884,14 +3804,18 @@ void database::_apply_transaction(const signed_transaction& trx)
       auto get_master_cont = [&]( const string& url ) { return &get_content(url).manage_master; };
       auto get_comp_cont = [&]( const string& url ) { return &get_content(url).manage_comp; };
 
-      trx.verify_authority( chain_id, get_active, get_owner, get_basic, get_master_cont, get_comp_cont,
-                            has_hardfork( MUSE_HARDFORK_0_4 ) ? 3 :
-                            has_hardfork( MUSE_HARDFORK_0_3 ) ? 2 : 1 );
+      const uint32_t version = has_hardfork( MUSE_HARDFORK_0_4 ) ? 3 :
+                               has_hardfork( MUSE_HARDFORK_0_3 ) ? 2 : 1;
+      if( signature_keys != nullptr )
+         trx.verify_authority( *signature_keys, get_active, get_owner, get_basic, get_master_cont, get_comp_cont, version );
+      else
+         trx.verify_authority( _signature_cache.get_signature_keys( trx, chain_id ),
+                               get_active, get_owner, get_basic, get_master_cont, get_comp_cont, version );
    }
    flat_set<string> required; vector<authority> other;
    flat_set<string> required_content;
    trx.get_required_authorities( required, required, required, required_content, required_content, other );
-   auto trx_size = fc::raw::pack_size(trx);
+   auto trx_size = precomputed.packed_size();
 
    for( const auto& auth : required ) {
       const auto& acnt = get_account(auth);
@@ -2932,7 +3856,12 @@ void database::_apply_transaction(const signed_transaction& trx)
    {
       create<transaction_object>([&](transaction_object& transaction) {
          transaction.trx_id = trx_id;
-         transaction.trx = trx;
+         transaction.expiration = trx.expiration;
+         if( in_block )
+         {
+            transaction.block_num = _current_block_num;
+            transaction.trx_in_block = _current_trx_in_block;
+         }
       });
    }
 
@@ -2946,7 +3875,7 @@ void database::_apply_transaction(const signed_transaction& trx)
    }
    _current_trx_id = transaction_id_type();
 
-} FC_CAPTURE_AND_RETHROW( (trx) ) }
+} FC_CAPTURE_AND_RETHROW( (precomputed.get()) ) }
 
 void database::apply_operation(transaction_evaluation_state& eval_state, const operation& op)
 { try {
@@ -2957,18 +3886,23 @@ void database::apply_operation(transaction_evaluation_state& eval_state, const o
    unique_ptr<op_evaluator>& eval = _operation_evaluators[ u_which ];
    FC_ASSERT( eval, "No registered evaluator for operation ${op}", ("op",op) );
    push_applied_operation( op );
+   const bool profile = _profiler.enabled() && _profiler.in_block();
+   const fc::time_point start = profile ? fc::time_point::now() : fc::time_point();
    eval->evaluate( eval_state, op, true );
+   if( profile )
+      _profiler.record_operation( i_which, fc::time_point::now() - start );
    notify_post_apply_operation( op );
 } FC_CAPTURE_AND_RETHROW(  ) }
 
-const witness_object& database::validate_block_header( uint32_t skip, const signed_block& next_block )const
+const witness_object& database::validate_block_header( uint32_t skip, const precomputed_block& precomputed )const
 {
+   const signed_block& next_block = precomputed.get();
    FC_ASSERT( head_block_id() == next_block.previous, "", ("head_block_id",head_block_id())("next.prev",next_block.previous) );
    FC_ASSERT( head_block_time() < next_block.timestamp, "", ("head_block_time",head_block_time())("next",next_block.timestamp)("blocknum",next_block.block_num()) );
    const witness_object& witness = get_witness( next_block.witness ); //(*this);
 
    if( !(skip&skip_witness_signature) )
-      FC_ASSERT( next_block.validate_signee( witness.signing_key ) );
+      FC_ASSERT( precomputed.signee() == witness.signing_key );
 
    if( !(skip&skip_witness_schedule_check) )
    {
@@ -2984,17 +3918,18 @@ const witness_object& database::validate_block_header( uint32_t skip, const sign
    return witness;
 }
 
-void database::create_block_summary(const signed_block& next_block)
+void database::create_block_summary(const precomputed_block& next_block)
 {
-   block_summary_id_type sid(next_block.block_num() & 0xffff );
+   block_summary_id_type sid(next_block->block_num() & 0xffff );
    modify( sid(*this), [&](block_summary_object& p) {
          p.block_id = next_block.id();
    });
 }
 
-void database::update_global_dynamic_data( const signed_block& b )
+void database::update_global_dynamic_data( const precomputed_block& precomputed )
 {
-   auto block_size = fc::raw::pack_size(b);
+   const signed_block& b = precomputed.get();
+   auto block_size = precomputed.packed_size();
    const dynamic_global_property_object& _dgp =
       dynamic_global_property_id_type(0)(*this);
 
@@ -3032,7 +3967,7 @@ void database::update_global_dynamic_data( const signed_block& b )
       }
 
       dgp.head_block_number = b.block_num();
-      dgp.head_block_id = b.id();
+      dgp.head_block_id = precomputed.id();
       dgp.time = b.timestamp;
       dgp.current_aslot += missed_blocks+1;
       dgp.average_block_size = (99 * dgp.average_block_size + block_size)/100;
@@ -3321,7 +4256,7 @@ void database::clear_expired_transactions()
    //Transactions must have expired by at least two forking windows in order to be removed.
    auto& transaction_idx = static_cast<transaction_index&>(get_mutable_index(implementation_ids, impl_transaction_object_type));
    const auto& dedupe_index = transaction_idx.indices().get<by_expiration>();
-   while( (!dedupe_index.empty()) && (head_block_time() > dedupe_index.begin()->trx.expiration) )
+   while( (!dedupe_index.empty()) && (head_block_time() > dedupe_index.begin()->expiration) )
       transaction_idx.remove(*dedupe_index.begin());
 }
 
@@ -3810,16 +4745,7 @@ void database::retally_witness_vote_counts( bool force )
 
 uint64_t database::get_scoring(const account_object& ao ) const
 {
-   uint64_t score = detail::isqrt(ao.get_scoring_vesting());
-   for ( const auto & a : ao.friends ) {
-      const auto& f = get<account_object>(a);
-      score += detail::isqrt(f.get_scoring_vesting()) * MUSE_1ST_LEVEL_SCORING_PERCENTAGE / 100;
-   }
-   for ( const auto & a : ao.second_level ){
-      const auto& sl = get<account_object>( a );
-      score += detail::isqrt(sl.get_scoring_vesting()) * MUSE_2ST_LEVEL_SCORING_PERCENTAGE / 100;
-   }
-   return score;
+   return _account_scores->get_score( ao.id );
 }
 
 uint64_t database::get_scoring(const content_object& co ) const
@@ -3841,47 +4767,30 @@ uint64_t database::get_scoring(const content_object& co ) const
    return score;
 }
 
-void database::recursive_recalculate_score(const account_object& a, share_type delta)
-{
-   share_type old_amount = a.vesting_shares.amount - delta;
-   int64_t score_delta = ((int64_t) detail::isqrt(a.get_scoring_vesting())) - detail::isqrt(old_amount.value);
-
-   modify<account_object>(a,[score_delta](account_object& ao){
-        ao.score += score_delta;
-   });
-
-   for( auto &f:a.friends ) {
-      const auto& f_object = get<account_object>(f);
-      modify<account_object>(f_object,[score_delta](account_object& ao){
-           ao.score += score_delta * MUSE_1ST_LEVEL_SCORING_PERCENTAGE / 100;
-      });
-   }
-
-   for( auto &f:a.second_level ) {
-      const auto& f_object = get<account_object>(f);
-      modify<account_object>(f_object,[score_delta](account_object& ao){
-           ao.score += score_delta * MUSE_2ST_LEVEL_SCORING_PERCENTAGE / 100;
-      });
-   }
-}
-
 void database::recalculate_score(const account_object& a) {
-   uint64_t score = detail::isqrt(a.get_scoring_vesting());
-
-   for( auto &f:a.friends ) {
-      const auto& f_object = get<account_object>(f);
-      score += detail::isqrt(f_object.get_scoring_vesting()) * MUSE_1ST_LEVEL_SCORING_PERCENTAGE / 100;
-   }
-
-   for( auto &f:a.second_level ) {
-      const auto& f_object = get<account_object>(f);
-      score += detail::isqrt(f_object.get_scoring_vesting()) * MUSE_2ST_LEVEL_SCORING_PERCENTAGE / 100;
-   }
+   const uint64_t score = _account_scores->get_score( a.id );
    modify<account_object>(a,[&](account_object& ao){
         ao.score = score;
    });
 };
 
+/**
+ *  Refreshes the stored score of a, whose vesting changed, and of every account that has a among its
+ *  friends or second_level, since their scores include a's vesting.
+ */
+void database::recursive_recalculate_score( const account_object& a )
+{
+   recalculate_score( a );
+   for( const account_id_type& id : _account_scores->get_dependents( a.id ) )
+      recalculate_score( get<account_object>( id ) );
+}
+
+void database::modify_social_graph( const account_object& a, const std::function<void(account_object&)>& m )
+{
+   _account_scores->edges_changed( a.get_id() );
+   modify( a, m );
+}
+
 namespace detail {
 uint32_t isqrt(uint64_t a) {
    uint64_t rem = 0;
@@ -7,9 +7,12 @@
 #include <muse/chain/streaming_platform_objects.hpp>
   
 #include <graphene/db/generic_index.hpp>
+#include <graphene/db/undo_database.hpp>
 
 #include <boost/multi_index/composite_key.hpp>
+#include <boost/multi_index/hashed_index.hpp>
 
+#include <memory>
 #include <numeric>
 
 namespace muse { namespace chain {
@@ -26,6 +29,8 @@ namespace muse { namespace chain {
 
          static const uint8_t space_id = implementation_ids;
          static const uint8_t type_id  = impl_account_object_type;
+         /// mostly modified in counters and balances, the sets and maps need not be copied for undo
+         static const bool serialized_undo = true;
 
          string          name;
          authority       owner; ///< used for backup control, can set owner or active
@@ -46,7 +51,7 @@ namespace muse { namespace chain {
          time_point_sec  last_account_recovery;
          uint32_t        lifetime_vote_count = 0;
 
-         uint64_t        score=0;
+         uint64_t        score=0; ///< as of the last database::recalculate_score, see database::get_scoring
          
          uint32_t        total_listening_time = 0;
          map<streaming_platform_id_type,uint32_t> total_time_by_platform;
@@ -135,9 +140,9 @@ namespace muse { namespace chain {
          }
 
 
-         std::set<account_id_type> friends;
-         std::set<account_id_type> second_level;
-         std::set<account_id_type> waiting;
+         flat_set<account_id_type> friends;
+         flat_set<account_id_type> second_level;
+         flat_set<account_id_type> waiting;
 
          uint64_t get_scoring_vesting() const { return vesting_shares.amount.value; }
 
@@ -190,6 +195,66 @@ namespace muse { namespace chain {
          set<public_key_type>    before_key_members;
    };
 
+   /**
+    *  @brief This secondary index maintains the score that database::recalculate_score assigns to each account.
+    *
+    *  The index keeps sorted copies of every account's friends and second_level sets together with the reverse
+    *  edges. A change of an account's vesting adjusts the scores of the accounts that list it, a change of its
+    *  sets only adds or subtracts the terms of the entries that differ, so both cost O(degree).
+    *
+    *  The sets are taken over when a modification was announced with edges_changed(), as done by
+    *  database::modify_social_graph, or when an undo state is rolled back. Any other modification of an
+    *  account only checks that its sets are still the ones indexed, and resyncs them if not.
+    */
+   class account_score_index : public secondary_index
+   {
+      public:
+         virtual void object_inserted( const object& obj ) override;
+         virtual void object_removed( const object& obj ) override;
+         virtual void object_modified( const object& after  ) override;
+
+         /** the score of the account, equal to database::get_scoring of its current state */
+         uint64_t get_score( account_id_type account )const;
+
+         /** the accounts having account among their friends or second_level, whose scores include its vesting */
+         vector< account_id_type > get_dependents( account_id_type account )const;
+
+         /** the next modification of account changes its friends or second_level sets */
+         void edges_changed( account_id_type account ) { _edges_changed = account; }
+
+         /** rolled back modifications may restore any earlier sets */
+         void set_undo_database( const undo_database& undo ) { _undo_db = &undo; }
+
+      private:
+         struct edges
+         {
+            vector< account_id_type > friends;
+            vector< account_id_type > second_level;
+            vector< account_id_type > friend_of;       ///< accounts that have this one in their friends
+            vector< account_id_type > second_level_of; ///< accounts that have this one in their second_level
+         };
+
+         struct node
+         {
+            uint64_t                  vesting = 0;
+            uint32_t                  root = 0; ///< isqrt of vesting
+            uint64_t                  score = 0;
+            std::unique_ptr< edges >  graph;
+         };
+
+         void set_vesting( account_id_type account, uint64_t vesting );
+         void set_edges( account_id_type account, const flat_set< account_id_type >& friends,
+                         const flat_set< account_id_type >& second_level );
+         void update_level( account_id_type account, vector< account_id_type >& current,
+                            const flat_set< account_id_type >& updated,
+                            vector< account_id_type > edges::*reverse, uint16_t percentage );
+         bool same_edges( const account_object& a )const;
+
+         vector< node >                _nodes;
+         optional< account_id_type >   _edges_changed;
+         const undo_database*          _undo_db = nullptr;
+   };
+
    class vesting_delegation_object : public abstract_object< vesting_delegation_object >
    {
       public:
@@ -253,6 +318,7 @@ namespace muse { namespace chain {
    };
 
    struct by_name;
+   struct by_name_hash;
    struct by_proxy;
    struct by_next_vesting_withdrawal;
    struct by_muse_balance;
@@ -271,6 +337,8 @@ namespace muse { namespace chain {
             member< object, object_id_type, &object::id > >,
          ordered_unique< tag< by_name >,
             member< account_object, string, &account_object::name > >,
+         hashed_unique< tag< by_name_hash >,
+            member< account_object, string, &account_object::name >, std::hash< string > >,
          ordered_unique< tag< by_proxy >,
             composite_key< account_object,
                member< account_object, string, &account_object::proxy >,
@@ -514,3 +582,9 @@ FC_REFLECT_DERIVED( muse::chain::change_recovery_account_request_object, (graphe
 FC_REFLECT_DERIVED( muse::chain::account_balance_object, (graphene::db::object), 
                     (owner)(asset_type)(balance) 
                   )
+
+GRAPHENE_DB_INDEX_KEYS( muse::chain::account_object,
+                        (name)(proxy)(next_vesting_withdrawal)(balance)(vesting_shares)(mbd_balance)
+                        (lifetime_vote_count)(last_owner_update)
+                        (owner)(active)(basic)(memo_key) // account_member_index
+                        (friends)(second_level) )         // account_score_index
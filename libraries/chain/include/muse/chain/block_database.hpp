@@ -2,14 +2,49 @@
 #include <fstream>
 #include <muse/chain/protocol/block.hpp>
 
+#include <fc/interprocess/file_mapping.hpp>
+
+#include <boost/thread/shared_mutex.hpp>
+
+#include <atomic>
+
 namespace muse { namespace chain {
    class index_entry;
 
+   struct block_id_index_stats
+   {
+      uint32_t index_size = 0; ///< highest block number in the index + 1
+      uint64_t hits = 0;       ///< id lookups that found a stored block
+      uint64_t misses = 0;     ///< id lookups answered negatively without touching the files
+   };
+
+   /**
+    *  Stores irreversible blocks on disk, indexed by block number.
+    *
+    *  All public methods are safe to call concurrently. Writes are serialized
+    *  against each other and against readers, blocks are deserialized outside
+    *  of the lock. When opened with use_mmap, the index and blocks files are
+    *  additionally mapped read-only and readers are served from the mappings
+    *  under a shared lock, so that lookups from several threads do not queue
+    *  behind a single file stream. The mappings extend past the end of the
+    *  files and are only renewed once a file has grown beyond them.
+    *
+    *  When opened with compress, new blocks are stored as zlib frames, using
+    *  the preset dictionary kept next to the blocks file if there is one.
+    *  Compressed frames are flagged in the index entry, so a blocks file may
+    *  mix raw and compressed blocks and existing files remain readable.
+    *
+    *  The ids of all blocks are loaded into memory on open and kept in sync
+    *  by store and remove, so that contains, fetch_block_id and unknown ids
+    *  passed to fetch_optional are answered without reading either file.
+    */
    class block_database
    {
       public:
-         void open( const fc::path& dbdir );
+         void open( const fc::path& dbdir, bool use_mmap = false, bool compress = false );
          bool is_open()const;
+         bool is_mmap_enabled()const { return _use_mmap; }
+         bool is_compression_enabled()const { return _compress; }
          void flush();
          void close();
 
@@ -22,10 +57,86 @@ namespace muse { namespace chain {
          optional<signed_block> fetch_by_number( uint32_t block_num )const;
          optional<signed_block> last()const;
          optional<block_id_type> last_id()const;
+
+         /**
+          *  Installs the preset dictionary for compressed frames and saves it in
+          *  the database directory. Only allowed while no block has been stored,
+          *  frames written with a dictionary cannot be read without it.
+          */
+         void set_dictionary( const vector<char>& dictionary );
+         const vector<char>& get_dictionary()const { return _dictionary; }
+
+         block_id_index_stats get_id_index_stats()const;
+
+         /**
+          *  Builds a preset dictionary of at most max_size bytes from a sample
+          *  of packed blocks, byte strings shared by many samples are kept and
+          *  the most frequent ones are placed last, where zlib finds them cheapest.
+          */
+         static vector<char> train_dictionary( const vector< vector<char> >& samples, size_t max_size = 32 * 1024 );
       private:
-         optional<index_entry> last_index_entry()const;
+         typedef boost::shared_lock<boost::shared_mutex> read_lock;
+         typedef boost::unique_lock<boost::shared_mutex> write_lock;
+
+         optional<index_entry>  last_index_entry()const;
+
+         /// The following helpers expect the caller to hold _lock
+         /// @{
+         bool                   read_index_entry( uint32_t block_num, index_entry& e )const;
+         bool                   read_block_data( const index_entry& e, vector<char>& data )const;
+         bool                   mappings_current()const;
+         void                   remap()const;
+         void                   unmap()const;
+         /// @}
+
+         void                   load_id_index();
+         void                   set_id_index_entry( uint32_t block_num, const block_id_type& id, bool stored );
+         bool                   id_index_contains( const block_id_type& id )const;
+
+         /// compresses a packed block into a frame, returns an empty vector if that does not pay off
+         vector<char>           encode_frame( const vector<char>& packed )const;
+         /// unpacks the block stored for e, may be called without holding _lock
+         signed_block           decode_block( const index_entry& e, const vector<char>& data )const;
+
+         /**
+          *  Runs f under a shared lock if the mappings cover the current file
+          *  sizes, otherwise remaps with headroom under an exclusive lock first. Without mmap
+          *  the fstreams are shared state, so f always runs exclusively.
+          */
+         template<typename Lambda>
+         auto with_read_access( Lambda&& f )const -> decltype( f() );
+
          fc::path _index_filename;
+         fc::path _blocks_filename;
+         fc::path _dictionary_filename;
          mutable std::fstream _blocks;
          mutable std::fstream _block_num_to_pos;
+
+         /// sizes of the files on disk, tracked here so readers need not seek to the end
+         mutable uint64_t _index_size  = 0;
+         uint64_t         _blocks_size = 0;
+
+         bool                                   _use_mmap = false;
+         bool                                   _compress = false;
+         vector<char>                           _dictionary;
+         mutable std::unique_ptr<fc::file_mapping>  _index_mapping;
+         mutable std::unique_ptr<fc::mapped_region> _index_region;
+         mutable std::unique_ptr<fc::file_mapping>  _blocks_mapping;
+         mutable std::unique_ptr<fc::mapped_region> _blocks_region;
+
+         /**
+          *  In-memory copy of the ids in the index file, addressed by block
+          *  number. The number is part of the id, so the slot of an id is
+          *  known without probing and only the remaining 16 bytes are kept.
+          */
+         struct id_suffix { uint32_t hash[4]; };
+         mutable vector<id_suffix> _id_index;
+         mutable vector<bool>      _id_stored; ///< false for removed blocks
+         mutable std::atomic<uint64_t> _id_hits{0};
+         mutable std::atomic<uint64_t> _id_misses{0};
+
+         mutable boost::shared_mutex _lock;
    };
 } }
+
+FC_REFLECT( muse::chain::block_id_index_stats, (index_size)(hits)(misses) )
@@ -0,0 +1,139 @@
+#pragma once
+#include <muse/chain/protocol/types.hpp>
+
+#include <fc/time.hpp>
+
+#include <functional>
+
+namespace muse { namespace chain {
+
+   /**
+    *  Timings of one measured stage. histogram[i] counts the samples that took
+    *  less than 2^i microseconds, the last bucket counts all longer ones.
+    */
+   struct timing_stats
+   {
+      string             name;
+      uint64_t           count = 0;
+      uint64_t           total_us = 0;
+      uint64_t           max_us = 0;
+      vector< uint64_t > histogram;
+
+      void add( int64_t us );
+   };
+
+   struct block_profile
+   {
+      uint64_t               blocks = 0;
+      vector< timing_stats > stages;
+      vector< timing_stats > operations; ///< by operation type, only types that were applied
+   };
+
+   /**
+    *  Collects the time spent in the stages of block application and in the
+    *  evaluation of each operation type. It is disabled by default, then the
+    *  timers do not read the clock at all. Operations are only timed while a
+    *  block is applied, not when pending transactions are pushed.
+    *
+    *  Not synchronized, it must only be used from the thread applying blocks.
+    */
+   class block_profiler
+   {
+      public:
+         enum stage
+         {
+            validate_block,
+            apply_transactions,
+            update_global_dynamic_data,
+            update_signing_witness,
+            update_last_irreversible_block,
+            create_block_summary,
+            clear_expired_objects,
+            update_witness_schedule,
+            update_median_feed,
+            update_virtual_supply,
+            process_funds,
+            process_conversions,
+            process_content_cashout,
+            adjust_funds,
+            process_vesting_withdrawals,
+            account_recovery_processing,
+            process_hardforks,
+            applied_block_observers,
+            notify_changed_objects,
+            stage_count
+         };
+
+         /**
+          *  Times consecutive stages, each lap records the time since the previous lap.
+          *  The profiler counts as applying a block while the timer exists.
+          */
+         class lap_timer
+         {
+            public:
+               explicit lap_timer( block_profiler& profiler )
+                  : _profiler( profiler ), _enabled( profiler.enabled() )
+               {
+                  _profiler._in_block = true;
+                  if( _enabled )
+                     _last = fc::time_point::now();
+               }
+               ~lap_timer() { _profiler._in_block = false; }
+
+               void lap( stage s )
+               {
+                  if( !_enabled )
+                     return;
+                  const fc::time_point now = fc::time_point::now();
+                  _profiler.record( s, now - _last + _split[s] );
+                  _split[s] = fc::microseconds();
+                  _last = now;
+               }
+
+               /** Like lap, for stages run more than once per block: the time is added to the next lap of s */
+               void split( stage s )
+               {
+                  if( !_enabled )
+                     return;
+                  const fc::time_point now = fc::time_point::now();
+                  _split[s] += now - _last;
+                  _last = now;
+               }
+
+            private:
+               block_profiler&  _profiler;
+               bool             _enabled;
+               fc::time_point   _last;
+               fc::microseconds _split[stage_count];
+         };
+
+         void enable( bool enabled ) { _enabled = enabled; }
+         bool enabled()const { return _enabled; }
+
+         void record( stage s, const fc::microseconds& elapsed );
+         void record_operation( int which, const fc::microseconds& elapsed );
+         bool in_block()const { return _in_block; }
+
+         /** Counts the block that has been applied completely and calls the block callback */
+         void block_applied();
+         uint64_t blocks()const { return _blocks; }
+
+         /** Called after each profiled block, the profile may be read and reset from here */
+         void set_block_callback( std::function< void( block_profiler& ) > callback ) { _block_callback = callback; }
+
+         block_profile get_profile()const;
+         void          reset();
+
+      private:
+         bool                   _enabled = false;
+         bool                   _in_block = false;
+         uint64_t               _blocks = 0;
+         std::function< void( block_profiler& ) > _block_callback;
+         timing_stats           _stages[stage_count];
+         vector< timing_stats > _operations;
+   };
+
+} }
+
+FC_REFLECT( muse::chain::timing_stats, (name)(count)(total_us)(max_us)(histogram) )
+FC_REFLECT( muse::chain::block_profile, (blocks)(stages)(operations) )
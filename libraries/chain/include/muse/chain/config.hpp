@@ -217,7 +217,7 @@
 #define MUSE_MAX_ASSET_WHITELIST_AUTHORITIES 10
 #define MUSE_MAX_URL_LENGTH                  127
 
-#define GRAPHENE_CURRENT_DB_VERSION          "MUSE_0_6_1"
+#define GRAPHENE_CURRENT_DB_VERSION          "MUSE_0_6_2"
 
 #define MUSE_IRREVERSIBLE_THRESHOLD          (51 * MUSE_1_PERCENT)
 
@@ -10,6 +10,7 @@
 #include <graphene/db/generic_index.hpp>
 
 #include <boost/multi_index/composite_key.hpp>
+#include <boost/multi_index/hashed_index.hpp>
 
 namespace muse { namespace chain {
 
@@ -20,6 +21,8 @@ namespace muse { namespace chain {
       public:
          static const uint8_t space_id = implementation_ids;
          static const uint8_t type_id  = impl_content_object_type;
+         /// streaming reports only bump counters, the distributions and metadata need not be copied for undo
+         static const bool serialized_undo = true;
 
          string uploader;
          
@@ -143,6 +146,7 @@ namespace muse { namespace chain {
    > content_vote_multi_index_type;
 
    struct by_url; 
+   struct by_url_hash;
    struct by_title;
    struct by_uploader;
    struct by_popularity;
@@ -154,6 +158,7 @@ namespace muse { namespace chain {
       indexed_by<
          ordered_unique< tag< by_id >, member< object, object_id_type, &object::id > >,
          ordered_unique< tag< by_url >, member< content_object, string, &content_object::url> >,
+         hashed_unique< tag< by_url_hash >, member< content_object, string, &content_object::url>, std::hash< string > >,
          ordered_non_unique< tag< by_title >, member< content_object, string, &content_object::track_title > >,
          ordered_unique< tag< by_uploader >,
             composite_key< content_object, 
@@ -228,3 +233,7 @@ FC_REFLECT_DERIVED( muse::chain::content_approve_object, (graphene::db::object),
 
 FC_REFLECT_DERIVED( muse::chain::content_vote_object, (graphene::db::object),
                     (voter)(content)(marked_for_curation_reward)(weight)(num_changes)(last_update) )
+
+GRAPHENE_DB_INDEX_KEYS( muse::chain::content_object,
+                        (url)(track_title)(uploader)(times_played_24)
+                        (album_meta)(track_meta) ) // content_by_genre_index, content_by_category_index
@@ -7,6 +7,8 @@
 #include <muse/chain/node_property_object.hpp>
 #include <muse/chain/fork_database.hpp>
 #include <muse/chain/block_database.hpp>
+#include <muse/chain/signature_cache.hpp>
+#include <muse/chain/block_profiler.hpp>
 #include <muse/chain/asset_object.hpp>
 #include <muse/chain/balance_object.hpp>
 
@@ -18,16 +20,42 @@
 #include <graphene/db/object.hpp>
 #include <graphene/db/simple_index.hpp>
 #include <fc/signals.hpp>
+#include <fc/thread/future.hpp>
 
 #include <fc/log/logger.hpp>
 
 #include <map>
+#include <unordered_map>
+
+namespace fc { class thread; }
 
 namespace muse { namespace chain {
    using graphene::db::abstract_object;
    using graphene::db::object;
 
    namespace detail{ uint32_t isqrt(uint64_t a); }
+   struct state_checkpoint;
+   struct state_snapshot;
+   struct content_payout_batch;
+   class voted_streaming_platform_index;
+   class account_score_index;
+
+   /**
+    *  The newest state snapshot written by database::update_state_snapshots(), block_num is 0 if there
+    *  is none. The hashes are computed when the snapshot is written, chunk_hashes holds the hash of
+    *  every chunk_size bytes of the file, the last chunk may be shorter.
+    */
+   struct state_snapshot_info
+   {
+      uint32_t           block_num = 0;
+      block_id_type      block_id;
+      fc::path           file;
+      uint64_t           size = 0;
+      fc::sha256         hash;
+      uint32_t           chunk_size = 0;
+      vector<fc::sha256> chunk_hashes;
+   };
+
    /**
     *   @class database
     *   @brief tracks the blockchain state in an extensible manner
@@ -59,6 +87,11 @@ namespace muse { namespace chain {
             skip_validate_invariants    = 1 << 11  ///< used to skip database invariant check on block application
          };
 
+         /** the skip flags that change how a single transaction is applied */
+         static const uint32_t transaction_skip_flags = skip_validate | skip_transaction_dupe_check
+                                                        | skip_transaction_signatures | skip_authority_check
+                                                        | skip_tapos_check;
+
          /**
           * @brief Open a database, creating a new one if necessary
           *
@@ -81,6 +114,30 @@ namespace muse { namespace chain {
           */
          void reindex( fc::path data_dir );
 
+         /**
+          * @brief Number of threads that read and decode blocks ahead of the chain thread during
+          * reindex(), 0 selects one less than the number of cores
+          */
+         void set_replay_threads( uint32_t n ) { _replay_threads = n; }
+
+         /**
+          * @brief Number of threads recovering the signing keys of a block's transactions before
+          * the block is applied, 0 selects one less than the number of cores, 1 disables
+          */
+         void set_signature_threads( uint32_t n ) { _signature_threads = n; }
+
+         /**
+          * @brief Number of transactions whose recovered signing keys are remembered, 0 disables the cache
+          */
+         void set_signature_cache_size( uint32_t n ) { _signature_cache.set_capacity( n ); }
+         signature_cache_stats get_signature_cache_stats()const { return _signature_cache.get_stats(); }
+
+         /**
+          * @brief Timings of the stages of block application and of operation evaluation, disabled by default
+          */
+         block_profiler&       get_profiler() { return _profiler; }
+         const block_profiler& get_profiler()const { return _profiler; }
+
          /**
           * @brief wipe Delete database from disk, and potentially the raw chain as well.
           * @param include_blocks If true, delete the raw chain as well as the database.
@@ -90,6 +147,67 @@ namespace muse { namespace chain {
          void wipe(const fc::path& data_dir, bool include_blocks);
          void close(bool rewind = true);
 
+         /**
+          * @brief Serve block log reads from read-only memory mappings, must be set before open()
+          */
+         void set_block_log_mmap( bool enable ) { _block_log_mmap = enable; }
+
+         /**
+          * @brief Store newly appended blocks compressed, must be set before open(). Blocks
+          * already in the log are left as they are, see programs/util/convert_block_log
+          */
+         void set_block_log_compression( bool enable ) { _block_log_compression = enable; }
+
+         /**
+          * The block log only contains blocks that have been applied; it may be read
+          * from any thread, also while the chain thread appends new blocks.
+          */
+         const block_database& get_block_log()const { return _block_id_to_block; }
+
+         /**
+          * @brief Persist the objects changed since the last flush or checkpoint every n blocks, 0 disables
+          *
+          * Checkpoints are written once their block has become irreversible and are applied on
+          * top of the last full flush when the database is opened after an unclean shutdown, so
+          * that only the blocks following the newest checkpoint have to be replayed. Checkpoints
+          * are folded into one when 16 have accumulated since the last flush. Must be set before
+          * open().
+          */
+         void set_state_checkpoint_interval( uint32_t n ) { _state_checkpoint_interval = n; }
+
+         /**
+          * @brief Write the complete state to a snapshot file every n blocks, 0 disables
+          *
+          * The state is captured at blocks whose number is a multiple of n, so that nodes using the
+          * same interval offer the same snapshots, and written by a worker thread once that block
+          * has become irreversible. Only the newest snapshot is kept. Must be set before open().
+          *
+          * Capturing packs every object on the chain thread while the block is pushed, so every
+          * n-th block takes about as long to push as packing the complete state does.
+          *
+          * @param chunk_size the snapshot is hashed in chunks of this size, see state_snapshot_info
+          */
+         void set_state_snapshot_interval( uint32_t n, uint32_t chunk_size )
+         {
+            _state_snapshot_interval = n;
+            _state_snapshot_chunk_size = chunk_size;
+         }
+         const state_snapshot_info& get_state_snapshot_info()const { return _state_snapshot_info; }
+
+         /**
+          * @brief Replace the state of a database that has not applied any block by a state snapshot
+          *
+          * Afterwards the database is at the block of the snapshot, which is the only block in its
+          * block log, and continues with the blocks following it. Blocks before the snapshot are
+          * not available, such a database cannot be replayed. The file is read one index at a time.
+          *
+          * The object version, chain and block of the snapshot are checked before any state is
+          * changed. If it fails after that, the state is unusable and the database has to be wiped.
+          *
+          * @param expected_block_id the block the snapshot must have been taken at
+          */
+         void load_state_snapshot( const fc::path& file, const block_id_type& expected_block_id );
+
          //////////////////// db_block.cpp ////////////////////
 
          /**
@@ -102,7 +220,9 @@ namespace muse { namespace chain {
          block_id_type              get_block_id_for_num( uint32_t block_num )const;
          optional<signed_block>     fetch_block_by_id( const block_id_type& id )const;
          optional<signed_block>     fetch_block_by_number( uint32_t num )const;
-         const signed_transaction&  get_recent_transaction( const transaction_id_type& trx_id )const;
+         signed_transaction         get_recent_transaction( const transaction_id_type& trx_id )const;
+         /** Like get_recent_transaction(), returns nothing for unknown transactions instead of throwing */
+         optional<signed_transaction> find_recent_transaction( const transaction_id_type& trx_id )const;
          std::vector<block_id_type> get_block_ids_on_fork(block_id_type head_of_fork) const;
 
          chain_id_type              get_chain_id()const;
@@ -141,9 +261,11 @@ namespace muse { namespace chain {
          bool                                   before_last_checkpoint()const;
 
          bool push_block( const signed_block& b, uint32_t skip = skip_nothing );
+         bool push_block( const precomputed_block& b, uint32_t skip = skip_nothing );
          void push_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing );
-         bool _push_block( const signed_block& b );
-         void _push_transaction( const signed_transaction& trx );
+         void push_transaction( const precomputed_transaction& trx, uint32_t skip = skip_nothing );
+         bool _push_block( const precomputed_block& b );
+         void _push_transaction( const precomputed_transaction& trx );
          void push_proposal( const proposal_object& proposal );
          signed_block generate_block(
             const fc::time_point_sec when,
@@ -240,6 +362,7 @@ namespace muse { namespace chain {
           *
           */
          bool is_voted_streaming_platform(string streaming_platform) const;
+         bool is_voted_streaming_platform( streaming_platform_id_type streaming_platform )const;
          
          /**
           * Get the time at which the given slot occurs.
@@ -278,7 +401,9 @@ namespace muse { namespace chain {
          uint64_t    get_scoring(const account_object& ao ) const;
          uint64_t    get_scoring(const content_object& co ) const;
          void recalculate_score(const account_object& ao );
-         void recursive_recalculate_score(const account_object& ao, share_type delta );
+         void recursive_recalculate_score(const account_object& ao );
+         /** Like modify(), for modifiers that change the friends or second_level sets of the account */
+         void modify_social_graph( const account_object& a, const std::function<void(account_object&)>& m );
 
          const asset_object& get_asset( const string& symbol )const;
          /** this updates the votes for witnesses and streaming_platforms as a result of account voting proxy changing */
@@ -311,9 +436,12 @@ namespace muse { namespace chain {
          vector<string> get_voted_streaming_platforms();
          void process_vesting_withdrawals();
 
-         asset pay_to_content(const content_object & content, asset payout, streaming_platform_id_type platform);
+         asset pay_to_content(const content_object & content, asset payout, streaming_platform_id_type platform,
+                              content_payout_batch& batch);
          void pay_to_content_master(const content_object &content, const asset& payout);
          void pay_to_content_comp(const content_object &content, const asset& payout);
+         /** applies the content, balance and supply changes collected in batch */
+         void flush_content_payouts( content_payout_batch& batch );
 
          asset process_content_cashout(const asset& content_reward);
          void process_funds(const asset& content_reward, const asset& witness_pay, const asset& vesting_reward);
@@ -401,26 +529,43 @@ namespace muse { namespace chain {
 
       private:
          optional<undo_database::session>       _pending_tx_session;
+         /** the transaction_skip_flags all of _pending_tx were applied with, unset when they differ */
+         optional<uint32_t>                     _pending_tx_skip_flags;
          vector< unique_ptr<op_evaluator> >     _operation_evaluators;
 
 
-         void apply_block( const signed_block& next_block, uint32_t skip = skip_nothing );
-         void apply_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing );
-         void _apply_block( const signed_block& next_block );
-         void _apply_transaction( const signed_transaction& trx );
+         void apply_block( const precomputed_block& next_block, uint32_t skip = skip_nothing );
+         /** applies a transaction of the block that is being applied */
+         void apply_transaction( const precomputed_transaction& trx, uint32_t skip = skip_nothing,
+                                 const flat_set<public_key_type>* signature_keys = nullptr );
+         void _apply_block( const precomputed_block& next_block );
+         void _apply_transaction( const precomputed_transaction& trx,
+                                  const flat_set<public_key_type>* signature_keys = nullptr,
+                                  bool in_block = false );
+
+         /**
+          *  Recovers the signing keys of all transactions in b on the signature workers.
+          *  An entry is left empty if recovery failed, applying that transaction recovers
+          *  the keys again and reports the error.
+          *
+          *  Waiting for the workers lets other tasks of the calling fc thread run, so this
+          *  must not be called while a block is partially applied. push_block() calls it
+          *  before it changes any state and hands the keys to _apply_block().
+          */
+         vector< optional< flat_set<public_key_type> > > recover_signature_keys( const signed_block& b );
          void apply_operation( transaction_evaluation_state& eval_state, const operation& op );
 
 
          ///Steps involved in applying a new block
          ///@{
 
-         const witness_object& validate_block_header( uint32_t skip, const signed_block& next_block )const;
-         void create_block_summary(const signed_block& next_block);
+         const witness_object& validate_block_header( uint32_t skip, const precomputed_block& next_block )const;
+         void create_block_summary(const precomputed_block& next_block);
 
          void update_witness_schedule4();
          void update_median_witness_props();
 
-         void update_global_dynamic_data( const signed_block& b );
+         void update_global_dynamic_data( const precomputed_block& b );
          void update_virtual_supply();
          void update_signing_witness(const witness_object& signing_witness, const signed_block& new_block);
          void update_last_irreversible_block();
@@ -434,6 +579,14 @@ namespace muse { namespace chain {
 
          void init_hardforks();
          void process_hardforks();
+
+         bool load_state_checkpoints();
+         void update_state_checkpoints();
+         void fold_state_checkpoints();
+         void reset_state_checkpoints();
+         void load_state_snapshot_info();
+         void update_state_snapshots();
+         void finish_state_snapshot_write( bool wait );
          void apply_hardfork( uint32_t hardfork );
 
          asset get_producer_reward();
@@ -442,7 +595,11 @@ namespace muse { namespace chain {
          void pay_to_platform( streaming_platform_id_type platform, const asset& payout, const string& url );
          ///@}
 
-         vector< signed_transaction >  _pending_tx;
+         vector< precomputed_transaction > _pending_tx;
+         /** positions in _pending_tx by transaction id */
+         std::unordered_map< transaction_id_type, size_t > _pending_tx_index;
+         const voted_streaming_platform_index* _voted_streaming_platforms = nullptr;
+         account_score_index*          _account_scores = nullptr;
          fork_database                 _fork_db;
          fc::time_point_sec            _hardfork_times[ MUSE_NUM_HARDFORKS + 1 ];
          hardfork_version              _hardfork_versions[ MUSE_NUM_HARDFORKS + 1 ];
@@ -457,6 +614,27 @@ namespace muse { namespace chain {
           *  the fork tree relatively simple.
           */
          block_database   _block_id_to_block;
+         bool             _block_log_mmap = false;
+         bool             _block_log_compression = false;
+         uint32_t         _replay_threads = 0;
+
+         uint32_t                          _signature_threads = 0;
+         vector< unique_ptr<fc::thread> >  _signature_workers;
+         signature_cache                   _signature_cache;
+         block_id_type                     _recovered_keys_block_id; ///< block the keys below were recovered for
+         vector< optional< flat_set<public_key_type> > > _recovered_keys;
+         block_profiler                    _profiler;
+
+         uint32_t                          _state_checkpoint_interval = 0;
+         uint32_t                          _state_checkpoint_base = 0; ///< block the next checkpoint builds on
+         unique_ptr<state_checkpoint>      _pending_state_checkpoint;  ///< captured, waiting for irreversibility
+
+         uint32_t                          _state_snapshot_interval = 0;
+         uint32_t                          _state_snapshot_chunk_size = 0;
+         unique_ptr<state_snapshot>        _pending_state_snapshot;    ///< captured, waiting for irreversibility
+         unique_ptr<fc::thread>            _state_snapshot_writer;
+         fc::future<state_snapshot_info>   _state_snapshot_written;    ///< valid while the writer is busy
+         state_snapshot_info               _state_snapshot_info;
 
          transaction_id_type               _current_trx_id;
          uint32_t                          _current_block_num    = 0;
@@ -469,6 +647,7 @@ namespace muse { namespace chain {
          node_property_object              _node_property_object;
 
          fc::sha256                        genesis_json_hash;
+         std::string                       _db_version; ///< as passed to open(), names the object layouts
 
          /**
           * Whether database is successfully opened or not.
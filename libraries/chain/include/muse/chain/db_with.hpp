@@ -40,12 +40,16 @@ struct skip_flags_restorer
  * Class used to help the without_pending_transactions
  * implementation.
  *
+ * Every surviving transaction is applied again on top of the new head
+ * block, whether or not the block touched the objects it uses; only
+ * transactions that have expired are dropped without applying them.
+ *
  * TODO:  Change the name of this class to better reflect the fact
  * that it restores popped transactions as well as pending transactions.
  */
 struct pending_transactions_restorer
 {
-   pending_transactions_restorer( database& db, std::vector<signed_transaction>&& pending_transactions )
+   pending_transactions_restorer( database& db, std::vector<precomputed_transaction>&& pending_transactions )
       : _db(db), _pending_transactions( std::move(pending_transactions) )
    {
       _db.clear_pending();
@@ -53,20 +57,30 @@ struct pending_transactions_restorer
 
    ~pending_transactions_restorer()
    {
+      // expired transactions would be rejected by _apply_transaction, drop them without applying,
+      // unless the node skips TaPoS and expiration checks
+      const bool check_expiration = _db.head_block_num() > 0
+                                    && !( _db.get_node_properties().skip_flags & database::skip_tapos_check );
+      const fc::time_point_sec now = _db.head_block_time();
       for( const auto& tx : _db._popped_tx )
       {
+         if( check_expiration && tx.expiration <= now )
+            continue;
          try {
-            if( !_db.is_known_transaction( tx.id() ) ) {
+            precomputed_transaction ptx( tx );
+            if( !_db.is_known_transaction( ptx.id() ) ) {
                // since push_transaction() takes a signed_transaction,
                // the operation_results field will be ignored.
-               _db._push_transaction( tx );
+               _db._push_transaction( ptx );
             }
          } catch ( const fc::exception&  ) {
          }
       }
       _db._popped_tx.clear();
-      for( const signed_transaction& tx : _pending_transactions )
+      for( const precomputed_transaction& tx : _pending_transactions )
       {
+         if( check_expiration && tx->expiration <= now )
+            continue;
          try
          {
             if( !_db.is_known_transaction( tx.id() ) ) {
@@ -86,7 +100,7 @@ struct pending_transactions_restorer
    }
 
    database& _db;
-   std::vector< signed_transaction > _pending_transactions;
+   std::vector< precomputed_transaction > _pending_transactions;
 };
 
 /**
@@ -116,7 +130,7 @@ void with_skip_flags(
 template< typename Lambda >
 void without_pending_transactions(
    database& db,
-   std::vector<signed_transaction>&& pending_transactions,
+   std::vector<precomputed_transaction>&& pending_transactions,
    Lambda callback )
 {
     pending_transactions_restorer restorer( db, std::move(pending_transactions) );
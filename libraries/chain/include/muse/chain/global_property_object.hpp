@@ -5,6 +5,7 @@
 #include <muse/chain/database.hpp>
 #include <muse/chain/config.hpp>
 #include <graphene/db/object.hpp>
+#include <graphene/db/index.hpp>
 
 namespace muse { namespace chain {
 
@@ -170,3 +171,4 @@ FC_REFLECT_DERIVED( muse::chain::dynamic_global_property_object, (graphene::db::
                     (total_vested_by_platforms)
                   )
 
+GRAPHENE_DB_NO_INDEX_KEYS( muse::chain::dynamic_global_property_object )
@@ -7,6 +7,8 @@ namespace muse { namespace chain {
    struct signed_block : public signed_block_header
    {
       checksum_type calculate_merkle_root()const;
+      /// the merkle root over the given transaction merkle digests
+      static checksum_type merkle_root_of( vector<digest_type> ids );
       vector<signed_transaction> transactions;
    };
 
@@ -0,0 +1,87 @@
+#pragma once
+#include <muse/chain/protocol/block.hpp>
+
+#include <memory>
+
+namespace muse { namespace chain {
+
+   /**
+    *  A signed_transaction together with values derived from it that are needed
+    *  several times while it is pushed, applied and included in a block. The
+    *  packed form is computed once on first use, id and merkle digest are
+    *  hashed from it rather than by serializing the transaction again. The
+    *  stateless validation is remembered as well, so a pending transaction
+    *  that is applied again after a block is not validated twice.
+    *
+    *  The wrapped transaction is immutable. Memoization is not synchronized, a
+    *  precomputed_transaction must not be used from several threads at once.
+    */
+   class precomputed_transaction
+   {
+      public:
+         /** Keeps a copy of trx */
+         explicit precomputed_transaction( signed_transaction trx );
+
+         /** Refers to trx without copying it, trx must outlive this object and all copies of it */
+         static precomputed_transaction view( const signed_transaction& trx );
+
+         const signed_transaction&  get()const { return *_trx; }
+         const signed_transaction*  operator->()const { return _trx.get(); }
+
+         const transaction_id_type& id()const;
+         const digest_type&         merkle_digest()const;
+         const vector<char>&        packed()const;
+         size_t                     packed_size()const { return packed().size(); }
+
+         /** Validates the transaction, once it passed later calls return immediately */
+         void                       validate()const;
+
+      private:
+         precomputed_transaction() {}
+
+         std::shared_ptr<const signed_transaction> _trx;
+         mutable optional< vector<char> >          _packed;
+         mutable optional< transaction_id_type >   _id;
+         mutable optional< digest_type >           _merkle_digest;
+         mutable bool                              _validated = false;
+   };
+
+   /**
+    *  Refers to a signed_block and memoizes its id, packed size, merkle root,
+    *  signee and the precomputed form of its transactions. The block must
+    *  outlive this object.
+    */
+   class precomputed_block
+   {
+      public:
+         explicit precomputed_block( const signed_block& b );
+
+         /** Reuses already precomputed transactions, they must be the transactions of b in order */
+         precomputed_block( const signed_block& b, vector<precomputed_transaction> transactions );
+
+         const signed_block&  get()const { return *_block; }
+         const signed_block*  operator->()const { return _block; }
+
+         const block_id_type&                    id()const;
+         const vector<precomputed_transaction>&  transactions()const;
+         size_t                                  packed_size()const;
+         const checksum_type&                    calculate_merkle_root()const;
+         const public_key_type&                  signee()const;
+
+         /**
+          *  Computes all memoized values and validates the transactions, so that
+          *  this can be done on another thread before the block is applied.
+          *  Transactions that fail validation are left unvalidated.
+          */
+         void                                    precompute()const;
+
+      private:
+         const signed_block*                                 _block;
+         mutable optional< block_id_type >                   _id;
+         mutable optional< vector<precomputed_transaction> > _transactions;
+         mutable optional< size_t >                          _packed_size;
+         mutable optional< checksum_type >                   _merkle_root;
+         mutable optional< public_key_type >                 _signee;
+   };
+
+} } // muse::chain
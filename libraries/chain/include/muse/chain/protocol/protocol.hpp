@@ -1,2 +1,3 @@
 #pragma once
 #include <muse/chain/protocol/block.hpp>
+#include <muse/chain/protocol/precomputed.hpp>
@@ -0,0 +1,58 @@
+#pragma once
+#include <muse/chain/protocol/transaction.hpp>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace muse { namespace chain {
+
+   struct signature_cache_stats
+   {
+      uint64_t size = 0;
+      uint64_t capacity = 0;
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+   };
+
+   /**
+    *  Remembers the public keys recovered from the signatures of recently seen
+    *  transactions, so that a transaction that is pushed, re-applied as pending
+    *  and finally applied as part of a block only pays for ECDSA recovery once.
+    *
+    *  Entries are keyed by a digest over the chain id and the complete signed
+    *  transaction, so they can never become stale. The oldest entries are
+    *  evicted once capacity is reached. All methods may be called concurrently.
+    */
+   class signature_cache
+   {
+      public:
+         explicit signature_cache( size_t capacity = 100000 ) : _capacity( capacity ) {}
+
+         /** Returns the keys recovered from trx's signatures, recovering them only on a miss */
+         flat_set<public_key_type> get_signature_keys( const signed_transaction& trx, const chain_id_type& chain_id );
+
+         void set_capacity( size_t capacity );
+         void clear();
+
+         signature_cache_stats get_stats()const;
+
+      private:
+         struct digest_hash
+         {
+            size_t operator()( const digest_type& d )const { return d._hash[0]; }
+         };
+
+         size_t                                                                _capacity;
+         std::unordered_map< digest_type, flat_set<public_key_type>, digest_hash > _keys;
+         std::deque< digest_type >                                             _insertion_order;
+         mutable std::mutex                                                    _mutex;
+
+         std::atomic<uint64_t> _hits{0};
+         std::atomic<uint64_t> _misses{0};
+   };
+
+} }
+
+FC_REFLECT( muse::chain::signature_cache_stats, (size)(capacity)(hits)(misses) )
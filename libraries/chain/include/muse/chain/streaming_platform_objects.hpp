@@ -7,6 +7,7 @@
 #include <graphene/db/generic_index.hpp>
 
 #include <boost/multi_index/composite_key.hpp>
+#include <boost/multi_index/hashed_index.hpp>
 
 namespace muse { namespace chain {
 
@@ -108,12 +109,14 @@ namespace muse { namespace chain {
     * @ingroup object_index
     */
    struct by_name;
+   struct by_name_hash;
    struct by_vote_name;
    typedef multi_index_container<
       streaming_platform_object,
       indexed_by<
          ordered_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
          ordered_unique< tag<by_name>, member<streaming_platform_object, string, &streaming_platform_object::owner> >,
+         hashed_unique< tag<by_name_hash>, member<streaming_platform_object, string, &streaming_platform_object::owner>, std::hash<string> >,
          ordered_unique< tag<by_vote_name>,
             composite_key< streaming_platform_object,
                member<streaming_platform_object, share_type, &streaming_platform_object::votes >,
@@ -165,6 +168,36 @@ namespace muse { namespace chain {
    typedef generic_index< streaming_platform_object,         streaming_platform_multi_index_type>             streaming_platform_index;
    typedef generic_index< streaming_platform_vote_object,    streaming_platform_vote_multi_index_type >       streaming_platform_vote_index;
    typedef generic_index< stream_report_request_object,      stream_report_request_multi_index_type>          stream_report_request_index;
+
+   /**
+    *  @brief This secondary index caches the streaming platforms that are voted in, i.e. the
+    *  first MUSE_MAX_VOTED_STREAMING_PLATFORMS by votes.
+    *
+    *  The cache is invalidated by any change that can affect the voted set, including changes
+    *  rolled back by the undo database, and rebuilt from the primary index on the next lookup.
+    */
+   class voted_streaming_platform_index : public secondary_index
+   {
+      public:
+         virtual void object_inserted( const object& obj ) override { _valid = false; }
+         virtual void object_removed( const object& obj ) override { _valid = false; }
+         virtual void about_to_modify( const object& before ) override;
+         virtual void object_modified( const object& after  ) override;
+
+         bool is_voted( const streaming_platform_index& idx, streaming_platform_id_type id )const;
+         /** owners of the voted platforms, by rank */
+         const vector< string >& get_voted( const streaming_platform_index& idx )const;
+
+      private:
+         void rebuild( const streaming_platform_index& idx )const;
+
+         share_type                                     _votes_before;
+         mutable bool                                   _valid = false;
+         mutable flat_set< streaming_platform_id_type > _voted;
+         mutable vector< string >                       _voted_owners;
+         mutable share_type                             _cutoff_votes;
+         mutable string                                 _cutoff_owner;
+   };
    
    struct by_consumer;
    struct by_content;
@@ -236,3 +269,6 @@ FC_REFLECT_DERIVED( muse::chain::report_object, (graphene::db::object),
 
 FC_REFLECT_DERIVED( muse::chain::streaming_platform_user_object, (graphene::db::object),
                     (streaming_platform)(sp_user_id)(total_listening_time) )
+
+GRAPHENE_DB_INDEX_KEYS( muse::chain::streaming_platform_object, (owner)(votes) )
+GRAPHENE_DB_INDEX_KEYS( muse::chain::streaming_platform_user_object, (streaming_platform)(sp_user_id) )
@@ -20,6 +20,9 @@ namespace muse { namespace chain {
     * The purpose of this object is to enable the detection of duplicate transactions. When a transaction is included
     * in a block a transaction_object is added. At the end of block processing all transaction_objects that have
     * expired can be removed from the index.
+    *
+    * Only the id and expiration are kept together with the position of the transaction in its block, the
+    * transaction itself can be read from the block database.
     */
    class transaction_object : public abstract_object<transaction_object>
    {
@@ -27,10 +30,12 @@ namespace muse { namespace chain {
          static const uint8_t space_id = implementation_ids;
          static const uint8_t type_id  = impl_transaction_object_type;
 
-         signed_transaction  trx;
          transaction_id_type trx_id;
+         time_point_sec      expiration;
+         uint32_t            block_num = 0; ///< 0 while the transaction is pending
+         uint16_t            trx_in_block = 0;
 
-         time_point_sec get_expiration()const { return trx.expiration; }
+         time_point_sec get_expiration()const { return expiration; }
    };
 
    struct by_expiration;
@@ -48,4 +53,4 @@ namespace muse { namespace chain {
    typedef generic_index<transaction_object, transaction_multi_index_type> transaction_index;
 } }
 
-FC_REFLECT_DERIVED( muse::chain::transaction_object, (graphene::db::object), (trx)(trx_id) )
+FC_REFLECT_DERIVED( muse::chain::transaction_object, (graphene::db::object), (trx_id)(expiration)(block_num)(trx_in_block) )
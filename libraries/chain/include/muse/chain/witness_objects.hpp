@@ -7,6 +7,7 @@
 #include <graphene/db/generic_index.hpp>
 
 #include <boost/multi_index/composite_key.hpp>
+#include <boost/multi_index/hashed_index.hpp>
 
 namespace muse { namespace chain {
 
@@ -117,6 +118,7 @@ namespace muse { namespace chain {
 
    struct by_vote_name;
    struct by_name;
+   struct by_name_hash;
    struct by_work;
    struct by_schedule_time;
    /**
@@ -128,6 +130,7 @@ namespace muse { namespace chain {
          ordered_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
          ordered_non_unique< tag<by_work>, member<witness_object, digest_type, &witness_object::last_work> >,
          ordered_unique< tag<by_name>, member<witness_object, string, &witness_object::owner> >,
+         hashed_unique< tag<by_name_hash>, member<witness_object, string, &witness_object::owner>, std::hash<string> >,
          ordered_unique< tag<by_vote_name>,
             composite_key< witness_object,
                member<witness_object, share_type, &witness_object::votes >,
@@ -188,7 +188,7 @@ void streaming_platform_report_evaluator::do_apply ( const streaming_platform_re
       }
    }
 
-   FC_ASSERT ( db().is_voted_streaming_platform( o.streaming_platform ));
+   FC_ASSERT ( db().is_voted_streaming_platform( streaming_platform_id_type( stp.id ) ));
    const auto& content = db().get_content( o.content );
    FC_ASSERT( !content.disabled );
 
@@ -216,7 +216,9 @@ void streaming_platform_report_evaluator::do_apply ( const streaming_platform_re
    if( consumer_account != nullptr )
    { // normal user
       prev_listening_time = consumer_account->total_listening_time;
-      db().modify< account_object >(*consumer_account, [&o,&stp,spp,&prev_platform_listening_time]( account_object &a ) {
+      db().modify_fields< GRAPHENE_DB_FIELD( account_object, total_listening_time ),
+                          GRAPHENE_DB_FIELD( account_object, total_time_by_platform ) >( *consumer_account,
+                                    [&o,&stp,spp,&prev_platform_listening_time]( account_object &a ) {
          a.total_listening_time += o.play_time;
          auto sp_id = spp ? spp->id : stp.id;
          auto entry = a.total_time_by_platform.find( sp_id );
@@ -234,7 +236,8 @@ void streaming_platform_report_evaluator::do_apply ( const streaming_platform_re
       if( consumer_sp_user != nullptr )
       {
          prev_listening_time = prev_platform_listening_time = consumer_sp_user->total_listening_time;
-         db().modify( *consumer_sp_user, [&o]( streaming_platform_user_object &sp ) {
+         db().modify_fields< GRAPHENE_DB_FIELD( streaming_platform_user_object, total_listening_time ) >(
+                                    *consumer_sp_user, [&o]( streaming_platform_user_object &sp ) {
             sp.total_listening_time += o.play_time;
          });
       }
@@ -249,12 +252,17 @@ void streaming_platform_report_evaluator::do_apply ( const streaming_platform_re
    { // anonymous user
       const auto& spinning_platform = spp == nullptr ? stp : *spp;
       prev_listening_time = prev_platform_listening_time = spinning_platform.total_anon_listening_time;
-      db().modify( spinning_platform, [&o]( streaming_platform_object &sp ) {
+      db().modify_fields< GRAPHENE_DB_FIELD( streaming_platform_object, total_anon_listening_time ) >(
+                                    spinning_platform, [&o]( streaming_platform_object &sp ) {
          sp.total_anon_listening_time += o.play_time;
       });
    }
 
-   db().modify( db().get_dynamic_global_properties(), [prev_listening_time, &o] ( dynamic_global_property_object &dgpo ){
+   db().modify_fields< GRAPHENE_DB_FIELD( dynamic_global_property_object, active_users ),
+                       GRAPHENE_DB_FIELD( dynamic_global_property_object, full_users_time ),
+                       GRAPHENE_DB_FIELD( dynamic_global_property_object, full_time_users ),
+                       GRAPHENE_DB_FIELD( dynamic_global_property_object, total_listening_time ) >(
+                                 db().get_dynamic_global_properties(), [prev_listening_time, &o] ( dynamic_global_property_object &dgpo ){
       if( prev_listening_time < 3600 )
       {
          if( prev_listening_time == 0 )
@@ -270,7 +278,11 @@ void streaming_platform_report_evaluator::do_apply ( const streaming_platform_re
       dgpo.total_listening_time += o.play_time;
    });
 
-   db().modify( spp == nullptr ? stp : *spp, [prev_platform_listening_time, &o] ( streaming_platform_object &sp ){
+   db().modify_fields< GRAPHENE_DB_FIELD( streaming_platform_object, active_users ),
+                       GRAPHENE_DB_FIELD( streaming_platform_object, full_users_time ),
+                       GRAPHENE_DB_FIELD( streaming_platform_object, full_time_users ),
+                       GRAPHENE_DB_FIELD( streaming_platform_object, total_listening_time ) >(
+                                 spp == nullptr ? stp : *spp, [prev_platform_listening_time, &o] ( streaming_platform_object &sp ){
       if( prev_platform_listening_time < 3600 )
       {
          if( prev_platform_listening_time == 0 )
@@ -286,7 +298,9 @@ void streaming_platform_report_evaluator::do_apply ( const streaming_platform_re
       sp.total_listening_time += o.play_time;
    });
 
-   db().modify< content_object >(content, [] (content_object &c){
+   // times_played_24 is the popularity key, so this one still goes through the index
+   db().modify_fields< GRAPHENE_DB_FIELD( content_object, times_played ),
+                       GRAPHENE_DB_FIELD( content_object, times_played_24 ) >( content, [] (content_object &c){
         ++c.times_played;
         ++c.times_played_24;
    });
@@ -341,26 +355,26 @@ void friendship_evaluator::do_apply( const friendship_operation& o )
 
       for( auto a3id : a2.friends ) {
          const auto &a3 = db().get<account_object>(a3id);
-         db().modify<account_object>(a3, [&](account_object &a) {
+         db().modify_social_graph(a3, [&](account_object &a) {
               a.second_level.insert(a1.id);
          });
          db().recalculate_score(a3);
       }
       for( auto a3id : a1.friends ) {
          const auto &a3 = db().get<account_object>(a3id);
-         db().modify<account_object>(a3, [&](account_object &a) {
+         db().modify_social_graph(a3, [&](account_object &a) {
               a.second_level.insert(a2.id);
          });
          db().recalculate_score(a3);
       }
-      db().modify<account_object>( a1, [&]( account_object& a ){
+      db().modify_social_graph( a1, [&]( account_object& a ){
            a.waiting.erase( a2.id );
            a.friends.insert( a2.id );
            a.second_level.insert( a2.friends.begin(), a2.friends.end() );
            a.second_level.erase( a.id );
       });
       db().recalculate_score(a1);
-      db().modify<account_object>( a2, [&]( account_object& a ){
+      db().modify_social_graph( a2, [&]( account_object& a ){
            a.friends.insert( a1.id );
            a.second_level.insert( a1.friends.begin(), a1.friends.end() ); //TODO_MUSE: potentially replace with set_union
            a.second_level.erase( a.id );
@@ -401,23 +415,23 @@ void unfriend_evaluator::do_apply( const unfriend_operation& o )
    });*/
    if( a2.friends.find( a1.id ) != a2.friends.end() )
    {
-      db().modify<account_object>( a2, [&]( account_object& a ) {
+      db().modify_social_graph( a2, [&]( account_object& a ) {
            a.friends.erase( a1.id );
            a.second_level.clear();
       });
-      db().modify<account_object>( a1, [&]( account_object& a ) {
+      db().modify_social_graph( a1, [&]( account_object& a ) {
            a.friends.erase( a2.id );
            a.second_level.clear();
       });
       //rebuild second level lists
-      set<account_id_type> new_sl_list;
+      flat_set<account_id_type> new_sl_list;
       for( auto fid : a1.friends )
       {
          const auto& f = db().get<account_object>( fid );
          new_sl_list.insert( f.friends.begin(), f.friends.end() );
       }
       new_sl_list.erase( a1.id );
-      db().modify<account_object>( a1, [&]( account_object& a ) {
+      db().modify_social_graph( a1, [&]( account_object& a ) {
            a.second_level = new_sl_list;
       });
       new_sl_list.clear();
@@ -427,7 +441,7 @@ void unfriend_evaluator::do_apply( const unfriend_operation& o )
          new_sl_list.insert( f.friends.begin(), f.friends.end() );
       }
       new_sl_list.erase( a2.id );
-      db().modify<account_object>( a2, [&]( account_object& a ) {
+      db().modify_social_graph( a2, [&]( account_object& a ) {
            a.second_level = new_sl_list;
       });
       db().recalculate_score(a1);
@@ -437,14 +451,14 @@ void unfriend_evaluator::do_apply( const unfriend_operation& o )
       for( auto aid : a1.friends )
       {
          const auto& f = db().get<account_object>( aid );
-         set<account_id_type> new_sl_list;
+         flat_set<account_id_type> new_sl_list;
          for( auto slid : f.friends )
          {
             const auto& sl = db().get<account_object>( slid );
             new_sl_list.insert( sl.friends.begin(), sl.friends.end() );
          }
          new_sl_list.erase( aid );
-         db().modify<account_object>(f, [&](account_object& a) {
+         db().modify_social_graph(f, [&](account_object& a) {
               a.second_level.clear();
               a.second_level = new_sl_list;
          });
@@ -453,14 +467,14 @@ void unfriend_evaluator::do_apply( const unfriend_operation& o )
       for( auto aid : a2.friends )
       {
          const auto& f = db().get<account_object>( aid );
-         set<account_id_type> new_sl_list;
+         flat_set<account_id_type> new_sl_list;
          for( auto slid : f.friends )
          {
             const auto& sl = db().get<account_object>( slid );
             new_sl_list.insert( sl.friends.begin(), sl.friends.end() );
          }
          new_sl_list.erase( aid );
-         db().modify<account_object>(f, [&](account_object& a) {
+         db().modify_social_graph(f, [&](account_object& a) {
               a.second_level.clear();
               a.second_level = new_sl_list;
          });
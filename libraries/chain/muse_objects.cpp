@@ -1,4 +1,5 @@
 #include <muse/chain/content_object.hpp>
+#include <muse/chain/streaming_platform_objects.hpp>
 
 #include <algorithm>
 
@@ -161,4 +162,51 @@ const set< content_id_type >& content_by_category_index::find_by_category( const
    return by_category->second;
 }
 
+void voted_streaming_platform_index::about_to_modify( const object& before )
+{
+   _votes_before = static_cast< const streaming_platform_object& >( before ).votes;
+}
+
+void voted_streaming_platform_index::object_modified( const object& after )
+{
+   if( !_valid ) return;
+   const streaming_platform_object& sp = static_cast< const streaming_platform_object& >( after );
+   if( sp.votes == _votes_before ) return;
+   // a platform outside of a full set that is still ranked behind the last voted one changes nothing
+   if( _voted_owners.size() < MUSE_MAX_VOTED_STREAMING_PLATFORMS
+       || _voted.find( streaming_platform_id_type( sp.id ) ) != _voted.end()
+       || sp.votes > _cutoff_votes
+       || ( sp.votes == _cutoff_votes && sp.owner < _cutoff_owner ) )
+      _valid = false;
+}
+
+void voted_streaming_platform_index::rebuild( const streaming_platform_index& idx )const
+{
+   _voted.clear();
+   _voted_owners.clear();
+   const auto& by_votes = idx.indices().get< by_vote_name >();
+   for( auto itr = by_votes.begin();
+        itr != by_votes.end() && _voted_owners.size() < MUSE_MAX_VOTED_STREAMING_PLATFORMS;
+        ++itr )
+   {
+      _voted.insert( streaming_platform_id_type( itr->id ) );
+      _voted_owners.push_back( itr->owner );
+      _cutoff_votes = itr->votes;
+      _cutoff_owner = itr->owner;
+   }
+   _valid = true;
+}
+
+bool voted_streaming_platform_index::is_voted( const streaming_platform_index& idx, streaming_platform_id_type id )const
+{
+   if( !_valid ) rebuild( idx );
+   return _voted.find( id ) != _voted.end();
+}
+
+const vector< string >& voted_streaming_platform_index::get_voted( const streaming_platform_index& idx )const
+{
+   if( !_valid ) rebuild( idx );
+   return _voted_owners;
+}
+
 } } // muse::chain
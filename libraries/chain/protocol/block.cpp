@@ -49,6 +49,14 @@ namespace muse { namespace chain {
       for( uint32_t i = 0; i < transactions.size(); ++i )
          ids[i] = transactions[i].merkle_digest();
 
+      return merkle_root_of( std::move( ids ) );
+   }
+
+   checksum_type signed_block::merkle_root_of( vector<digest_type> ids )
+   {
+      if( ids.size() == 0 )
+         return checksum_type();
+
       vector<digest_type>::size_type current_number_of_hashes = ids.size();
       while( current_number_of_hashes > 1 )
       {
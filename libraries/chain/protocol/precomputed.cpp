@@ -0,0 +1,149 @@
+#include <muse/chain/protocol/precomputed.hpp>
+
+#include <fc/io/raw.hpp>
+#include <fc/smart_ref_impl.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace muse { namespace chain {
+
+precomputed_transaction::precomputed_transaction( signed_transaction trx )
+   : _trx( std::make_shared<const signed_transaction>( std::move( trx ) ) ) {}
+
+precomputed_transaction precomputed_transaction::view( const signed_transaction& trx )
+{
+   precomputed_transaction result;
+   // aliasing an empty shared_ptr gives a pointer that owns nothing
+   result._trx = std::shared_ptr<const signed_transaction>( std::shared_ptr<const signed_transaction>(), &trx );
+   return result;
+}
+
+const vector<char>& precomputed_transaction::packed()const
+{
+   if( !_packed.valid() )
+      _packed = fc::raw::pack_to_vector( *_trx );
+   return *_packed;
+}
+
+const transaction_id_type& precomputed_transaction::id()const
+{
+   if( !_id.valid() )
+   {
+      // the unsigned transaction is packed first, the signatures follow it
+      const vector<char>& data = packed();
+      const size_t unsigned_size = data.size() - fc::raw::pack_size( _trx->signatures );
+      const digest_type h = digest_type::hash( data.data(), unsigned_size );
+      transaction_id_type result;
+      memcpy( result._hash, h._hash, std::min( sizeof(result), sizeof(h) ) );
+      _id = result;
+   }
+   return *_id;
+}
+
+const digest_type& precomputed_transaction::merkle_digest()const
+{
+   if( !_merkle_digest.valid() )
+   {
+      const vector<char>& data = packed();
+      _merkle_digest = digest_type::hash( data.data(), data.size() );
+   }
+   return *_merkle_digest;
+}
+
+void precomputed_transaction::validate()const
+{
+   if( _validated )
+      return;
+   _trx->validate();
+   _validated = true;
+}
+
+precomputed_block::precomputed_block( const signed_block& b ) : _block( &b ) {}
+
+precomputed_block::precomputed_block( const signed_block& b, vector<precomputed_transaction> transactions )
+   : _block( &b ), _transactions( std::move( transactions ) )
+{
+   FC_ASSERT( _transactions->size() == b.transactions.size() );
+}
+
+const block_id_type& precomputed_block::id()const
+{
+   if( !_id.valid() )
+      _id = _block->id();
+   return *_id;
+}
+
+const vector<precomputed_transaction>& precomputed_block::transactions()const
+{
+   if( !_transactions.valid() )
+   {
+      vector<precomputed_transaction> result;
+      result.reserve( _block->transactions.size() );
+      for( const auto& trx : _block->transactions )
+         result.push_back( precomputed_transaction::view( trx ) );
+      _transactions = std::move( result );
+   }
+   return *_transactions;
+}
+
+size_t precomputed_block::packed_size()const
+{
+   if( !_packed_size.valid() )
+   {
+      size_t size = fc::raw::pack_size( static_cast<const signed_block_header&>( *_block ) )
+                  + fc::raw::pack_size( fc::unsigned_int( _block->transactions.size() ) );
+      for( const auto& trx : transactions() )
+         size += trx.packed_size();
+      _packed_size = size;
+   }
+   return *_packed_size;
+}
+
+const checksum_type& precomputed_block::calculate_merkle_root()const
+{
+   if( !_merkle_root.valid() )
+   {
+      vector<digest_type> digests;
+      digests.reserve( _block->transactions.size() );
+      for( const auto& trx : transactions() )
+         digests.push_back( trx.merkle_digest() );
+      _merkle_root = signed_block::merkle_root_of( std::move( digests ) );
+   }
+   return *_merkle_root;
+}
+
+const public_key_type& precomputed_block::signee()const
+{
+   if( !_signee.valid() )
+      _signee = public_key_type( _block->signee() );
+   return *_signee;
+}
+
+void precomputed_block::precompute()const
+{
+   id();
+   packed_size();
+   calculate_merkle_root();
+   // failures are reported again when the block is applied
+   try
+   {
+      signee();
+   }
+   catch( const fc::exception& )
+   {
+   }
+   for( const auto& trx : transactions() )
+   {
+      trx.id();
+      try
+      {
+         trx.validate();
+      }
+      catch( const fc::exception& )
+      {
+      }
+   }
+}
+
+} } // muse::chain
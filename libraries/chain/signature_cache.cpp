@@ -0,0 +1,73 @@
+#include <muse/chain/signature_cache.hpp>
+
+#include <fc/io/raw.hpp>
+#include <fc/smart_ref_impl.hpp>
+
+namespace muse { namespace chain {
+
+flat_set<public_key_type> signature_cache::get_signature_keys( const signed_transaction& trx, const chain_id_type& chain_id )
+{
+   digest_type::encoder enc;
+   fc::raw::pack( enc, chain_id );
+   fc::raw::pack( enc, trx );
+   const digest_type key = enc.result();
+
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      auto itr = _keys.find( key );
+      if( itr != _keys.end() )
+      {
+         ++_hits;
+         return itr->second;
+      }
+   }
+   ++_misses;
+
+   // recover outside of the lock, failures propagate and are not cached
+   flat_set<public_key_type> keys = trx.get_signature_keys( chain_id );
+
+   std::lock_guard<std::mutex> lock( _mutex );
+   if( _capacity > 0 && _keys.emplace( key, keys ).second )
+   {
+      _insertion_order.push_back( key );
+      while( _insertion_order.size() > _capacity )
+      {
+         _keys.erase( _insertion_order.front() );
+         _insertion_order.pop_front();
+      }
+   }
+   return keys;
+}
+
+void signature_cache::set_capacity( size_t capacity )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   _capacity = capacity;
+   while( _insertion_order.size() > _capacity )
+   {
+      _keys.erase( _insertion_order.front() );
+      _insertion_order.pop_front();
+   }
+}
+
+void signature_cache::clear()
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   _keys.clear();
+   _insertion_order.clear();
+}
+
+signature_cache_stats signature_cache::get_stats()const
+{
+   signature_cache_stats stats;
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      stats.size = _keys.size();
+      stats.capacity = _capacity;
+   }
+   stats.hits = _hits;
+   stats.misses = _misses;
+   return stats;
+}
+
+} }
@@ -28,6 +28,10 @@
 #include <fc/io/json.hpp>
 #include <fc/crypto/sha256.hpp>
 #include <fstream>
+#include <type_traits>
+#include <unordered_set>
+
+#include <boost/preprocessor/seq/for_each.hpp>
 
 namespace graphene { namespace db {
    /**
@@ -141,6 +145,55 @@ namespace graphene { namespace db {
          virtual void object_modified( const object& after  ){};
    };
 
+   /**
+    *  Set by GRAPHENE_DB_INDEX_KEYS for the members of Class that are part of an index key or are
+    *  read by a secondary index, i.e. the members object_database::modify_fields() must not touch
+    *  in place.
+    */
+   template<typename Class, typename Type, Type Class::*Member>
+   struct index_key_field : std::false_type {};
+
+   /** Set by GRAPHENE_DB_INDEX_KEYS, modify_fields() is only available for types that declare their keys */
+   template<typename Class>
+   struct has_index_keys : std::false_type {};
+
+   /** A data member of Class, named with GRAPHENE_DB_FIELD() */
+   template<typename Class, typename Type, Type Class::*Member>
+   struct object_field
+   {
+      typedef Class class_type;
+      static const bool is_index_key = index_key_field<Class,Type,Member>::value;
+      static Type&       get( Class& obj )       { return obj.*Member; }
+      static const Type& get( const Class& obj ) { return obj.*Member; }
+   };
+
+   template<typename... Fields>
+   struct any_index_key : std::false_type {};
+   template<typename Field, typename... Fields>
+   struct any_index_key<Field, Fields...>
+      : std::integral_constant<bool, Field::is_index_key || any_index_key<Fields...>::value> {};
+
+   template<typename Class, typename... Fields>
+   struct fields_of : std::true_type {};
+   template<typename Class, typename Field, typename... Fields>
+   struct fields_of<Class, Field, Fields...>
+      : std::integral_constant<bool, std::is_same<Class, typename Field::class_type>::value
+                                     && fields_of<Class, Fields...>::value> {};
+
+   /**
+    *  @brief The objects of one index that changed since changes were last taken
+    *
+    *  Modified objects are stored in their packed form, as produced by object::pack().
+    */
+   struct index_changes
+   {
+      uint8_t                                        space_id = 0;
+      uint8_t                                        type_id  = 0;
+      object_id_type                                 next_id;
+      vector< std::pair<object_id_type,vector<char>> > modified;
+      vector< object_id_type >                       removed;
+   };
+
    /**
     *   Defines the common implementation
     */
@@ -148,6 +201,7 @@ namespace graphene { namespace db {
    {
       public:
          base_primary_index( object_database& db ):_db(db){}
+         virtual ~base_primary_index(){}
 
          /** called just before obj is modified */
          void save_undo( const object& obj );
@@ -161,6 +215,40 @@ namespace graphene { namespace db {
          /** called just after obj is modified */
          void on_modify( const object& obj );
 
+         /**
+          *  When enabled, the ids of all objects added, modified or removed are
+          *  recorded until they are collected with take_changes(). Enabling or
+          *  disabling forgets all recorded ids.
+          */
+         void set_track_changes( bool enabled );
+         bool tracks_changes()const { return _track_changes; }
+         void clear_changes() { _changed.clear(); _removed.clear(); }
+
+         /** Packs the current value of every recorded object into changes and forgets the recorded ids */
+         virtual void take_changes( index_changes& changes ) = 0;
+
+         /** Records the objects in changes again, used when taken changes could not be persisted */
+         void restore_changes( const index_changes& changes );
+
+         /** Removes an object without saving undo state or notifying observers, counterpart of index::load() */
+         virtual void unload( object_id_type id ) = 0;
+
+         /** Unloads every object and resets the next id */
+         virtual void unload_all() = 0;
+
+         /** Packs every object of the index into snapshot, in the form taken by object_database::apply_changes() */
+         virtual void snapshot_objects( index_changes& snapshot )const = 0;
+
+         /**
+          *  Reads the objects written by index::save() without notifying secondary indexes. Different
+          *  indexes may be loaded concurrently; populate_secondary_indexes() must be called afterwards.
+          *  @return the number of objects loaded
+          */
+         virtual uint64_t load_objects( const fc::path& db ) = 0;
+
+         /** Notifies all secondary indexes of every object in the index */
+         virtual void populate_secondary_indexes() = 0;
+
          template<typename T>
          void add_secondary_index()
          {
@@ -178,10 +266,23 @@ namespace graphene { namespace db {
             FC_THROW_EXCEPTION( fc::assert_exception, "invalid index type" );
          }
 
+         template<typename T>
+         T& get_secondary_index()
+         {
+            return const_cast<T&>( static_cast<const base_primary_index*>( this )->get_secondary_index<T>() );
+         }
+
       protected:
+         /** called when an object is re-inserted, i.e. by undo */
+         void on_insert( const object& obj );
+
          vector< shared_ptr<index_observer> >   _observers;
          vector< unique_ptr<secondary_index> >  _sindex;
 
+         bool                                   _track_changes = false;
+         std::unordered_set<object_id_type>     _changed;
+         std::unordered_set<object_id_type>     _removed;
+
       private:
          object_database& _db;
    };
@@ -220,8 +321,14 @@ namespace graphene { namespace db {
          }
 
          virtual void open( const fc::path& db )override
-         { 
-            if( !fc::exists( db ) ) return;
+         {
+            load_objects( db );
+            populate_secondary_indexes();
+         }
+
+         virtual uint64_t load_objects( const fc::path& db )override
+         {
+            if( !fc::exists( db ) ) return 0;
             fc::file_mapping fm( db.generic_string().c_str(), fc::read_only );
             fc::mapped_region mr( fm, fc::read_only, 0, fc::file_size(db) );
             fc::datastream<const char*> ds( (const char*)mr.get_address(), mr.get_size() );
@@ -230,14 +337,34 @@ namespace graphene { namespace db {
             fc::raw::unpack(ds, _next_id);
             fc::raw::unpack(ds, open_ver);
             FC_ASSERT( open_ver == get_object_version(), "Incompatible Version, the serialization of objects in this index has changed" );
+            uint64_t count = 0;
             try {
-               vector<char> tmp;
-               while( true ) 
+               // each object is stored as a packed vector<char>, unpack it in place instead of copying it out first
+               while( ds.remaining() > 0 )
                {
-                  fc::raw::unpack( ds, tmp );
-                  load( tmp );
+                  fc::unsigned_int size;
+                  fc::raw::unpack( ds, size );
+                  FC_ASSERT( size.value <= ds.remaining() );
+                  fc::datastream<const char*> obj_ds( ds.pos(), size.value );
+                  object_type obj;
+                  fc::raw::unpack( obj_ds, obj );
+                  DerivedIndex::insert( std::move(obj) );
+                  ds.skip( size.value );
+                  ++count;
                }
-            } catch ( const fc::exception&  ){}
+            } catch ( const fc::exception& e ) {
+               wlog( "Stopped loading ${f} after ${n} objects: ${e}", ("f",db)("n",count)("e",e.to_string()) );
+            }
+            return count;
+         }
+
+         virtual void populate_secondary_indexes()override
+         {
+            if( _sindex.empty() ) return;
+            this->inspect_all_objects( [this]( const object& o ) {
+               for( const auto& item : _sindex )
+                  item->object_inserted( o );
+            });
          }
 
          virtual void save( const fc::path& db ) override 
@@ -263,6 +390,59 @@ namespace graphene { namespace db {
             return result;
          }
 
+         virtual void unload( object_id_type id )override
+         {
+            const object* obj = DerivedIndex::find( id );
+            if( obj == nullptr ) return;
+            for( const auto& item : _sindex )
+               item->object_removed( *obj );
+            DerivedIndex::remove( *obj );
+         }
+
+         virtual void unload_all()override
+         {
+            vector<object_id_type> ids;
+            this->inspect_all_objects( [&ids]( const object& o ) { ids.push_back( o.id ); } );
+            for( const auto& id : ids )
+               unload( id );
+            _next_id = object_id_type( object_type::space_id, object_type::type_id, 0 );
+         }
+
+         virtual void snapshot_objects( index_changes& snapshot )const override
+         {
+            snapshot.space_id = object_type::space_id;
+            snapshot.type_id  = object_type::type_id;
+            snapshot.next_id  = _next_id;
+            this->inspect_all_objects( [&snapshot]( const object& o ) {
+               snapshot.modified.emplace_back( o.id, o.pack() );
+            });
+         }
+
+         virtual void take_changes( index_changes& changes )override
+         {
+            changes.space_id = object_type::space_id;
+            changes.type_id  = object_type::type_id;
+            changes.next_id  = _next_id;
+            changes.modified.reserve( _changed.size() );
+            for( const auto& id : _changed )
+            {
+               const object* obj = DerivedIndex::find( id );
+               if( obj != nullptr )
+                  changes.modified.emplace_back( id, obj->pack() );
+            }
+            changes.removed.assign( _removed.begin(), _removed.end() );
+            clear_changes();
+         }
+
+         virtual const object& insert( object&& obj )override
+         {
+            const auto& result = DerivedIndex::insert( std::move(obj) );
+            for( const auto& item : _sindex )
+               item->object_inserted( result );
+            on_insert( result );
+            return result;
+         }
+
 
          virtual const object&  create(const std::function<void(object&)>& constructor )override
          {
@@ -320,3 +500,30 @@ namespace graphene { namespace db {
    };
 
 } } // graphene::db
+
+FC_REFLECT( graphene::db::index_changes, (space_id)(type_id)(next_id)(modified)(removed) )
+
+/** Names a data member for object_database::modify_fields() */
+#define GRAPHENE_DB_FIELD( CLASS, MEMBER ) \
+   graphene::db::object_field< CLASS, decltype(CLASS::MEMBER), &CLASS::MEMBER >
+
+#define GRAPHENE_DB_INDEX_KEY_FIELD( r, CLASS, MEMBER ) \
+   template<> struct index_key_field< CLASS, decltype(CLASS::MEMBER), &CLASS::MEMBER > : std::true_type {};
+
+/**
+ *  Declares the members of CLASS that make up the keys of its index, including members read by
+ *  secondary indexes, as a sequence (a)(b)(c). Must be used at global scope.
+ */
+#define GRAPHENE_DB_INDEX_KEYS( CLASS, MEMBERS ) \
+   namespace graphene { namespace db { \
+      template<> struct has_index_keys< CLASS > : std::true_type {}; \
+      BOOST_PP_SEQ_FOR_EACH( GRAPHENE_DB_INDEX_KEY_FIELD, CLASS, MEMBERS ) \
+   } }
+
+/** Declares that CLASS is indexed by id only */
+#define GRAPHENE_DB_NO_INDEX_KEYS( CLASS ) \
+   namespace graphene { namespace db { \
+      template<> struct has_index_keys< CLASS > : std::true_type {}; \
+   } }
+
+
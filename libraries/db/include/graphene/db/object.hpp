@@ -27,6 +27,8 @@
 #include <fc/crypto/city.hpp>
 #include <fc/uint128.hpp>
 
+#include <new>
+
 #define MAX_NESTING (200)
 
 namespace graphene { namespace db {
@@ -68,6 +70,13 @@ namespace graphene { namespace db {
          static const uint8_t space_id = 0;
          static const uint8_t type_id  = 0;
 
+         /**
+          *  Object types that hold large containers but are mostly modified in a few scalar
+          *  fields can set this to true in their class. undo_database then saves their value
+          *  in serialized form in its arena instead of deep copying the containers.
+          */
+         static const bool serialized_undo = false;
+
 
          // serialized
          object_id_type          id;
@@ -75,6 +84,16 @@ namespace graphene { namespace db {
          /// these methods are implemented for derived classes by inheriting abstract_object<DerivedClass>
          virtual unique_ptr<object> clone()const = 0;
          virtual void               move_from( object& obj ) = 0;
+         /// construct a copy (or take the value) of this object in caller provided memory of object_size() bytes
+         virtual object*            copy_to( void* mem )const = 0;
+         virtual object*            move_to( void* mem ) = 0;
+         virtual size_t             object_size()const = 0;
+         virtual size_t             object_alignment()const = 0;
+         /// serialized form used by undo_database for types with serialized_undo
+         virtual bool               uses_serialized_undo()const = 0;
+         virtual size_t             packed_size()const = 0;
+         virtual void               pack_to( char* mem, size_t size )const = 0;
+         virtual void               unpack_from( const char* data, size_t size ) = 0;
          virtual variant            to_variant()const  = 0;
          virtual vector<char>       pack()const = 0;
          virtual fc::uint128        hash()const = 0;
@@ -100,6 +119,31 @@ namespace graphene { namespace db {
          {
             static_cast<DerivedClass&>(*this) = std::move( static_cast<DerivedClass&>(obj) );
          }
+         virtual object* copy_to( void* mem )const
+         {
+            return new (mem) DerivedClass( *static_cast<const DerivedClass*>(this) );
+         }
+         virtual object* move_to( void* mem )
+         {
+            return new (mem) DerivedClass( std::move( *static_cast<DerivedClass*>(this) ) );
+         }
+         virtual size_t  object_size()const      { return sizeof(DerivedClass); }
+         virtual size_t  object_alignment()const { return alignof(DerivedClass); }
+         virtual bool    uses_serialized_undo()const { return DerivedClass::serialized_undo; }
+         virtual size_t  packed_size()const { return fc::raw::pack_size( static_cast<const DerivedClass&>(*this) ); }
+         virtual void    pack_to( char* mem, size_t size )const
+         {
+            fc::datastream<char*> ds( mem, size );
+            fc::raw::pack( ds, static_cast<const DerivedClass&>(*this) );
+         }
+         virtual void    unpack_from( const char* data, size_t size )
+         {
+            // unpacking into a fresh object, since unpacking appends to existing containers
+            fc::datastream<const char*> ds( data, size );
+            DerivedClass tmp;
+            fc::raw::unpack( ds, tmp );
+            static_cast<DerivedClass&>(*this) = std::move( tmp );
+         }
          virtual variant to_variant()const { return variant( static_cast<const DerivedClass&>(*this), MAX_NESTING ); }
          virtual vector<char> pack()const  { return fc::raw::pack_to_vector( static_cast<const DerivedClass&>(*this) ); }
          virtual fc::uint128  hash()const  {  
@@ -32,6 +32,9 @@
 
 namespace graphene { namespace db {
 
+   /** The changes of every index that tracks them, @see object_database::take_changes() */
+   typedef vector< index_changes > object_changes;
+
    /**
     *   @class object_database
     *   @brief maintains a set of indexed objects that can be modified with multi-level rollback support
@@ -42,7 +45,7 @@ namespace graphene { namespace db {
          object_database();
          ~object_database();
 
-         void reset_indexes() { _index.clear(); _index.resize(255); }
+         void reset_indexes() { _index.clear(); _index.resize(255); _primary_index.clear(); _primary_index.resize(255); }
 
          void open(const fc::path& data_dir );
 
@@ -53,6 +56,30 @@ namespace graphene { namespace db {
          void wipe(const fc::path& data_dir); // remove from disk
          void close();
 
+         /**
+          *  Incremental persistence: while change tracking is enabled every index records which
+          *  objects were added, modified or removed. take_changes() collects the current value of
+          *  those objects so that they can be written out and later replayed on top of the last
+          *  full flush() with apply_changes(), which is much cheaper than saving every object.
+          */
+         /// @{
+         void           set_track_changes( bool enabled );
+         object_changes take_changes();
+         void           restore_changes( const object_changes& changes );
+         void           apply_changes( const object_changes& changes );
+         /** merges later, taken after changes, into changes as if both had been taken at once */
+         static void    fold_changes( object_changes& changes, const object_changes& later );
+         /// @}
+
+         /**
+          *  The complete state as changes to an empty database: every object of every primary index.
+          *  unload_all_objects() followed by apply_changes() of the result restores it.
+          */
+         /// @{
+         object_changes snapshot_objects();
+         void           unload_all_objects();
+         /// @}
+
          template<typename T, typename F>
          const T& create( F&& constructor )
          {
@@ -91,6 +118,26 @@ namespace graphene { namespace db {
             get_mutable_index(obj.id).modify(obj,m);
          }
 
+         /**
+          *  Like modify(), for modifiers that only change the listed Fields, e.g.
+          *
+          *     db.modify_fields< GRAPHENE_DB_FIELD( account_object, total_listening_time ) >( acct,
+          *        []( account_object& a ) { a.total_listening_time += 10; } );
+          *
+          *  If none of the fields is declared as a key by GRAPHENE_DB_INDEX_KEYS, the object is changed
+          *  in place: the index containers are not re-sorted and secondary indexes are not notified.
+          *  Undo state, change tracking and observers are handled as by modify(). Otherwise this is
+          *  the same as modify(). Debug builds check that the modifier changed no other member.
+          */
+         template<typename... Fields, typename T, typename Lambda>
+         void modify_fields( const T& obj, const Lambda& m )
+         {
+            static_assert( has_index_keys<T>::value, "declare the index keys of T with GRAPHENE_DB_INDEX_KEYS" );
+            static_assert( sizeof...(Fields) > 0, "list the modified fields" );
+            static_assert( fields_of<T, Fields...>::value, "the fields must be members of T" );
+            modify_fields_impl<Fields...>( obj, m, std::integral_constant<bool, !any_index_key<Fields...>::value>() );
+         }
+
          ///@}
 
          template<typename T>
@@ -136,6 +183,9 @@ namespace graphene { namespace db {
             assert(!_index[ObjectType::space_id][ObjectType::type_id]);
             FC_ASSERT(!_index[ObjectType::space_id][ObjectType::type_id], "duplicate index id detected");
             unique_ptr<index> indexptr( new IndexType(*this) );
+            if( _primary_index[ObjectType::space_id].size() <= ObjectType::type_id )
+                _primary_index[ObjectType::space_id].resize( 255 );
+            _primary_index[ObjectType::space_id][ObjectType::type_id] = dynamic_cast<base_primary_index*>( indexptr.get() );
             _index[ObjectType::space_id][ObjectType::type_id] = std::move(indexptr);
             return static_cast<IndexType*>(_index[ObjectType::space_id][ObjectType::type_id].get());
          }
@@ -158,6 +208,41 @@ namespace graphene { namespace db {
          index& get_mutable_index(uint8_t space_id, uint8_t type_id);
 
      private:
+         template<typename Lambda>
+         void for_each_primary_index( Lambda&& l );
+
+         template<typename... Fields, typename T, typename Lambda>
+         void modify_fields_impl( const T& obj, const Lambda& m, std::false_type /* in place */ )
+         {
+            modify( obj, m );
+         }
+
+         template<typename... Fields, typename T, typename Lambda>
+         void modify_fields_impl( const T& obj, const Lambda& m, std::true_type /* in place */ )
+         {
+            base_primary_index* primary = _primary_index[obj.id.space()][obj.id.type()];
+            if( primary == nullptr )
+            {
+               modify( obj, m );
+               return;
+            }
+#ifndef NDEBUG
+            const T before( obj );
+#endif
+            save_undo( obj );
+            m( const_cast<T&>( obj ) );
+#ifndef NDEBUG
+            {
+               // with the listed fields put back, the object must be what it was before
+               T unlisted( obj );
+               using expand = int[];
+               (void)expand{ 0, ( Fields::get( unlisted ) = Fields::get( before ), 0 )... };
+               FC_ASSERT( fc::raw::pack_to_vector( unlisted ) == fc::raw::pack_to_vector( before ),
+                          "modify_fields() modifier changed a field that is not listed", ("id",obj.id) );
+            }
+#endif
+            primary->on_modify( obj );
+         }
 
          friend class base_primary_index;
          friend class undo_database;
@@ -167,8 +252,7 @@ namespace graphene { namespace db {
 
          fc::path                                                  _data_dir;
          vector< vector< unique_ptr<index> > >                     _index;
+         vector< vector< base_primary_index* > >                   _primary_index; ///< same layout as _index
    };
 
 } } // graphene::db
-
-
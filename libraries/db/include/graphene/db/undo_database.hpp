@@ -23,7 +23,9 @@
  */
 #pragma once
 #include <graphene/db/object.hpp>
+#include <algorithm>
 #include <deque>
+#include <unordered_map>
 #include <fc/exception/exception.hpp>
 
 namespace graphene { namespace db {
@@ -32,12 +34,215 @@ namespace graphene { namespace db {
    using fc::flat_set;
    class object_database;
 
+   /**
+    *  Bump allocator for the object copies held by an undo_state. Memory is carved out of
+    *  fixed size chunks and only given back, all at once, when the state is released. Released
+    *  chunks go to a pool shared by the states of one undo_database, so that sessions which are
+    *  opened and closed for every transaction do not allocate once the pool is warm.
+    */
+   class undo_arena
+   {
+      public:
+         typedef vector< unique_ptr<char[]> > chunk_pool;
+         static const size_t chunk_size     = 16 * 1024;
+         static const size_t max_pooled     = 64;
+
+         explicit undo_arena( chunk_pool* pool ):_pool(pool){}
+         ~undo_arena() { release(); }
+
+         undo_arena( const undo_arena& ) = delete;
+         undo_arena& operator=( const undo_arena& ) = delete;
+
+         void* allocate( size_t size, size_t alignment );
+         void  release();
+
+      private:
+         chunk_pool*                  _pool;
+         vector< unique_ptr<char[]> > _chunks;
+         vector< unique_ptr<char[]> > _oversized; ///< allocations too big for a chunk, not pooled
+         char*                        _pos = nullptr;
+         char*                        _end = nullptr;
+   };
+
+   /**
+    *  Maps object ids to values in a flat vector. While the map is small, the vector is sorted
+    *  except for a short tail of recent insertions, which is searched linearly and merged into
+    *  the sorted part once it has grown to max_unsorted entries. Beyond max_sorted entries the
+    *  positions of all entries are kept in a hash map instead, so that large sessions do not
+    *  pay for merges and vector erases proportional to their size. Iteration order is unspecified.
+    */
+   template<typename T>
+   class flat_id_map
+   {
+      public:
+         typedef std::pair<object_id_type,T>                  value_type;
+         typedef typename vector<value_type>::iterator        iterator;
+         typedef typename vector<value_type>::const_iterator  const_iterator;
+         static const size_t max_unsorted = 32;
+         static const size_t max_sorted   = 1024;
+
+         T* find( object_id_type id )
+         {
+            auto itr = find_entry( id );
+            return itr != _entries.end() ? &itr->second : nullptr;
+         }
+         const T* find( object_id_type id )const { return const_cast<flat_id_map*>(this)->find( id ); }
+         bool     contains( object_id_type id )const { return find( id ) != nullptr; }
+
+         /** @pre id is not contained */
+         T& insert( object_id_type id, T value )
+         {
+            if( !_hashed )
+            {
+               if( _entries.size() >= max_sorted )
+                  switch_to_hashed();
+               else if( _entries.size() - _sorted >= max_unsorted )
+                  sort();
+            }
+            if( _hashed )
+               _positions.emplace( id, _entries.size() );
+            _entries.emplace_back( id, std::move(value) );
+            return _entries.back().second;
+         }
+
+         bool erase( object_id_type id )
+         {
+            auto itr = find_entry( id );
+            if( itr == _entries.end() )
+               return false;
+            if( _hashed )
+            {
+               _positions.erase( id );
+               if( itr + 1 != _entries.end() )
+               {
+                  std::swap( *itr, _entries.back() );
+                  _positions[ itr->first ] = itr - _entries.begin();
+               }
+               _entries.pop_back();
+            }
+            else if( size_t( itr - _entries.begin() ) < _sorted )
+            {
+               _entries.erase( itr );
+               --_sorted;
+            }
+            else
+            {
+               std::swap( *itr, _entries.back() );
+               _entries.pop_back();
+            }
+            return true;
+         }
+
+         size_t         size()const  { return _entries.size(); }
+         bool           empty()const { return _entries.empty(); }
+         void           clear()      { _entries.clear(); _sorted = 0; _positions.clear(); _hashed = false; }
+         iterator       begin()      { return _entries.begin(); }
+         iterator       end()        { return _entries.end(); }
+         const_iterator begin()const { return _entries.begin(); }
+         const_iterator end()const   { return _entries.end(); }
+
+      private:
+         struct key_less
+         {
+            bool operator()( const value_type& a, const value_type& b )const { return a.first < b.first; }
+            bool operator()( const value_type& a, object_id_type b )const    { return a.first < b; }
+         };
+
+         void sort()
+         {
+            auto sorted_end = _entries.begin() + _sorted;
+            std::sort( sorted_end, _entries.end(), key_less() );
+            std::inplace_merge( _entries.begin(), sorted_end, _entries.end(), key_less() );
+            _sorted = _entries.size();
+         }
+
+         void switch_to_hashed()
+         {
+            _positions.reserve( _entries.size() * 2 );
+            for( size_t i = 0; i < _entries.size(); ++i )
+               _positions.emplace( _entries[i].first, i );
+            _hashed = true;
+            _sorted = 0;
+         }
+
+         iterator find_entry( object_id_type id )
+         {
+            if( _hashed )
+            {
+               auto pos = _positions.find( id );
+               return pos != _positions.end() ? _entries.begin() + pos->second : _entries.end();
+            }
+            auto sorted_end = _entries.begin() + _sorted;
+            auto itr = std::lower_bound( _entries.begin(), sorted_end, id, key_less() );
+            if( itr != sorted_end && itr->first == id )
+               return itr;
+            for( itr = sorted_end; itr != _entries.end(); ++itr )
+               if( itr->first == id )
+                  return itr;
+            return _entries.end();
+         }
+
+         vector<value_type>                         _entries;
+         size_t                                     _sorted = 0;
+         bool                                       _hashed = false;
+         std::unordered_map<object_id_type,size_t>  _positions; ///< index into _entries, only filled once _hashed
+   };
+
+   /**
+    *  The value of an object before it was modified. Objects of types with serialized_undo are
+    *  kept packed rather than as a deep copy, see object::serialized_undo. Once the session is
+    *  committed, the packed value is replaced by a diff against the object's value at the end
+    *  of the session where that is smaller, see undo_state::compact.
+    */
+   struct undo_record
+   {
+      object*  value  = nullptr; ///< copy of the object, or nullptr if it is packed
+      char*    packed = nullptr;
+      uint32_t packed_size = 0;
+      bool     is_diff = false; ///< packed holds a diff against the value after the state
+   };
+
+   /**
+    *  The changes of one undo session. Saved object values live in the state's arena and are
+    *  destroyed together with the state. Full packed values are kept in a separate scratch arena
+    *  that is given back when the state is compacted.
+    *
+    *  A diff is only valid while the object still has the value it had at the end of the state,
+    *  which is the case whenever the state is at the top of the stack. Diffs are therefore turned
+    *  back into full values before the object is modified again or a later state is merged in.
+    */
    struct undo_state
    {
-      unordered_map<object_id_type, unique_ptr<object> > old_values;
-      unordered_map<object_id_type, object_id_type>      old_index_next_ids;
-      std::unordered_set<object_id_type>                 new_ids;
-      unordered_map<object_id_type, unique_ptr<object> > removed;
+      explicit undo_state( undo_arena::chunk_pool* pool ):arena(pool),scratch(pool){}
+      ~undo_state();
+
+      undo_state( const undo_state& ) = delete;
+      undo_state& operator=( const undo_state& ) = delete;
+
+      /** @return a copy of obj allocated in this state's arena */
+      object* save( const object& obj );
+      /** @return obj moved into this state's arena */
+      object* adopt( object& obj );
+
+      /** @return the value of obj to restore on undo, packed if its type uses serialized undo */
+      undo_record record( const object& obj );
+      /** @return rec moved or copied into this state's arena */
+      undo_record adopt( undo_record& rec );
+      /** @return the full object saved by rec, current is the object's value after this state */
+      object*     materialize( const undo_record& rec, const object& current );
+      /** @return the packed value saved by rec, after is the packed value of the object after this state */
+      vector<char> packed_value( const undo_record& rec, const vector<char>& after )const;
+      /** replaces the diff in rec by the full packed value, see packed_value */
+      void        expand( undo_record& rec, const vector<char>& after );
+      /** replaces the full packed values of this state by diffs against the objects' present values */
+      void        compact( const object_database& db );
+
+      flat_id_map<undo_record>     old_values;
+      flat_id_map<object_id_type>  old_index_next_ids;
+      flat_id_map<bool>            new_ids; ///< only the keys are used
+      flat_id_map<object*>         removed;
+      undo_arena                   arena;
+      undo_arena                   scratch; ///< full packed values, released by compact()
    };
 
 
@@ -94,6 +299,8 @@ namespace graphene { namespace db {
          void    disable();
          void    enable();
          bool    enabled()const { return !_disabled; }
+         /** true while the objects of an undo state are being restored */
+         bool    rolling_back()const { return _rolling_back; }
 
          session start_undo_session( bool force_enable = false );
          /**
@@ -140,6 +347,8 @@ namespace graphene { namespace db {
 
          uint32_t                _active_sessions = 0;
          bool                    _disabled = true;
+         bool                    _rolling_back = false;
+         undo_arena::chunk_pool  _chunk_pool;
          std::deque<undo_state>  _stack;
          object_database&        _db;
          size_t                  _max_size = 256;
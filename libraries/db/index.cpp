@@ -32,12 +32,43 @@ namespace graphene { namespace db {
    void base_primary_index::on_add( const object& obj )
    {
       _db.save_undo_add( obj );
+      if( _track_changes ) { _changed.insert( obj.id ); _removed.erase( obj.id ); }
       for( auto ob : _observers ) ob->on_add( obj );
    }
 
    void base_primary_index::on_remove( const object& obj )
-   { _db.save_undo_remove( obj ); for( auto ob : _observers ) ob->on_remove( obj ); }
+   {
+      _db.save_undo_remove( obj );
+      if( _track_changes ) { _changed.erase( obj.id ); _removed.insert( obj.id ); }
+      for( auto ob : _observers ) ob->on_remove( obj );
+   }
 
    void base_primary_index::on_modify( const object& obj )
-   {for( auto ob : _observers ) ob->on_modify(  obj ); }
+   {
+      if( _track_changes ) _changed.insert( obj.id );
+      for( auto ob : _observers ) ob->on_modify(  obj );
+   }
+
+   void base_primary_index::on_insert( const object& obj )
+   {
+      if( _track_changes ) { _changed.insert( obj.id ); _removed.erase( obj.id ); }
+   }
+
+   void base_primary_index::set_track_changes( bool enabled )
+   {
+      _track_changes = enabled;
+      clear_changes();
+   }
+
+   void base_primary_index::restore_changes( const index_changes& changes )
+   {
+      if( !_track_changes ) return;
+      // anything recorded since the changes were taken is more recent and takes precedence
+      for( const auto& item : changes.modified )
+         if( _removed.find( item.first ) == _removed.end() )
+            _changed.insert( item.first );
+      for( const auto& id : changes.removed )
+         if( _changed.find( id ) == _changed.end() )
+            _removed.insert( id );
+   }
 } } // graphene::chain
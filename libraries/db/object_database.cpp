@@ -25,14 +25,21 @@
 
 #include <fc/io/raw.hpp>
 #include <fc/container/flat.hpp>
+#include <fc/thread/thread.hpp>
 #include <fc/uint128.hpp>
 
+#include <algorithm>
+#include <map>
+#include <set>
+#include <thread>
+
 namespace graphene { namespace db {
 
 object_database::object_database()
 :_undo_db(*this)
 {
    _index.resize(255);
+   _primary_index.resize(255);
    _undo_db.enable();
 }
 
@@ -71,6 +78,9 @@ index& object_database::get_mutable_index(uint8_t space_id, uint8_t type_id)
 
 void object_database::flush()
 {
+   // everything is on disk now, changes recorded so far are no longer needed
+   for_each_primary_index( []( base_primary_index& idx ) { idx.clear_changes(); } );
+
    fc::create_directories( _data_dir / "object_database.tmp" / "lock" );
    for( uint32_t space = 0; space < _index.size(); ++space )
    {
@@ -95,6 +105,18 @@ void object_database::wipe(const fc::path& data_dir)
    ilog("Done wiping object databse.");
 }
 
+/** Load statistics of one index, for the breakdown logged by object_database::open() */
+struct index_load_job
+{
+   index*              idx = nullptr;
+   base_primary_index* primary = nullptr;
+   fc::path            file;
+   uint64_t            file_size = 0;
+   uint64_t            objects = 0;
+   fc::microseconds    load_time;
+   fc::microseconds    secondary_time;
+};
+
 void object_database::open(const fc::path& data_dir)
 { try {
    _data_dir = data_dir;
@@ -104,12 +126,194 @@ void object_database::open(const fc::path& data_dir)
        return;
    }
    ilog("Opening object database from ${d} ...", ("d", data_dir));
+   auto start = fc::time_point::now();
+
+   vector<index_load_job> jobs;
    for( uint32_t space = 0; space < _index.size(); ++space )
       for( uint32_t type = 0; type  < _index[space].size(); ++type )
          if( _index[space][type] )
-            _index[space][type]->open( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
+         {
+            index_load_job job;
+            job.idx = _index[space][type].get();
+            job.primary = dynamic_cast<base_primary_index*>( job.idx );
+            job.file = _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type);
+            if( !fc::exists( job.file ) ) continue;
+            job.file_size = fc::file_size( job.file );
+            jobs.push_back( job );
+         }
+
+   // biggest indexes first, each to the worker with the fewest bytes assigned so far
+   std::sort( jobs.begin(), jobs.end(), []( const index_load_job& a, const index_load_job& b ) {
+      return a.file_size > b.file_size;
+   });
+   const uint32_t cores = std::thread::hardware_concurrency();
+   const size_t worker_count = std::max<size_t>( 1, std::min<size_t>( cores, jobs.size() ) );
+   vector< vector<index_load_job*> > assigned( worker_count );
+   vector< uint64_t > assigned_bytes( worker_count, 0 );
+   for( auto& job : jobs )
+   {
+      if( job.primary == nullptr ) continue;
+      const size_t w = std::min_element( assigned_bytes.begin(), assigned_bytes.end() ) - assigned_bytes.begin();
+      assigned[w].push_back( &job );
+      assigned_bytes[w] += job.file_size;
+   }
+
+   {
+      vector< std::unique_ptr<fc::thread> > workers;
+      vector< fc::future<void> > done;
+      for( size_t w = 0; w < worker_count; ++w )
+      {
+         if( assigned[w].empty() ) continue;
+         workers.emplace_back( new fc::thread( "load_" + fc::to_string( uint64_t(w) ) ) );
+         const vector<index_load_job*>& todo = assigned[w];
+         done.push_back( workers.back()->async( [&todo]() {
+            for( index_load_job* job : todo )
+            {
+               auto job_start = fc::time_point::now();
+               job->objects = job->primary->load_objects( job->file );
+               job->load_time = fc::time_point::now() - job_start;
+            }
+         }, "load_indexes" ) );
+      }
+      fc::optional<fc::exception> error;
+      for( auto& f : done )
+         try { f.wait(); } catch( const fc::exception& e ) { if( !error ) error = e; }
+      if( error )
+         throw *error;
+   }
+
+   // secondary indexes may refer to other indexes, so they are only filled once all objects are loaded
+   for( auto& job : jobs )
+   {
+      auto job_start = fc::time_point::now();
+      if( job.primary == nullptr )
+         job.idx->open( job.file );
+      else
+         job.primary->populate_secondary_indexes();
+      job.secondary_time = fc::time_point::now() - job_start;
+   }
+
+   std::sort( jobs.begin(), jobs.end(), []( const index_load_job& a, const index_load_job& b ) {
+      return a.load_time + a.secondary_time > b.load_time + b.secondary_time;
+   });
+   for( const auto& job : jobs )
+      if( job.objects > 0 )
+         ilog( "   ${s}.${t}: ${n} objects, ${b} bytes, load ${l} ms, secondary indexes ${x} ms",
+               ("s",job.idx->object_space_id())("t",job.idx->object_type_id())("n",job.objects)("b",job.file_size)
+               ("l",job.load_time.count() / 1000)("x",job.secondary_time.count() / 1000) );
+   ilog( "Opened object database with ${w} threads in ${t} ms", ("w",worker_count)
+         ("t",(fc::time_point::now() - start).count() / 1000) );
 } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
 
+template<typename Lambda>
+void object_database::for_each_primary_index( Lambda&& l )
+{
+   for( auto& space : _index )
+      for( auto& idx : space )
+      {
+         base_primary_index* primary = dynamic_cast<base_primary_index*>( idx.get() );
+         if( primary != nullptr )
+            l( *primary );
+      }
+}
+
+void object_database::set_track_changes( bool enabled )
+{
+   for_each_primary_index( [enabled]( base_primary_index& idx ) { idx.set_track_changes( enabled ); } );
+}
+
+object_changes object_database::take_changes()
+{
+   object_changes result;
+   for_each_primary_index( [&result]( base_primary_index& idx ) {
+      if( !idx.tracks_changes() ) return;
+      index_changes changes;
+      idx.take_changes( changes );
+      result.emplace_back( std::move(changes) );
+   });
+   return result;
+}
+
+void object_database::restore_changes( const object_changes& changes )
+{
+   for( const auto& item : changes )
+   {
+      base_primary_index* primary = dynamic_cast<base_primary_index*>( &get_mutable_index( item.space_id, item.type_id ) );
+      FC_ASSERT( primary != nullptr );
+      primary->restore_changes( item );
+   }
+}
+
+void object_database::apply_changes( const object_changes& changes )
+{ try {
+   for( const auto& item : changes )
+   {
+      index& idx = get_mutable_index( item.space_id, item.type_id );
+      base_primary_index* primary = dynamic_cast<base_primary_index*>( &idx );
+      FC_ASSERT( primary != nullptr );
+      for( const auto& id : item.removed )
+         primary->unload( id );
+      for( const auto& obj : item.modified )
+      {
+         primary->unload( obj.first );
+         idx.load( obj.second );
+      }
+      idx.set_next_id( item.next_id );
+   }
+} FC_CAPTURE_AND_RETHROW() }
+
+void object_database::fold_changes( object_changes& changes, const object_changes& later )
+{
+   for( const auto& item : later )
+   {
+      auto itr = std::find_if( changes.begin(), changes.end(), [&item]( const index_changes& c ) {
+         return c.space_id == item.space_id && c.type_id == item.type_id;
+      });
+      if( itr == changes.end() )
+      {
+         changes.push_back( item );
+         continue;
+      }
+
+      std::map< object_id_type, vector<char> > modified;
+      for( auto& obj : itr->modified )
+         modified[ obj.first ] = std::move( obj.second );
+      std::set< object_id_type > removed( itr->removed.begin(), itr->removed.end() );
+      for( const auto& id : item.removed )
+      {
+         modified.erase( id );
+         removed.insert( id );
+      }
+      for( const auto& obj : item.modified )
+      {
+         removed.erase( obj.first );
+         modified[ obj.first ] = obj.second;
+      }
+
+      itr->modified.clear();
+      itr->modified.reserve( modified.size() );
+      for( auto& obj : modified )
+         itr->modified.emplace_back( obj.first, std::move( obj.second ) );
+      itr->removed.assign( removed.begin(), removed.end() );
+      itr->next_id = item.next_id;
+   }
+}
+
+object_changes object_database::snapshot_objects()
+{
+   object_changes result;
+   for_each_primary_index( [&result]( base_primary_index& idx ) {
+      index_changes snapshot;
+      idx.snapshot_objects( snapshot );
+      result.emplace_back( std::move(snapshot) );
+   });
+   return result;
+}
+
+void object_database::unload_all_objects()
+{
+   for_each_primary_index( []( base_primary_index& idx ) { idx.unload_all(); } );
+}
 
 void object_database::pop_undo()
 { try {
@@ -25,8 +25,259 @@
 #include <graphene/db/undo_database.hpp>
 #include <fc/reflect/variant.hpp>
 
+#include <cstdint>
+#include <cstring>
+
 namespace graphene { namespace db {
 
+void* undo_arena::allocate( size_t size, size_t alignment )
+{
+   auto align_up = [alignment]( char* p ) {
+      return reinterpret_cast<char*>( ( reinterpret_cast<uintptr_t>(p) + alignment - 1 ) & ~uintptr_t( alignment - 1 ) );
+   };
+   if( size + alignment > chunk_size )
+   {
+      _oversized.emplace_back( new char[ size + alignment ] );
+      return align_up( _oversized.back().get() );
+   }
+   char* result = align_up( _pos );
+   if( _pos == nullptr || result + size > _end )
+   {
+      if( _pool != nullptr && !_pool->empty() )
+      {
+         _chunks.emplace_back( std::move( _pool->back() ) );
+         _pool->pop_back();
+      }
+      else
+         _chunks.emplace_back( new char[ chunk_size ] );
+      _pos = _chunks.back().get();
+      _end = _pos + chunk_size;
+      result = align_up( _pos );
+   }
+   _pos = result + size;
+   return result;
+}
+
+void undo_arena::release()
+{
+   for( auto& chunk : _chunks )
+      if( _pool != nullptr && _pool->size() < max_pooled )
+         _pool->emplace_back( std::move( chunk ) );
+   _chunks.clear();
+   _oversized.clear();
+   _pos = _end = nullptr;
+}
+
+undo_state::~undo_state()
+{
+   for( auto& item : old_values )
+      if( item.second.value != nullptr )
+         item.second.value->~object();
+   for( auto& item : removed )
+      item.second->~object();
+}
+
+object* undo_state::save( const object& obj )
+{
+   return obj.copy_to( arena.allocate( obj.object_size(), obj.object_alignment() ) );
+}
+
+object* undo_state::adopt( object& obj )
+{
+   return obj.move_to( arena.allocate( obj.object_size(), obj.object_alignment() ) );
+}
+
+namespace {
+
+   // Runs of changed bytes closer than this are stored as one run
+   const size_t min_diff_gap = 16;
+
+   void put_u32( vector<char>& out, size_t value )
+   {
+      uint32_t v = uint32_t( value );
+      out.insert( out.end(), reinterpret_cast<const char*>(&v), reinterpret_cast<const char*>(&v) + sizeof(v) );
+   }
+
+   size_t get_u32( const char*& pos )
+   {
+      uint32_t v;
+      std::memcpy( &v, pos, sizeof(v) );
+      pos += sizeof(v);
+      return v;
+   }
+
+   /**
+    *  The diff is the length of the common prefix and suffix of old and cur and the size of old,
+    *  followed by (offset, length, bytes) runs of old that differ from cur between the two. If the
+    *  parts between prefix and suffix differ in size, that part of old is stored as a single run.
+    */
+   vector<char> make_diff( const char* old, size_t old_size, const char* cur, size_t cur_size )
+   {
+      const size_t common = std::min( old_size, cur_size );
+      size_t prefix = 0;
+      while( prefix < common && old[prefix] == cur[prefix] )
+         ++prefix;
+      size_t suffix = 0;
+      while( suffix < common - prefix && old[old_size - 1 - suffix] == cur[cur_size - 1 - suffix] )
+         ++suffix;
+      const size_t old_mid = old_size - prefix - suffix;
+      const size_t cur_mid = cur_size - prefix - suffix;
+      const char* old_begin = old + prefix;
+      const char* cur_begin = cur + prefix;
+
+      vector<char> result;
+      put_u32( result, prefix );
+      put_u32( result, suffix );
+      put_u32( result, old_size );
+      auto put_run = [&]( size_t offset, size_t length ) {
+         put_u32( result, offset );
+         put_u32( result, length );
+         result.insert( result.end(), old_begin + offset, old_begin + offset + length );
+      };
+      if( old_mid != cur_mid )
+      {
+         put_run( 0, old_mid );
+         return result;
+      }
+      size_t i = 0;
+      while( i < old_mid )
+      {
+         if( old_begin[i] == cur_begin[i] )
+         {
+            ++i;
+            continue;
+         }
+         size_t start = i;
+         size_t end = i;
+         for( size_t equal = 0; i < old_mid && equal < min_diff_gap; ++i )
+         {
+            if( old_begin[i] == cur_begin[i] )
+               ++equal;
+            else
+            {
+               equal = 0;
+               end = i + 1;
+            }
+         }
+         put_run( start, end - start );
+         i = end;
+      }
+      return result;
+   }
+
+   vector<char> apply_diff( const char* diff, size_t diff_size, const vector<char>& cur )
+   {
+      const char* pos = diff;
+      const char* diff_end = diff + diff_size;
+      const size_t prefix = get_u32( pos );
+      const size_t suffix = get_u32( pos );
+      const size_t old_size = get_u32( pos );
+      FC_ASSERT( prefix + suffix <= cur.size() && prefix + suffix <= old_size, "undo diff does not match the object" );
+      const size_t old_mid = old_size - prefix - suffix;
+      const size_t cur_mid = cur.size() - prefix - suffix;
+
+      vector<char> result( old_size );
+      std::memcpy( result.data(), cur.data(), prefix );
+      std::memcpy( result.data() + prefix, cur.data() + prefix, std::min( old_mid, cur_mid ) );
+      std::memcpy( result.data() + old_size - suffix, cur.data() + cur.size() - suffix, suffix );
+      while( pos < diff_end )
+      {
+         const size_t offset = get_u32( pos );
+         const size_t length = get_u32( pos );
+         std::memcpy( result.data() + prefix + offset, pos, length );
+         pos += length;
+      }
+      return result;
+   }
+
+} // anonymous namespace
+
+undo_record undo_state::record( const object& obj )
+{
+   undo_record result;
+   if( obj.uses_serialized_undo() )
+   {
+      result.packed_size = obj.packed_size();
+      result.packed = static_cast<char*>( scratch.allocate( result.packed_size, 1 ) );
+      obj.pack_to( result.packed, result.packed_size );
+   }
+   else
+      result.value = save( obj );
+   return result;
+}
+
+undo_record undo_state::adopt( undo_record& rec )
+{
+   undo_record result;
+   if( rec.value != nullptr )
+      result.value = adopt( *rec.value );
+   else
+   {
+      result.packed_size = rec.packed_size;
+      result.is_diff = rec.is_diff;
+      result.packed = static_cast<char*>( ( rec.is_diff ? arena : scratch ).allocate( rec.packed_size, 1 ) );
+      std::memcpy( result.packed, rec.packed, rec.packed_size );
+   }
+   return result;
+}
+
+object* undo_state::materialize( const undo_record& rec, const object& current )
+{
+   if( rec.value != nullptr )
+      return rec.value;
+   object* result = save( current );
+   if( rec.is_diff )
+   {
+      vector<char> value = packed_value( rec, current.pack() );
+      result->unpack_from( value.data(), value.size() );
+   }
+   else
+      result->unpack_from( rec.packed, rec.packed_size );
+   return result;
+}
+
+vector<char> undo_state::packed_value( const undo_record& rec, const vector<char>& after )const
+{
+   if( rec.value != nullptr )
+      return rec.value->pack();
+   if( rec.is_diff )
+      return apply_diff( rec.packed, rec.packed_size, after );
+   return vector<char>( rec.packed, rec.packed + rec.packed_size );
+}
+
+void undo_state::expand( undo_record& rec, const vector<char>& after )
+{
+   if( !rec.is_diff )
+      return;
+   vector<char> value = packed_value( rec, after );
+   rec.packed_size = value.size();
+   rec.packed = static_cast<char*>( scratch.allocate( rec.packed_size, 1 ) );
+   std::memcpy( rec.packed, value.data(), rec.packed_size );
+   rec.is_diff = false;
+}
+
+void undo_state::compact( const object_database& db )
+{
+   for( auto& item : old_values )
+   {
+      undo_record& rec = item.second;
+      if( rec.value != nullptr || rec.is_diff )
+         continue;
+      vector<char> after = db.get_object( item.first ).pack();
+      vector<char> diff = make_diff( rec.packed, rec.packed_size, after.data(), after.size() );
+      // the scratch arena is released below, so values that don't shrink are copied as they are
+      const bool use_diff = diff.size() < rec.packed_size;
+      const char* data = use_diff ? diff.data() : rec.packed;
+      const size_t size = use_diff ? diff.size() : rec.packed_size;
+      char* packed = static_cast<char*>( arena.allocate( size, 1 ) );
+      std::memcpy( packed, data, size );
+      rec.packed = packed;
+      rec.packed_size = size;
+      rec.is_diff = use_diff;
+   }
+   scratch.release();
+}
+
 void undo_database::enable()  { _disabled = false; }
 void undo_database::disable() { _disabled = true; }
 
@@ -40,7 +291,7 @@ undo_database::session undo_database::start_undo_session( bool force_enable )
    while( size() > max_size() )
       _stack.pop_front();
 
-   _stack.emplace_back();
+   _stack.emplace_back( &_chunk_pool );
    ++_active_sessions;
    return session(*this, disable_on_exit );
 }
@@ -49,60 +300,80 @@ void undo_database::on_create( const object& obj )
    if( _disabled ) return;
 
    if( _stack.empty() )
-      _stack.emplace_back();
+      _stack.emplace_back( &_chunk_pool );
    auto& state = _stack.back();
    auto index_id = object_id_type( obj.id.space(), obj.id.type(), 0 );
-   auto itr = state.old_index_next_ids.find( index_id );
-   if( itr == state.old_index_next_ids.end() )
-      state.old_index_next_ids[index_id] = obj.id;
-   state.new_ids.insert(obj.id);
+   if( !state.old_index_next_ids.contains( index_id ) )
+      state.old_index_next_ids.insert( index_id, obj.id );
+   state.new_ids.insert( obj.id, true );
 }
 void undo_database::on_modify( const object& obj )
 {
    if( _disabled ) return;
 
    if( _stack.empty() )
-      _stack.emplace_back();
+      _stack.emplace_back( &_chunk_pool );
    auto& state = _stack.back();
-   if( state.new_ids.find(obj.id) != state.new_ids.end() )
+   if( state.new_ids.contains(obj.id) )
       return;
-   auto itr =  state.old_values.find(obj.id);
-   if( itr != state.old_values.end() ) return;
-   state.old_values[obj.id] = obj.clone();
+   if( undo_record* old_value = state.old_values.find(obj.id) )
+   {
+      // the diff is against the value obj is about to lose
+      if( old_value->is_diff )
+         state.expand( *old_value, obj.pack() );
+      return;
+   }
+   state.old_values.insert( obj.id, state.record( obj ) );
 }
 void undo_database::on_remove( const object& obj )
 {
    if( _disabled ) return;
 
    if( _stack.empty() )
-      _stack.emplace_back();
+      _stack.emplace_back( &_chunk_pool );
    undo_state& state = _stack.back();
-   if( state.new_ids.count(obj.id) )
-   {
-      state.new_ids.erase(obj.id);
+   if( state.new_ids.erase(obj.id) )
       return;
-   }
-   if( state.old_values.count(obj.id) )
+   if( undo_record* old_value = state.old_values.find(obj.id) )
    {
-      state.removed[obj.id] = std::move(state.old_values[obj.id]);
+      state.removed.insert( obj.id, state.materialize( *old_value, obj ) );
       state.old_values.erase(obj.id);
       return;
    }
-   if( state.removed.count(obj.id) ) return;
-   state.removed[obj.id] = obj.clone();
+   if( state.removed.contains(obj.id) ) return;
+   state.removed.insert( obj.id, state.save( obj ) );
 }
 
 void undo_database::rollback_state()
 { try {
    auto& state = _stack.back();
-   for( auto& item : state.old_values )
+   _rolling_back = true;
+   try {
+      for( auto& item : state.old_values )
+      {
+         const undo_record& rec = item.second;
+         const object& current = _db.get_object( item.first );
+         if( rec.value != nullptr )
+            _db.modify( current, [&rec]( object& obj ){ obj.move_from( *rec.value ); } );
+         else if( rec.is_diff )
+         {
+            vector<char> value = state.packed_value( rec, current.pack() );
+            _db.modify( current, [&value]( object& obj ){ obj.unpack_from( value.data(), value.size() ); } );
+         }
+         else
+            _db.modify( current, [&rec]( object& obj ){ obj.unpack_from( rec.packed, rec.packed_size ); } );
+      }
+   }
+   catch( ... )
    {
-      _db.modify( _db.get_object( item.second->id ), [&item]( object& obj ){ obj.move_from( *item.second ); } );
+      _rolling_back = false;
+      throw;
    }
+   _rolling_back = false;
 
-   for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
+   for( auto& item : state.new_ids )
    {
-      _db.remove( _db.get_object(*ritr) );
+      _db.remove( _db.get_object(item.first) );
    }
 
    for( auto& item : state.old_index_next_ids )
@@ -184,32 +455,35 @@ void undo_database::merge()
    // *+upd
    for( auto& obj : state.old_values )
    {
-      if( prev_state.new_ids.find(obj.second->id) != prev_state.new_ids.end() )
+      if( prev_state.new_ids.contains(obj.first) )
       {
          // new+upd -> new, type A
          continue;
       }
-      if( prev_state.old_values.find(obj.second->id) != prev_state.old_values.end() )
+      if( undo_record* old_value = prev_state.old_values.find(obj.first) )
       {
          // upd(was=X) + upd(was=Y) -> upd(was=X), type A
+         // a diff in prev_state is against Y, which is only saved by state
+         if( old_value->is_diff )
+            prev_state.expand( *old_value, state.packed_value( obj.second, _db.get_object( obj.first ).pack() ) );
          continue;
       }
       // del+upd -> N/A
-      assert( prev_state.removed.find(obj.second->id) == prev_state.removed.end() );
+      assert( !prev_state.removed.contains(obj.first) );
       // nop+upd(was=Y) -> upd(was=Y), type B
-      prev_state.old_values[obj.second->id] = std::move(obj.second);
+      prev_state.old_values.insert( obj.first, prev_state.adopt( obj.second ) );
    }
 
    // *+new, but we assume the N/A cases don't happen, leaving type B nop+new -> new
-   for( auto id : state.new_ids )
-      prev_state.new_ids.insert(id);
+   for( auto& item : state.new_ids )
+      prev_state.new_ids.insert( item.first, true );
 
    // old_index_next_ids can only be updated, iterate over *+upd cases
    for( auto& item : state.old_index_next_ids )
    {
-      if( prev_state.old_index_next_ids.find( item.first ) == prev_state.old_index_next_ids.end() )
+      if( !prev_state.old_index_next_ids.contains( item.first ) )
          // nop+upd(was=Y) -> upd(was=Y), type B
-         prev_state.old_index_next_ids[item.first] = item.second;
+         prev_state.old_index_next_ids.insert( item.first, item.second );
       // else
          // upd(was=X)+upd(was=Y) -> upd(was=X), type A
          // type A implementation is a no-op, as discussed above, so there is no code here
@@ -218,25 +492,25 @@ void undo_database::merge()
    // *+del
    for( auto& obj : state.removed )
    {
-      if( prev_state.new_ids.find(obj.second->id) != prev_state.new_ids.end() )
+      if( prev_state.new_ids.erase(obj.first) )
       {
          // new + del -> nop (type C)
-         prev_state.new_ids.erase(obj.second->id);
          continue;
       }
-      auto it = prev_state.old_values.find(obj.second->id);
-      if( it != prev_state.old_values.end() )
+      if( undo_record* old_value = prev_state.old_values.find(obj.first) )
       {
          // upd(was=X) + del(was=Y) -> del(was=X)
-         prev_state.removed[obj.second->id] = std::move(it->second);
-         prev_state.old_values.erase(obj.second->id);
+         prev_state.removed.insert( obj.first, prev_state.materialize( *old_value, *obj.second ) );
+         prev_state.old_values.erase(obj.first);
          continue;
       }
       // del + del -> N/A
-      assert( prev_state.removed.find( obj.second->id ) == prev_state.removed.end() );
+      assert( !prev_state.removed.contains( obj.first ) );
       // nop + del(was=Y) -> del(was=Y)
-      prev_state.removed[obj.second->id] = std::move(obj.second);
+      prev_state.removed.insert( obj.first, prev_state.adopt( *obj.second ) );
    }
+   // objects taken over by prev_state have been moved into its arena, the rest of state,
+   // including its arena chunks, is released as a whole
    _stack.pop_back();
    --_active_sessions;
 }
@@ -244,6 +518,9 @@ void undo_database::commit()
 {
    FC_ASSERT( _active_sessions > 0 );
    --_active_sessions;
+   // committed states are kept until they fall off the stack, store them as diffs
+   if( !_disabled && !_stack.empty() )
+      _stack.back().compact( _db );
 }
 
 void undo_database::pop_commit()
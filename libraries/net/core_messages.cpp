@@ -45,6 +45,13 @@ namespace graphene { namespace net {
   const core_message_type_enum check_firewall_reply_message::type            = core_message_type_enum::check_firewall_reply_message_type;
   const core_message_type_enum get_current_connections_request_message::type = core_message_type_enum::get_current_connections_request_message_type;
   const core_message_type_enum get_current_connections_reply_message::type   = core_message_type_enum::get_current_connections_reply_message_type;
+  const core_message_type_enum compact_block_message::type                   = core_message_type_enum::compact_block_message_type;
+  const core_message_type_enum fetch_block_transactions_message::type        = core_message_type_enum::fetch_block_transactions_message_type;
+  const core_message_type_enum block_transactions_message::type              = core_message_type_enum::block_transactions_message_type;
+  const core_message_type_enum state_snapshot_request_message::type          = core_message_type_enum::state_snapshot_request_message_type;
+  const core_message_type_enum state_snapshot_manifest_message::type         = core_message_type_enum::state_snapshot_manifest_message_type;
+  const core_message_type_enum fetch_state_snapshot_chunk_message::type      = core_message_type_enum::fetch_state_snapshot_chunk_message_type;
+  const core_message_type_enum state_snapshot_chunk_message::type            = core_message_type_enum::state_snapshot_chunk_message_type;
 
 } } // graphene::net
 
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#pragma once
+
+#include <graphene/net/config.hpp>
+#include <graphene/net/core_messages.hpp>
+#include <graphene/net/message.hpp>
+
+#include <fc/optional.hpp>
+
+#include <vector>
+
+namespace graphene { namespace net {
+
+  /// the item type to send in a fetch_items_message for a block_message_type item
+  inline uint32_t block_item_type_for_peer( uint32_t core_protocol_version )
+  {
+    return core_protocol_version >= GRAPHENE_NET_COMPACT_BLOCKS_PROTOCOL_VERSION ? (uint32_t)compact_block_message_type
+                                                                                  : (uint32_t)block_message_type;
+  }
+
+  /// the answer to a fetch_block_transactions_message, nothing if an index is outside the block
+  inline fc::optional<block_transactions_message> select_block_transactions( const item_hash_t& block_message_hash,
+                                                                            const signed_block& block,
+                                                                            const std::vector<uint32_t>& transaction_indices )
+  {
+    block_transactions_message reply( block_message_hash );
+    reply.transactions.reserve( transaction_indices.size() );
+    for( uint32_t transaction_index : transaction_indices )
+    {
+      if( transaction_index >= block.transactions.size() )
+        return fc::optional<block_transactions_message>();
+      reply.transactions.push_back( block.transactions[transaction_index] );
+    }
+    return fc::optional<block_transactions_message>( std::move( reply ) );
+  }
+
+  /**
+   * A block being rebuilt from a compact_block_message.  The transactions are filled in from
+   * what the receiver already holds, the rest are requested from the peer by their position in
+   * the block.  Transaction ids don't cover signatures, so the result has to be compared with
+   * the block_message that was requested before it is used.
+   */
+  class partial_compact_block
+  {
+    public:
+      partial_compact_block() {}
+      explicit partial_compact_block( const compact_block_message& compact_block )
+        : _transaction_ids( compact_block.transaction_ids )
+      {
+        static_cast<signed_block_header&>( _block ) = compact_block.header;
+        _block.transactions.resize( _transaction_ids.size() );
+        _missing_transaction_indices.reserve( _transaction_ids.size() );
+        for( uint32_t i = 0; i < _transaction_ids.size(); ++i )
+          _missing_transaction_indices.push_back( i );
+      }
+
+      /// lookup returns the transaction with the given id, or an empty optional if it is unknown
+      template<typename Lookup>
+      void look_up( const Lookup& lookup )
+      {
+        std::vector<fc::optional<signed_transaction>> known;
+        known.reserve( _missing_transaction_indices.size() );
+        for( uint32_t i : _missing_transaction_indices )
+          known.push_back( lookup( _transaction_ids[i] ) );
+        fill_in( known );
+      }
+
+      /// known holds the transactions found for missing_transaction_ids(), in the same order
+      void fill_in( const std::vector<fc::optional<signed_transaction>>& known )
+      {
+        std::vector<uint32_t> still_missing;
+        for( uint32_t j = 0; j < _missing_transaction_indices.size(); ++j )
+        {
+          const uint32_t i = _missing_transaction_indices[j];
+          if( j < known.size() && known[j] && known[j]->id() == _transaction_ids[i] )
+            _block.transactions[i] = *known[j];
+          else
+            still_missing.push_back( i );
+        }
+        _missing_transaction_indices = std::move( still_missing );
+      }
+
+      /// transactions answers a request for missing_transaction_indices(), false if it doesn't fit
+      bool add_missing_transactions( const std::vector<signed_transaction>& transactions )
+      {
+        if( transactions.size() != _missing_transaction_indices.size() )
+          return false;
+        for( size_t j = 0; j < transactions.size(); ++j )
+          _block.transactions[_missing_transaction_indices[j]] = transactions[j];
+        _missing_transaction_indices.clear();
+        return true;
+      }
+
+      const std::vector<uint32_t>& missing_transaction_indices()const { return _missing_transaction_indices; }
+      std::vector<transaction_id_type> missing_transaction_ids()const
+      {
+        std::vector<transaction_id_type> ids;
+        ids.reserve( _missing_transaction_indices.size() );
+        for( uint32_t i : _missing_transaction_indices )
+          ids.push_back( _transaction_ids[i] );
+        return ids;
+      }
+      bool complete()const { return _missing_transaction_indices.empty(); }
+
+      const signed_block& block()const { return _block; }
+      /// the rebuilt block as a message, nothing if it is not the block_message with the given hash
+      fc::optional<message> rebuilt_message( const item_hash_t& block_message_hash )const
+      {
+        message result = block_message( _block );
+        if( result.id() != block_message_hash )
+          return fc::optional<message>();
+        return fc::optional<message>( std::move( result ) );
+      }
+
+    private:
+      signed_block                     _block; ///< the transactions at _missing_transaction_indices are still empty
+      std::vector<transaction_id_type> _transaction_ids;
+      std::vector<uint32_t>            _missing_transaction_indices;
+  };
+
+} } // graphene::net
@@ -23,7 +23,36 @@
  */
 #pragma once
 
-#define GRAPHENE_NET_PROTOCOL_VERSION                        106
+#define GRAPHENE_NET_PROTOCOL_VERSION                        108
+
+/**
+ * Peers at or above this protocol version understand compact_block_message,
+ * fetch_block_transactions_message and block_transactions_message
+ */
+#define GRAPHENE_NET_COMPACT_BLOCKS_PROTOCOL_VERSION         107
+
+/**
+ * Peers at or above this protocol version answer state_snapshot_request_message
+ * and fetch_state_snapshot_chunk_message
+ */
+#define GRAPHENE_NET_STATE_SNAPSHOT_PROTOCOL_VERSION         108
+
+/**
+ * State snapshots are transferred in chunks of this size, each verified against
+ * its hash in the manifest.  A node downloads from every peer offering the same
+ * snapshot, with up to GRAPHENE_NET_STATE_SNAPSHOT_CHUNKS_PER_PEER requests
+ * outstanding per peer.  A peer that takes longer than the timeout to answer a
+ * chunk request is disconnected; if no peer offers a usable snapshot for the
+ * manifest timeout, the node gives up and syncs all blocks instead.
+ *
+ * The chunks a peer answers at once sit in its send queue together, so they
+ * must stay well below GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES or the
+ * peer disconnects us.
+ */
+#define GRAPHENE_NET_STATE_SNAPSHOT_CHUNK_SIZE               (256 * 1024)
+#define GRAPHENE_NET_STATE_SNAPSHOT_CHUNKS_PER_PEER          2
+#define GRAPHENE_NET_STATE_SNAPSHOT_CHUNK_TIMEOUT_SEC        30
+#define GRAPHENE_NET_STATE_SNAPSHOT_MANIFEST_TIMEOUT_SEC     60
 
 /**
  * Define this to enable debugging code in the p2p network interface.
@@ -57,6 +86,14 @@
 
 #define GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES        (1024 * 1024)
 
+/**
+ * Queued messages are sent to a peer in batches of about this many bytes,
+ * each batch is encrypted and written to the socket in one pass.  A single
+ * larger message is still sent on its own.  The send buffer is released after
+ * a batch that needed more than twice this size.
+ */
+#define GRAPHENE_NET_MAX_SEND_BATCH_SIZE_IN_BYTES            (64 * 1024)
+
 /**
  * When we receive a message from the network, we advertise it to
  * our peers and save a copy in a cache were we will find it if
@@ -79,7 +116,18 @@
 
 #define GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES           2
 
-#define GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING      200
+/**
+ * During sync, each peer is asked for a batch of blocks at a time.  The batch
+ * size starts at GRAPHENE_NET_INITIAL_BLOCKS_PER_PEER_DURING_SYNCING and is fitted
+ * to the peer after each batch, so that a batch takes about
+ * GRAPHENE_NET_SYNC_BATCH_TARGET_DURATION_MS (or four round trips, if longer).
+ * It stays between the minimum and the node's maximum_blocks_per_peer_during_syncing,
+ * which defaults to GRAPHENE_NET_MAX_SYNC_REQUEST_WINDOW.
+ */
+#define GRAPHENE_NET_INITIAL_BLOCKS_PER_PEER_DURING_SYNCING  200
+#define GRAPHENE_NET_MIN_BLOCKS_PER_PEER_DURING_SYNCING      10
+#define GRAPHENE_NET_MAX_SYNC_REQUEST_WINDOW                 1000
+#define GRAPHENE_NET_SYNC_BATCH_TARGET_DURATION_MS           500
 
 /**
  * During normal operation, how many items will be fetched from each
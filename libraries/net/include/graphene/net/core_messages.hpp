@@ -44,6 +44,7 @@ namespace graphene { namespace net {
   using muse::chain::block_id_type;
   using muse::chain::transaction_id_type;
   using muse::chain::signed_block;
+  using muse::chain::signed_block_header;
 
   typedef fc::ecc::public_key_data node_id_t;
   typedef fc::ripemd160 item_hash_t;
@@ -86,6 +87,13 @@ namespace graphene { namespace net {
     check_firewall_reply_message_type            = 5015,
     get_current_connections_request_message_type = 5016,
     get_current_connections_reply_message_type   = 5017,
+    compact_block_message_type                   = 5018,
+    fetch_block_transactions_message_type        = 5019,
+    block_transactions_message_type              = 5020,
+    state_snapshot_request_message_type          = 5021,
+    state_snapshot_manifest_message_type         = 5022,
+    fetch_state_snapshot_chunk_message_type      = 5023,
+    state_snapshot_chunk_message_type            = 5024,
     core_message_type_last                       = 5099
   };
 
@@ -398,6 +406,115 @@ namespace graphene { namespace net {
     std::vector<current_connection_data> current_connections;
   };
 
+  /**
+   * Sent instead of a block_message to peers that requested the block as a
+   * compact_block_message_type item.  The block is announced by its header and
+   * the ids of its transactions, the receiver takes the transactions from its
+   * message cache and its pending transactions and asks for the rest with a
+   * fetch_block_transactions_message.
+   */
+  struct compact_block_message
+  {
+    static const core_message_type_enum type;
+
+    compact_block_message() {}
+    compact_block_message(const item_hash_t& block_message_hash, const signed_block& blk) :
+      block_message_hash(block_message_hash),
+      header(blk)
+    {
+      transaction_ids.reserve(blk.transactions.size());
+      for (const signed_transaction& trx : blk.transactions)
+        transaction_ids.push_back(trx.id());
+    }
+
+    item_hash_t                      block_message_hash; /// hash of the full block_message, the item that was requested
+    signed_block_header              header;
+    std::vector<transaction_id_type> transaction_ids;
+  };
+
+  struct fetch_block_transactions_message
+  {
+    static const core_message_type_enum type;
+
+    item_hash_t           block_message_hash;
+    std::vector<uint32_t> transaction_indices; /// positions in the block of the transactions we are missing
+
+    fetch_block_transactions_message() {}
+    fetch_block_transactions_message(const item_hash_t& block_message_hash, const std::vector<uint32_t>& transaction_indices) :
+      block_message_hash(block_message_hash),
+      transaction_indices(transaction_indices)
+    {}
+  };
+
+  struct block_transactions_message
+  {
+    static const core_message_type_enum type;
+
+    item_hash_t                     block_message_hash;
+    std::vector<signed_transaction> transactions; /// in the order of the requested transaction_indices
+
+    block_transactions_message() {}
+    block_transactions_message(const item_hash_t& block_message_hash) :
+      block_message_hash(block_message_hash)
+    {}
+  };
+
+  /** Asks a peer which state snapshot it offers, answered by a state_snapshot_manifest_message */
+  struct state_snapshot_request_message
+  {
+    static const core_message_type_enum type;
+
+    state_snapshot_request_message() {}
+  };
+
+  /**
+   * Describes the state snapshot a peer offers: the snapshot file is split into
+   * chunks of chunk_size bytes, the last one may be shorter.  block_id is null
+   * if the peer has no snapshot.
+   */
+  struct state_snapshot_manifest_message
+  {
+    static const core_message_type_enum type;
+
+    block_id_type            block_id;
+    uint64_t                 size = 0;
+    fc::sha256               hash; /// of the whole snapshot file, what an operator pins with node::sync_from_state_snapshot()
+    uint32_t                 chunk_size = 0;
+    std::vector<fc::sha256>  chunk_hashes;
+
+    state_snapshot_manifest_message() {}
+  };
+
+  struct fetch_state_snapshot_chunk_message
+  {
+    static const core_message_type_enum type;
+
+    block_id_type block_id;
+    uint32_t      chunk_index = 0;
+
+    fetch_state_snapshot_chunk_message() {}
+    fetch_state_snapshot_chunk_message(const block_id_type& block_id, uint32_t chunk_index) :
+      block_id(block_id),
+      chunk_index(chunk_index)
+    {}
+  };
+
+  /** A chunk of a state snapshot, data is empty if the peer no longer has the snapshot */
+  struct state_snapshot_chunk_message
+  {
+    static const core_message_type_enum type;
+
+    block_id_type     block_id;
+    uint32_t          chunk_index = 0;
+    std::vector<char> data;
+
+    state_snapshot_chunk_message() {}
+    state_snapshot_chunk_message(const block_id_type& block_id, uint32_t chunk_index) :
+      block_id(block_id),
+      chunk_index(chunk_index)
+    {}
+  };
+
 
 } } // graphene::net
 
@@ -422,6 +539,13 @@ FC_REFLECT_ENUM( graphene::net::core_message_type_enum,
                  (check_firewall_reply_message_type)
                  (get_current_connections_request_message_type)
                  (get_current_connections_reply_message_type)
+                 (compact_block_message_type)
+                 (fetch_block_transactions_message_type)
+                 (block_transactions_message_type)
+                 (state_snapshot_request_message_type)
+                 (state_snapshot_manifest_message_type)
+                 (fetch_state_snapshot_chunk_message_type)
+                 (state_snapshot_chunk_message_type)
                  (core_message_type_last) )
 
 FC_REFLECT( graphene::net::trx_message, (trx) )
@@ -505,6 +629,13 @@ FC_REFLECT(graphene::net::get_current_connections_reply_message, (upload_rate_on
                                                             (upload_rate_one_hour)
                                                             (download_rate_one_hour)
                                                             (current_connections))
+FC_REFLECT(graphene::net::compact_block_message, (block_message_hash)(header)(transaction_ids))
+FC_REFLECT(graphene::net::fetch_block_transactions_message, (block_message_hash)(transaction_indices))
+FC_REFLECT(graphene::net::block_transactions_message, (block_message_hash)(transactions))
+FC_REFLECT_EMPTY(graphene::net::state_snapshot_request_message)
+FC_REFLECT(graphene::net::state_snapshot_manifest_message, (block_id)(size)(hash)(chunk_size)(chunk_hashes))
+FC_REFLECT(graphene::net::fetch_state_snapshot_chunk_message, (block_id)(chunk_index))
+FC_REFLECT(graphene::net::state_snapshot_chunk_message, (block_id)(chunk_index)(data))
 
 #include <unordered_map>
 #include <fc/crypto/city.hpp>
@@ -29,6 +29,8 @@
 
 #include <muse/chain/protocol/types.hpp>
 
+#include <fc/filesystem.hpp>
+
 #include <list>
 
 namespace graphene { namespace net {
@@ -80,6 +82,13 @@ namespace graphene { namespace net {
          virtual bool handle_block( const graphene::net::block_message& blk_msg, bool sync_mode,
                                     std::vector<fc::uint160_t>& contained_transaction_message_ids ) = 0;
 
+         /**
+          *  @brief Called from the p2p thread when a sync block is queued, before it is
+          *         passed to handle_block.  Lets the delegate start the stateless checks
+          *         of the block elsewhere, it must return without blocking.
+          */
+         virtual void prevalidate_block( const graphene::net::block_message& blk_msg ) = 0;
+
          /**
           *  @brief Called when a new transaction comes in from the network
           *
@@ -114,6 +123,13 @@ namespace graphene { namespace net {
           */
          virtual message get_item( const item_id& id ) = 0;
 
+         /**
+          *  Looks up the transactions we have among the pending and recent ones, e.g.
+          *  those of a compact block, in one call.
+          *  @return one entry per id, unset for the transactions we don't have
+          */
+         virtual std::vector<fc::optional<signed_transaction>> get_transactions(const std::vector<transaction_id_type>& ids) = 0;
+
          /**
           * Returns a synopsis of the blockchain used for syncing.
           * This consists of a list of selected item hashes from our current preferred
@@ -167,6 +183,26 @@ namespace graphene { namespace net {
 
          virtual void error_encountered(const std::string& message, const fc::oexception& error) = 0;
 
+         /**
+          *  Describes the state snapshot we offer to peers, the block_id of the result
+          *  is null if we have none.
+          */
+         virtual state_snapshot_manifest_message get_state_snapshot_manifest() = 0;
+
+         /**
+          *  Returns chunk chunk_index of the state snapshot at block_id.
+          *  @throws exception if we no longer offer that snapshot
+          */
+         virtual std::vector<char> get_state_snapshot_chunk(const block_id_type& block_id, uint32_t chunk_index) = 0;
+
+         /**
+          *  Called when a state snapshot requested with node::sync_from_state_snapshot() has been
+          *  downloaded to file and all chunks matched the manifest.  Replaces the state of the
+          *  blockchain by the snapshot, afterwards the node syncs the blocks following it.
+          *
+          *  @throws exception if the snapshot could not be loaded
+          */
+         virtual void load_state_snapshot(const fc::path& file, const block_id_type& block_id) = 0;
    };
 
    /**
@@ -270,6 +306,18 @@ namespace graphene { namespace net {
          */
         virtual void      sync_from(const item_id& current_head_block, const std::vector<uint32_t>& hard_fork_block_numbers);
 
+        /**
+         *  Before syncing any blocks, download the state snapshot offered by our peers and hand
+         *  it to the delegate's load_state_snapshot().  Only meaningful for a node without blocks,
+         *  must be called before connecting to the network.  If expected_block_id is given, only
+         *  a snapshot at that block is accepted.  Only a snapshot file with the sha256 hash
+         *  expected_hash is accepted, which must come from a source the operator trusts: the
+         *  chunk hashes only prove that the data matches the manifest of the same peer.  If no
+         *  peer offers a usable snapshot, all blocks are synced as usual.
+         */
+        void      sync_from_state_snapshot(const fc::optional<block_id_type>& expected_block_id,
+                                           const fc::sha256& expected_hash);
+
         bool      is_connected() const;
 
         void set_advanced_node_parameters(const fc::variant_object& params);
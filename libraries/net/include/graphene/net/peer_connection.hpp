@@ -28,6 +28,8 @@
 #include <graphene/net/message_oriented_connection.hpp>
 #include <graphene/net/stcp_socket.hpp>
 #include <graphene/net/config.hpp>
+#include <graphene/net/compact_block.hpp>
+#include <graphene/net/sync_request_window.hpp>
 
 #include <boost/tuple/tuple.hpp>
 
@@ -40,6 +42,8 @@
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 
+#include <list>
+#include <map>
 #include <queue>
 #include <boost/container/deque.hpp>
 #include <fc/thread/future.hpp>
@@ -167,7 +171,8 @@ namespace graphene { namespace net
 
 
       size_t _total_queued_messages_size = 0;
-      std::queue<std::unique_ptr<queued_message>, std::list<std::unique_ptr<queued_message> > > _queued_messages;
+      /// a list rather than a queue so the sending task can batch several messages from the front
+      std::list<std::unique_ptr<queued_message> > _queued_messages;
       fc::future<void> _send_queued_messages_done;
     public:
       fc::time_point connection_initiation_time;
@@ -232,6 +237,7 @@ namespace graphene { namespace net
       item_hash_t last_block_delegate_has_seen; /// the hash of the last block  this peer has told us about that the peer knows
       fc::time_point_sec last_block_time_delegate_has_seen;
       bool inhibit_fetching_sync_blocks = false;
+      sync_request_window sync_window; /// number of sync blocks we request from this peer at once, fitted to how fast it delivers them
       /// @}
 
       /// non-synchronization state data
@@ -255,6 +261,16 @@ namespace graphene { namespace net
       timestamped_items_set_type inventory_advertised_to_peer;
 
       item_to_time_map_type items_requested_from_peer;  /// items we've requested from this peer during normal operation.  fetch from another peer if this peer disconnects
+
+      std::map<item_hash_t, partial_compact_block> compact_blocks_awaiting_transactions; /// compact blocks from this peer whose missing transactions we've requested, by block_message hash
+      /// @}
+
+      /// state snapshot download, see node::sync_from_state_snapshot()
+      /// @{
+      bool state_snapshot_manifest_requested = false;
+      bool offers_state_snapshot = false; /// the peer offers the snapshot we're downloading
+      std::set<uint32_t> state_snapshot_chunks_requested;
+      fc::time_point last_state_snapshot_progress_time; /// when we last received a chunk, or requested one while none were outstanding
       /// @}
 
       // if they're flooding us with transactions, we set this to avoid fetching for a few seconds to let the
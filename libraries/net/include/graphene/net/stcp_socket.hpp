@@ -67,6 +67,9 @@ class stcp_socket : public fc::iostream
     fc::aes_encoder      _send_aes;
     fc::aes_decoder      _recv_aes;
     std::shared_ptr<char> _read_buffer;
+    std::shared_ptr<char> _plaintext_buffer; ///< decrypted bytes read ahead of the caller
+    size_t                _plaintext_begin = 0;
+    size_t                _plaintext_end = 0;
     std::shared_ptr<char> _write_buffer;
 #ifndef NDEBUG
     bool _read_buffer_in_use;
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/net/config.hpp>
+
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace graphene { namespace net {
+
+  /**
+   * The number of sync blocks we request from one peer at once.  A batch starts with the
+   * first request made while nothing is outstanding from the peer, requests made before it
+   * completes are added to it, and it completes when the last outstanding block arrives.
+   * The window is then moved halfway towards the number of blocks the peer could deliver in
+   * GRAPHENE_NET_SYNC_BATCH_TARGET_DURATION_MS, or in four round trips if that is longer.
+   */
+  class sync_request_window
+  {
+    public:
+      uint32_t size()const { return _size; }
+      uint32_t batch_size()const { return _batch_size; }
+      fc::time_point batch_request_time()const { return _batch_request_time; }
+
+      /// count items were requested at now, outstanding tells whether any were still on their way
+      void items_requested( uint32_t count, bool outstanding, fc::time_point now )
+      {
+        if( outstanding && _batch_size != 0 )
+        {
+          _batch_size += count;
+          return;
+        }
+        _batch_request_time = now;
+        _batch_size = count;
+      }
+
+      /// the last outstanding item arrived at now, returns how long the batch took
+      fc::microseconds batch_completed( fc::time_point now, fc::microseconds round_trip_delay, uint32_t maximum )
+      {
+        if( _batch_size == 0 )
+          return fc::microseconds();
+        fc::microseconds batch_duration = std::max( now - _batch_request_time, fc::microseconds(1000) );
+        fc::microseconds target_duration = std::max( fc::microseconds(GRAPHENE_NET_SYNC_BATCH_TARGET_DURATION_MS * 1000),
+                                                     fc::microseconds(round_trip_delay.count() * 4) );
+        uint64_t fitted_window = uint64_t(_batch_size) * target_duration.count() / batch_duration.count();
+        // a single slow or fast batch shouldn't swing the window
+        uint64_t window = (uint64_t(_size) + fitted_window) / 2;
+        window = std::min<uint64_t>( window, maximum );
+        window = std::max<uint64_t>( window, GRAPHENE_NET_MIN_BLOCKS_PER_PEER_DURING_SYNCING );
+        _size = (uint32_t)window;
+        _batch_size = 0;
+        return batch_duration;
+      }
+
+    private:
+      uint32_t       _size = GRAPHENE_NET_INITIAL_BLOCKS_PER_PEER_DURING_SYNCING;
+      uint32_t       _batch_size = 0; ///< 0 when no batch is being measured
+      fc::time_point _batch_request_time;
+  };
+
+} } // graphene::net
@@ -63,6 +63,7 @@ namespace graphene { namespace net {
       fc::time_point _last_message_sent_time;
 
       bool _send_message_in_progress;
+      std::vector<char> _send_buffer; ///< reused for the padded messages of every send
       std::atomic_bool readLoopInProgress;
 #ifndef NDEBUG
       fc::thread* _thread;
@@ -70,6 +71,8 @@ namespace graphene { namespace net {
 
       void read_loop();
       void start_read_loop();
+      size_t append_to_send_buffer(const message& message_to_send, size_t offset);
+      void send_messages(const message* messages_to_send, size_t count);
     public:
       fc::tcp_socket& get_socket();
       void accept();
@@ -81,6 +84,7 @@ namespace graphene { namespace net {
       ~message_oriented_connection_impl();
 
       void send_message(const message& message_to_send);
+      void send_messages(const std::vector<message>& messages_to_send);
       void close_connection();
       void destroy_connection();
 
@@ -246,6 +250,36 @@ namespace graphene { namespace net {
     }
 
     void message_oriented_connection_impl::send_message(const message& message_to_send)
+    {
+      send_messages(&message_to_send, 1);
+    }
+
+    void message_oriented_connection_impl::send_messages(const std::vector<message>& messages_to_send)
+    {
+      if (!messages_to_send.empty())
+        send_messages(messages_to_send.data(), messages_to_send.size());
+    }
+
+    size_t message_oriented_connection_impl::append_to_send_buffer(const message& message_to_send, size_t offset)
+    {
+      size_t size_of_message_and_header = sizeof(message_header) + message_to_send.size;
+      if( message_to_send.size > MAX_MESSAGE_SIZE )
+         elog("Trying to send a message larger than MAX_MESSAGE_SIZE. This probably won't work...");
+      //pad the message we send to a multiple of 16 bytes
+      size_t size_with_padding = 16 * ((size_of_message_and_header + 15) / 16);
+      if (_send_buffer.size() < offset + size_with_padding)
+        _send_buffer.resize(offset + size_with_padding);
+
+      char* padded_message = _send_buffer.data() + offset;
+      memcpy(padded_message, (char*)&message_to_send, sizeof(message_header));
+      memcpy(padded_message + sizeof(message_header), message_to_send.data.data(), message_to_send.size );
+      char* paddingSpace = padded_message + size_of_message_and_header;
+      size_t toClean = size_with_padding - size_of_message_and_header;
+      memset(paddingSpace, 0, toClean);
+      return offset + size_with_padding;
+    }
+
+    void message_oriented_connection_impl::send_messages(const message* messages_to_send, size_t count)
     {
       VERIFY_CORRECT_THREAD();
 #if 0 // this gets too verbose
@@ -274,23 +308,20 @@ namespace graphene { namespace net {
 
       try
       {
-        size_t size_of_message_and_header = sizeof(message_header) + message_to_send.size;
-        if( message_to_send.size > MAX_MESSAGE_SIZE )
-           elog("Trying to send a message larger than MAX_MESSAGE_SIZE. This probably won't work...");
-        //pad the message we send to a multiple of 16 bytes
-        size_t size_with_padding = 16 * ((size_of_message_and_header + 15) / 16);
-        std::unique_ptr<char[]> padded_message(new char[size_with_padding]);
-
-        memcpy(padded_message.get(), (char*)&message_to_send, sizeof(message_header));
-        memcpy(padded_message.get() + sizeof(message_header), message_to_send.data.data(), message_to_send.size );
-        char* paddingSpace = padded_message.get() + sizeof(message_header) + message_to_send.size;
-        size_t toClean = size_with_padding - size_of_message_and_header;
-        memset(paddingSpace, 0, toClean);
-
-        _sock.write(padded_message.get(), size_with_padding);
+        // pack all messages into one buffer so they are encrypted and written in one pass
+        size_t size_with_padding = 0;
+        for (size_t i = 0; i < count; ++i)
+          size_with_padding = append_to_send_buffer(messages_to_send[i], size_with_padding);
+
+        _sock.write(_send_buffer.data(), size_with_padding);
         _sock.flush();
         _bytes_sent += size_with_padding;
         _last_message_sent_time = fc::time_point::now();
+
+        // a full batch overshoots the batch size by up to one message, but don't hold on to the space
+        // of an unusually large message for the life of the connection
+        if (_send_buffer.size() > 2 * GRAPHENE_NET_MAX_SEND_BATCH_SIZE_IN_BYTES)
+          std::vector<char>().swap(_send_buffer);
       } FC_RETHROW_EXCEPTIONS( warn, "unable to send message" );
     }
 
@@ -395,6 +426,11 @@ namespace graphene { namespace net {
     my->send_message(message_to_send);
   }
 
+  void message_oriented_connection::send_messages(const std::vector<message>& messages_to_send)
+  {
+    my->send_messages(messages_to_send);
+  }
+
   void message_oriented_connection::close_connection()
   {
     my->close_connection();
@@ -30,6 +30,7 @@
 #include <iostream>
 #include <algorithm>
 #include <tuple>
+#include <fstream>
 #include <boost/tuple/tuple.hpp>
 #include <boost/circular_buffer.hpp>
 
@@ -175,6 +176,7 @@ namespace graphene { namespace net {
       void cache_message( const message& message_to_cache, const message_hash_type& hash_of_message_to_cache,
                         const message_propagation_data& propagation_data, const fc::uint160_t& message_content_hash );
       message get_message( const message_hash_type& hash_of_message_to_lookup );
+      signed_transaction get_transaction( const transaction_id_type& id_of_transaction_to_lookup ) const;
       message_propagation_data get_message_propagation_data( const fc::uint160_t& hash_of_message_contents_to_lookup ) const;
       size_t size() const { return _message_cache.size(); }
     };
@@ -208,6 +210,16 @@ namespace graphene { namespace net {
       FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested message not in cache" );
     }
 
+    signed_transaction blockchain_tied_message_cache::get_transaction( const transaction_id_type& id_of_transaction_to_lookup ) const
+    {
+      // transactions are cached with their id as the message contents hash
+      auto range = _message_cache.get<message_contents_hash_index>().equal_range( id_of_transaction_to_lookup );
+      for( auto iter = range.first; iter != range.second; ++iter )
+        if( iter->message_body.msg_type == trx_message_type )
+          return iter->message_body.as<trx_message>().trx;
+      FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested transaction not in cache" );
+    }
+
     message_propagation_data blockchain_tied_message_cache::get_message_propagation_data( const fc::uint160_t& hash_of_message_contents_to_lookup ) const
     {
       if( hash_of_message_contents_to_lookup != fc::uint160_t() )
@@ -290,6 +302,7 @@ namespace graphene { namespace net { namespace detail {
                                    (handle_transaction) \
                                    (get_block_ids) \
                                    (get_item) \
+                                   (get_transactions) \
                                    (get_blockchain_synopsis) \
                                    (sync_status) \
                                    (connection_count_changed) \
@@ -297,7 +310,10 @@ namespace graphene { namespace net { namespace detail {
                                    (get_block_time) \
                                    (get_head_block_id) \
                                    (estimate_last_known_fork_from_git_revision_timestamp) \
-                                   (error_encountered)
+                                   (error_encountered) \
+                                   (get_state_snapshot_manifest) \
+                                   (get_state_snapshot_chunk) \
+                                   (load_state_snapshot)
 
 
 #define DECLARE_ACCUMULATOR(r, data, method_name) \
@@ -381,11 +397,13 @@ namespace graphene { namespace net { namespace detail {
       bool has_item( const net::item_id& id ) override;
       void handle_message( const message& ) override;
       bool handle_block( const graphene::net::block_message& block_message, bool sync_mode, std::vector<fc::uint160_t>& contained_transaction_message_ids ) override;
+      void prevalidate_block( const graphene::net::block_message& block_message ) override;
       void handle_transaction( const graphene::net::trx_message& transaction_message ) override;
       std::vector<item_hash_t> get_block_ids(const std::vector<item_hash_t>& blockchain_synopsis,
                                              uint32_t& remaining_item_count,
                                              uint32_t limit = 2000) override;
       message get_item( const item_id& id ) override;
+      std::vector<fc::optional<signed_transaction>> get_transactions(const std::vector<transaction_id_type>& ids) override;
       std::vector<item_hash_t> get_blockchain_synopsis(const item_hash_t& reference_point,
                                                        uint32_t number_of_blocks_after_reference_point) override;
       void     sync_status( uint32_t item_type, uint32_t item_count ) override;
@@ -397,6 +415,9 @@ namespace graphene { namespace net { namespace detail {
       const fc::sha256& get_genesis_hash() const override;
       uint32_t estimate_last_known_fork_from_git_revision_timestamp(uint32_t unix_timestamp) const override;
       void error_encountered(const std::string& message, const fc::oexception& error) override;
+      state_snapshot_manifest_message get_state_snapshot_manifest() override;
+      std::vector<char> get_state_snapshot_chunk(const block_id_type& block_id, uint32_t chunk_index) override;
+      void load_state_snapshot(const fc::path& file, const block_id_type& block_id) override;
     };
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -445,12 +466,31 @@ namespace graphene { namespace net { namespace detail {
 
       active_sync_requests_map              _active_sync_requests; /// list of sync blocks we've asked for from peers but have not yet received
       std::list<graphene::net::block_message> _new_received_sync_items; /// list of sync blocks we've just received but haven't yet tried to process
-      std::list<graphene::net::block_message> _received_sync_items; /// list of sync blocks we've received, but can't yet process because we are still missing blocks that come earlier in the chain
+      std::unordered_map<graphene::net::block_id_type, graphene::net::block_message> _received_sync_items; /// sync blocks we've received, but can't yet process because we are still missing blocks that come earlier in the chain, by block id
       // @}
 
       fc::future<void> _process_backlog_of_sync_blocks_done;
       bool _suspend_fetching_sync_blocks;
 
+      /// used while downloading a state snapshot before syncing blocks, see node::sync_from_state_snapshot()
+      // @{
+      struct state_snapshot_download
+      {
+        fc::optional<block_id_type> expected_block_id;
+        fc::sha256 expected_hash;
+        fc::optional<state_snapshot_manifest_message> manifest; /// the snapshot we're downloading, from the first usable manifest we received
+        fc::path           file;
+        std::ofstream      stream;
+        std::vector<bool>  chunks_received;
+        uint32_t           number_of_chunks_received = 0;
+        std::set<uint32_t> chunks_requested; /// chunks requested from any peer that we haven't received yet
+        fc::time_point     last_progress_time; /// when we started, chose a manifest or last received a chunk
+
+        bool is_complete() const { return manifest && number_of_chunks_received == chunks_received.size(); }
+      };
+      std::unique_ptr<state_snapshot_download> _state_snapshot_download; /// null unless we're downloading a snapshot
+      // @}
+
       /// used by the task that fetches items during normal operation
       // @{
       fc::promise<void>::ptr _retrigger_fetch_item_loop_promise;
@@ -583,6 +623,7 @@ namespace graphene { namespace net { namespace detail {
       void trigger_p2p_network_connect_loop();
 
       bool have_already_received_sync_item( const item_hash_t& item_hash );
+      void update_sync_request_window( peer_connection* peer );
       void request_sync_item_from_peer( const peer_connection_ptr& peer, const item_hash_t& item_to_request );
       void request_sync_items_from_peer( const peer_connection_ptr& peer, const std::vector<item_hash_t>& items_to_request );
       void fetch_sync_items_loop();
@@ -647,6 +688,32 @@ namespace graphene { namespace net { namespace detail {
       void on_item_not_available_message( peer_connection* originating_peer,
                                           const item_not_available_message& item_not_available_message_received );
 
+      void on_compact_block_message( peer_connection* originating_peer,
+                                     const compact_block_message& compact_block_message_received );
+
+      void on_fetch_block_transactions_message( peer_connection* originating_peer,
+                                                const fetch_block_transactions_message& fetch_block_transactions_message_received );
+
+      void on_block_transactions_message( peer_connection* originating_peer,
+                                          const block_transactions_message& block_transactions_message_received );
+
+      void on_state_snapshot_request_message( peer_connection* originating_peer,
+                                              const state_snapshot_request_message& state_snapshot_request_message_received );
+
+      void on_state_snapshot_manifest_message( peer_connection* originating_peer,
+                                               const state_snapshot_manifest_message& state_snapshot_manifest_message_received );
+
+      void on_fetch_state_snapshot_chunk_message( peer_connection* originating_peer,
+                                                  const fetch_state_snapshot_chunk_message& fetch_state_snapshot_chunk_message_received );
+
+      void on_state_snapshot_chunk_message( peer_connection* originating_peer,
+                                            const state_snapshot_chunk_message& state_snapshot_chunk_message_received );
+
+      void request_state_snapshot_manifest(const peer_connection_ptr& peer);
+      void request_state_snapshot_chunks();
+      void finish_state_snapshot_download();
+      void abandon_state_snapshot_download();
+
       void on_item_ids_inventory_message( peer_connection* originating_peer,
                                           const item_ids_inventory_message& item_ids_inventory_message_received );
 
@@ -681,6 +748,8 @@ namespace graphene { namespace net { namespace detail {
       void process_block_during_sync(peer_connection* originating_peer, const graphene::net::block_message& block_message, const message_hash_type& message_hash);
       void process_block_during_normal_operation(peer_connection* originating_peer, const graphene::net::block_message& block_message, const message_hash_type& message_hash);
       void process_block_message(peer_connection* originating_peer, const message& message_to_process, const message_hash_type& message_hash);
+      void process_reconstructed_block(peer_connection* originating_peer, const partial_compact_block& reconstructed_block, const item_hash_t& block_message_hash);
+      fc::optional<graphene::net::block_message> get_block_message_for_item(const item_hash_t& block_message_hash);
 
       void process_ordinary_message(peer_connection* originating_peer, const message& message_to_process, const message_hash_type& message_hash);
 
@@ -732,6 +801,8 @@ namespace graphene { namespace net { namespace detail {
       void broadcast(const message& item_to_broadcast, const message_propagation_data& propagation_data);
       void broadcast(const message& item_to_broadcast);
       void sync_from(const item_id& current_head_block, const std::vector<uint32_t>& hard_fork_block_numbers);
+      void sync_from_state_snapshot(const fc::optional<block_id_type>& expected_block_id,
+                                    const fc::sha256& expected_hash);
       bool is_connected() const;
       std::vector<potential_peer_record> get_potential_peers() const;
       void set_advanced_node_parameters( const fc::variant_object& params );
@@ -820,7 +891,7 @@ namespace graphene { namespace net { namespace detail {
       _node_is_shutting_down(false),
       _maximum_number_of_blocks_to_handle_at_one_time(MAXIMUM_NUMBER_OF_BLOCKS_TO_HANDLE_AT_ONE_TIME),
       _maximum_number_of_sync_blocks_to_prefetch(MAXIMUM_NUMBER_OF_BLOCKS_TO_PREFETCH),
-      _maximum_blocks_per_peer_during_syncing(GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING)
+      _maximum_blocks_per_peer_during_syncing(GRAPHENE_NET_MAX_SYNC_REQUEST_WINDOW)
     {
       _rate_limiter.set_actual_rate_time_constant(fc::seconds(2));
       fc::rand_bytes(&_node_id.data[0], (int)_node_id.size());
@@ -989,10 +1060,9 @@ namespace graphene { namespace net { namespace detail {
     bool node_impl::have_already_received_sync_item( const item_hash_t& item_hash )
     {
       VERIFY_CORRECT_THREAD();
-      return std::find_if(_received_sync_items.begin(), _received_sync_items.end(),
-                          [&item_hash]( const graphene::net::block_message& message ) { return message.block_id == item_hash; } ) != _received_sync_items.end() ||
+      return _received_sync_items.find(item_hash) != _received_sync_items.end() ||
              std::find_if(_new_received_sync_items.begin(), _new_received_sync_items.end(),
-                          [&item_hash]( const graphene::net::block_message& message ) { return message.block_id == item_hash; } ) != _new_received_sync_items.end();                          ;
+                          [&item_hash]( const graphene::net::block_message& message ) { return message.block_id == item_hash; } ) != _new_received_sync_items.end();
     }
 
     void node_impl::request_sync_item_from_peer( const peer_connection_ptr& peer, const item_hash_t& item_to_request )
@@ -1002,6 +1072,7 @@ namespace graphene { namespace net { namespace detail {
       item_id item_id_to_request( graphene::net::block_message_type, item_to_request );
       _active_sync_requests.insert( active_sync_requests_map::value_type(item_to_request, fc::time_point::now() ) );
       peer->last_sync_item_received_time = fc::time_point::now();
+      peer->sync_window.items_requested(1, !peer->sync_items_requested_from_peer.empty(), fc::time_point::now());
       peer->sync_items_requested_from_peer.insert(item_to_request);
       peer->send_message( fetch_items_message(item_id_to_request.item_type, std::vector<item_hash_t>{item_id_to_request.item_hash} ) );
     }
@@ -1011,6 +1082,7 @@ namespace graphene { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
       dlog( "requesting ${item_count} item(s) ${items_to_request} from peer ${endpoint}",
             ("item_count", items_to_request.size())("items_to_request", items_to_request)("endpoint", peer->get_remote_endpoint()) );
+      peer->sync_window.items_requested(items_to_request.size(), !peer->sync_items_requested_from_peer.empty(), fc::time_point::now());
       for (const item_hash_t& item_to_request : items_to_request)
       {
         _active_sync_requests.insert( active_sync_requests_map::value_type(item_to_request, fc::time_point::now() ) );
@@ -1020,6 +1092,22 @@ namespace graphene { namespace net { namespace detail {
       peer->send_message(fetch_items_message(graphene::net::block_message_type, items_to_request));
     }
 
+    void node_impl::update_sync_request_window( peer_connection* peer )
+    {
+      VERIFY_CORRECT_THREAD();
+      uint32_t batch_size = peer->sync_window.batch_size();
+      if (batch_size == 0)
+        return;
+      // size the next batch so that it takes about GRAPHENE_NET_SYNC_BATCH_TARGET_DURATION_MS, or a few round
+      // trips if that is longer.  Fast peers get more blocks at once, slow peers hold back fewer of them
+      uint32_t old_window = peer->sync_window.size();
+      fc::microseconds batch_duration = peer->sync_window.batch_completed(fc::time_point::now(), peer->round_trip_delay,
+                                                                          _maximum_blocks_per_peer_during_syncing);
+      dlog("peer ${endpoint} delivered ${count} sync blocks in ${duration}us, request window ${old} -> ${new}",
+           ("endpoint", peer->get_remote_endpoint())("count", batch_size)("duration", batch_duration.count())
+           ("old", old_window)("new", peer->sync_window.size()));
+    }
+
     void node_impl::fetch_sync_items_loop()
     {
       VERIFY_CORRECT_THREAD();
@@ -1057,7 +1145,7 @@ namespace graphene { namespace net { namespace detail {
                       // then schedule a request from this peer
                       sync_item_requests_to_send[peer].push_back(item_to_potentially_request);
                       sync_items_to_request.insert( item_to_potentially_request );
-                      if (sync_item_requests_to_send[peer].size() >= _maximum_blocks_per_peer_during_syncing)
+                      if (sync_item_requests_to_send[peer].size() >= std::min<uint32_t>(peer->sync_window.size(), _maximum_blocks_per_peer_during_syncing))
                         break;
                     }
                   }
@@ -1196,7 +1284,12 @@ namespace graphene { namespace net { namespace detail {
                  ("count", items_by_type.second.size())("type", (uint32_t)items_by_type.first)
                  ("endpoint", peer_and_items.peer->get_remote_endpoint())
                  ("hashes", items_by_type.second));
-            peer_and_items.peer->send_message(fetch_items_message(items_by_type.first,
+            // peers that know compact blocks send the header and transaction ids instead of the full block,
+            // the request is still tracked as a block_message_type item in items_requested_from_peer
+            uint32_t item_type_to_request = items_by_type.first;
+            if (item_type_to_request == graphene::net::block_message_type)
+              item_type_to_request = block_item_type_for_peer(peer_and_items.peer->core_protocol_version);
+            peer_and_items.peer->send_message(fetch_items_message(item_type_to_request,
                                                                   items_by_type.second));
           }
         }
@@ -1395,6 +1488,14 @@ namespace graphene { namespace net { namespace detail {
                       ("synopsis", active_peer->item_ids_requested_from_peer->get<0>()));
                 disconnect_due_to_request_timeout = true;
               }
+            if (!disconnect_due_to_request_timeout &&
+                !active_peer->state_snapshot_chunks_requested.empty() &&
+                active_peer->last_state_snapshot_progress_time < fc::time_point::now() - fc::seconds(GRAPHENE_NET_STATE_SNAPSHOT_CHUNK_TIMEOUT_SEC))
+            {
+              wlog("Disconnecting peer ${peer} because they haven't made any progress on my remaining ${count} state snapshot chunk requests",
+                   ("peer", active_peer->get_remote_endpoint())("count", active_peer->state_snapshot_chunks_requested.size()));
+              disconnect_due_to_request_timeout = true;
+            }
             if (!disconnect_due_to_request_timeout)
               for (const peer_connection::item_to_time_map_type::value_type& item_and_time : active_peer->items_requested_from_peer)
                 if (item_and_time.second < active_ignored_request_threshold)
@@ -1419,6 +1520,7 @@ namespace graphene { namespace net { namespace detail {
               peers_to_send_keep_alive.push_back(active_peer);
             }
             else if (active_peer->we_need_sync_items_from_peer &&
+                     !_state_snapshot_download &&
                      !active_peer->is_currently_handling_message() &&
                      !active_peer->item_ids_requested_from_peer &&
                      active_peer->ids_of_items_to_get.empty())
@@ -1497,6 +1599,15 @@ namespace graphene { namespace net { namespace detail {
                            offsetof(current_time_request_message, request_sent_time));
       peers_to_send_keep_alive.clear();
 
+      // give up on a state snapshot no peer is serving us, and sync all blocks instead
+      if (_state_snapshot_download && !_state_snapshot_download->is_complete() &&
+          _state_snapshot_download->last_progress_time < fc::time_point::now() - fc::seconds(GRAPHENE_NET_STATE_SNAPSHOT_MANIFEST_TIMEOUT_SEC))
+      {
+        wlog("No progress downloading a state snapshot in ${timeout} seconds, syncing all blocks instead",
+             ("timeout", GRAPHENE_NET_STATE_SNAPSHOT_MANIFEST_TIMEOUT_SEC));
+        abandon_state_snapshot_download();
+      }
+
       if (!_node_is_shutting_down && !_terminate_inactive_connections_loop_done.canceled())
          _terminate_inactive_connections_loop_done = fc::schedule( [this](){ terminate_inactive_connections_loop(); },
                                                                    fc::time_point::now() + fc::seconds(GRAPHENE_NET_PEER_HANDSHAKE_INACTIVITY_TIMEOUT / 2),
@@ -1798,6 +1909,27 @@ namespace graphene { namespace net { namespace detail {
       case core_message_type_enum::block_message_type:
         process_block_message(originating_peer, received_message, message_hash);
         break;
+      case core_message_type_enum::compact_block_message_type:
+        on_compact_block_message(originating_peer, received_message.as<compact_block_message>());
+        break;
+      case core_message_type_enum::fetch_block_transactions_message_type:
+        on_fetch_block_transactions_message(originating_peer, received_message.as<fetch_block_transactions_message>());
+        break;
+      case core_message_type_enum::block_transactions_message_type:
+        on_block_transactions_message(originating_peer, received_message.as<block_transactions_message>());
+        break;
+      case core_message_type_enum::state_snapshot_request_message_type:
+        on_state_snapshot_request_message(originating_peer, received_message.as<state_snapshot_request_message>());
+        break;
+      case core_message_type_enum::state_snapshot_manifest_message_type:
+        on_state_snapshot_manifest_message(originating_peer, received_message.as<state_snapshot_manifest_message>());
+        break;
+      case core_message_type_enum::fetch_state_snapshot_chunk_message_type:
+        on_fetch_state_snapshot_chunk_message(originating_peer, received_message.as<fetch_state_snapshot_chunk_message>());
+        break;
+      case core_message_type_enum::state_snapshot_chunk_message_type:
+        on_state_snapshot_chunk_message(originating_peer, received_message.as<state_snapshot_chunk_message>());
+        break;
       case core_message_type_enum::current_time_request_message_type:
         on_current_time_request_message(originating_peer, received_message.as<current_time_request_message>());
         break;
@@ -2763,6 +2895,23 @@ namespace graphene { namespace net { namespace detail {
            ("type", fetch_items_message_received.item_type)
            ("endpoint", originating_peer->get_remote_endpoint()));
 
+      if (fetch_items_message_received.item_type == compact_block_message_type)
+      {
+        for (const item_hash_t& item_hash : fetch_items_message_received.items_to_fetch)
+        {
+          fc::optional<graphene::net::block_message> block = get_block_message_for_item(item_hash);
+          if (block)
+          {
+            originating_peer->last_block_delegate_has_seen = block->block_id;
+            originating_peer->last_block_time_delegate_has_seen = block->block.timestamp;
+            originating_peer->send_message(compact_block_message(item_hash, block->block));
+          }
+          else
+            originating_peer->send_message(item_not_available_message(item_id(block_message_type, item_hash)));
+        }
+        return;
+      }
+
       fc::optional<message> last_block_message_sent;
 
       std::list<message> reply_messages;
@@ -2831,6 +2980,7 @@ namespace graphene { namespace net { namespace detail {
       {
         originating_peer->items_requested_from_peer.erase( regular_item_iter );
         originating_peer->inventory_peer_advertised_to_us.erase( requested_item );
+        originating_peer->compact_blocks_awaiting_transactions.erase( requested_item.item_hash );
         if (is_item_in_any_peers_inventory(requested_item))
           _items_to_fetch.insert(prioritized_item_id(requested_item, _items_to_fetch_sequence_counter++));
         wlog("Peer doesn't have the requested item.");
@@ -2857,6 +3007,449 @@ namespace graphene { namespace net { namespace detail {
       dlog("Peer doesn't have an item we're looking for, which is fine because we weren't looking for it");
     }
 
+    fc::optional<graphene::net::block_message> node_impl::get_block_message_for_item(const item_hash_t& block_message_hash)
+    {
+      try
+      {
+        message cached_message = _message_cache.get_message(block_message_hash);
+        if (cached_message.msg_type == block_message_type)
+          return fc::optional<graphene::net::block_message>(cached_message.as<graphene::net::block_message>());
+      }
+      catch (fc::key_not_found_exception&)
+      {}
+      try
+      {
+        message delegate_message = _delegate->get_item(item_id(block_message_type, block_message_hash));
+        if (delegate_message.msg_type == block_message_type)
+          return fc::optional<graphene::net::block_message>(delegate_message.as<graphene::net::block_message>());
+      }
+      catch (const fc::canceled_exception&)
+      {
+        throw;
+      }
+      catch (const fc::exception&)
+      {}
+      return fc::optional<graphene::net::block_message>();
+    }
+
+    void node_impl::on_compact_block_message(peer_connection* originating_peer, const compact_block_message& compact_block_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      const item_hash_t& block_message_hash = compact_block_message_received.block_message_hash;
+      if (originating_peer->items_requested_from_peer.find(item_id(block_message_type, block_message_hash)) == originating_peer->items_requested_from_peer.end())
+      {
+        wlog("received a compact block I didn't ask for from peer ${endpoint}, disconnecting from peer",
+             ("endpoint", originating_peer->get_remote_endpoint()));
+        fc::exception detailed_error(FC_LOG_MESSAGE(error, "You sent me a compact block that I didn't ask for, block_message_hash: ${hash}",
+                                                    ("hash", block_message_hash)));
+        disconnect_from_peer(originating_peer, "You sent me a compact block that I didn't request", true, detailed_error);
+        return;
+      }
+
+      // fill in the transactions we already have, either because a peer relayed them to us
+      // or because they are pending in our client
+      partial_compact_block partial_block(compact_block_message_received);
+      partial_block.look_up([this](const transaction_id_type& transaction_id) {
+        try
+        {
+          return fc::optional<signed_transaction>(_message_cache.get_transaction(transaction_id));
+        }
+        catch (fc::key_not_found_exception&)
+        {
+          return fc::optional<signed_transaction>();
+        }
+      });
+
+      // ask the client for all the others at once
+      if (!partial_block.complete())
+      {
+        try
+        {
+          partial_block.fill_in(_delegate->get_transactions(partial_block.missing_transaction_ids()));
+        }
+        catch (const fc::canceled_exception&)
+        {
+          throw;
+        }
+        catch (const fc::exception& e)
+        {
+          wlog("error looking up the transactions of compact block ${id}: ${e}",
+               ("id", compact_block_message_received.header.id())("e", e.to_detail_string()));
+        }
+      }
+
+      if (partial_block.complete())
+      {
+        process_reconstructed_block(originating_peer, partial_block, block_message_hash);
+        return;
+      }
+
+      dlog("compact block ${id} from peer ${endpoint} is missing ${missing} of ${count} transactions, requesting them",
+           ("id", compact_block_message_received.header.id())("endpoint", originating_peer->get_remote_endpoint())
+           ("missing", partial_block.missing_transaction_indices().size())("count", compact_block_message_received.transaction_ids.size()));
+      originating_peer->send_message(fetch_block_transactions_message(block_message_hash, partial_block.missing_transaction_indices()));
+      originating_peer->compact_blocks_awaiting_transactions[block_message_hash] = std::move(partial_block);
+    }
+
+    void node_impl::on_fetch_block_transactions_message(peer_connection* originating_peer, const fetch_block_transactions_message& fetch_block_transactions_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      const item_hash_t& block_message_hash = fetch_block_transactions_message_received.block_message_hash;
+      fc::optional<graphene::net::block_message> block = get_block_message_for_item(block_message_hash);
+      if (!block)
+      {
+        originating_peer->send_message(item_not_available_message(item_id(block_message_type, block_message_hash)));
+        return;
+      }
+
+      fc::optional<block_transactions_message> reply = select_block_transactions(block_message_hash, block->block,
+                                                                                 fetch_block_transactions_message_received.transaction_indices);
+      if (!reply)
+      {
+        wlog("peer ${endpoint} requested a transaction beyond the ${count} transactions of a block, disconnecting from peer",
+             ("endpoint", originating_peer->get_remote_endpoint())("count", block->block.transactions.size()));
+        disconnect_from_peer(originating_peer, "You requested a transaction that is not in the block");
+        return;
+      }
+      originating_peer->send_message(*reply);
+    }
+
+    void node_impl::on_block_transactions_message(peer_connection* originating_peer, const block_transactions_message& block_transactions_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      const item_hash_t& block_message_hash = block_transactions_message_received.block_message_hash;
+      auto partial_block_iter = originating_peer->compact_blocks_awaiting_transactions.find(block_message_hash);
+      if (partial_block_iter == originating_peer->compact_blocks_awaiting_transactions.end())
+      {
+        dlog("received transactions for a compact block we are not reconstructing, ignoring them");
+        return;
+      }
+
+      partial_compact_block partial_block = std::move(partial_block_iter->second);
+      originating_peer->compact_blocks_awaiting_transactions.erase(partial_block_iter);
+      const size_t missing = partial_block.missing_transaction_indices().size();
+      if (!partial_block.add_missing_transactions(block_transactions_message_received.transactions))
+      {
+        wlog("peer ${endpoint} sent ${count} transactions for a compact block, we asked for ${missing}, fetching the full block",
+             ("endpoint", originating_peer->get_remote_endpoint())
+             ("count", block_transactions_message_received.transactions.size())("missing", missing));
+        originating_peer->send_message(fetch_items_message(block_message_type, std::vector<item_hash_t>{block_message_hash}));
+        return;
+      }
+      process_reconstructed_block(originating_peer, partial_block, block_message_hash);
+    }
+
+    void node_impl::process_reconstructed_block(peer_connection* originating_peer, const partial_compact_block& reconstructed_block, const item_hash_t& block_message_hash)
+    {
+      VERIFY_CORRECT_THREAD();
+      fc::optional<message> block_message_to_process = reconstructed_block.rebuilt_message(block_message_hash);
+      if (!block_message_to_process)
+      {
+        // transaction ids don't cover signatures, so a transaction we hold may differ from the one in the block.
+        // fall back to fetching the full block, the request is still in items_requested_from_peer
+        wlog("compact block ${id} from peer ${endpoint} did not reconstruct to the requested block, fetching the full block",
+             ("id", reconstructed_block.block().id())("endpoint", originating_peer->get_remote_endpoint()));
+        originating_peer->send_message(fetch_items_message(block_message_type, std::vector<item_hash_t>{block_message_hash}));
+        return;
+      }
+      process_block_message(originating_peer, *block_message_to_process, block_message_hash);
+    }
+
+    void node_impl::on_state_snapshot_request_message(peer_connection* originating_peer, const state_snapshot_request_message& state_snapshot_request_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      state_snapshot_manifest_message reply;
+      try
+      {
+        reply = _delegate->get_state_snapshot_manifest();
+      }
+      catch (const fc::exception& e)
+      {
+        wlog("Unable to describe our state snapshot to peer ${endpoint}, offering none: ${e}",
+             ("endpoint", originating_peer->get_remote_endpoint())("e", e));
+        reply = state_snapshot_manifest_message();
+      }
+      originating_peer->send_message(reply);
+    }
+
+    void node_impl::on_state_snapshot_manifest_message(peer_connection* originating_peer, const state_snapshot_manifest_message& state_snapshot_manifest_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      const state_snapshot_manifest_message& manifest = state_snapshot_manifest_message_received;
+      if (!originating_peer->state_snapshot_manifest_requested)
+      {
+        wlog("received a state snapshot manifest I didn't ask for from peer ${endpoint}, disconnecting from peer",
+             ("endpoint", originating_peer->get_remote_endpoint()));
+        fc::exception detailed_error(FC_LOG_MESSAGE(error, "You sent me a state snapshot manifest that I didn't ask for, block_id: ${id}",
+                                                    ("id", manifest.block_id)));
+        disconnect_from_peer(originating_peer, "You sent me a state snapshot manifest that I didn't request", true, detailed_error);
+        return;
+      }
+      originating_peer->state_snapshot_manifest_requested = false;
+
+      if (!_state_snapshot_download || _state_snapshot_download->is_complete())
+        return;
+      if (manifest.block_id == block_id_type())
+      {
+        dlog("peer ${endpoint} doesn't offer a state snapshot", ("endpoint", originating_peer->get_remote_endpoint()));
+        return;
+      }
+
+      const uint64_t number_of_chunks = manifest.chunk_size ? (manifest.size + manifest.chunk_size - 1) / manifest.chunk_size : 0;
+      if (manifest.size == 0 ||
+          manifest.chunk_size == 0 ||
+          manifest.chunk_size > GRAPHENE_NET_STATE_SNAPSHOT_CHUNK_SIZE ||
+          manifest.chunk_hashes.size() != number_of_chunks)
+      {
+        wlog("peer ${endpoint} sent an invalid state snapshot manifest, size: ${size}, chunk_size: ${chunk_size}, chunks: ${count}",
+             ("endpoint", originating_peer->get_remote_endpoint())
+             ("size", manifest.size)("chunk_size", manifest.chunk_size)("count", manifest.chunk_hashes.size()));
+        disconnect_from_peer(originating_peer, "You sent me an invalid state snapshot manifest");
+        return;
+      }
+
+      state_snapshot_download& download = *_state_snapshot_download;
+      if (download.expected_block_id && *download.expected_block_id != manifest.block_id)
+      {
+        dlog("peer ${endpoint} offers a state snapshot at block ${id}, we're only accepting block ${expected}",
+             ("endpoint", originating_peer->get_remote_endpoint())("id", manifest.block_id)("expected", *download.expected_block_id));
+        return;
+      }
+      if (download.expected_hash != manifest.hash)
+      {
+        dlog("peer ${endpoint} offers a state snapshot with hash ${hash}, we're only accepting ${expected}",
+             ("endpoint", originating_peer->get_remote_endpoint())("hash", manifest.hash)("expected", download.expected_hash));
+        return;
+      }
+
+      if (!download.manifest)
+      {
+        ilog("Downloading the state snapshot at block ${id}, ${size} bytes in ${count} chunks, offered by peer ${endpoint}",
+             ("id", manifest.block_id)("size", manifest.size)("count", number_of_chunks)("endpoint", originating_peer->get_remote_endpoint()));
+        download.stream.open(download.file.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!download.stream)
+        {
+          elog("Unable to create ${file} for the state snapshot, syncing all blocks instead", ("file", download.file));
+          abandon_state_snapshot_download();
+          return;
+        }
+        download.manifest = manifest;
+        download.chunks_received.assign(number_of_chunks, false);
+        download.last_progress_time = fc::time_point::now();
+      }
+
+      if (download.manifest->block_id != manifest.block_id ||
+          download.manifest->size != manifest.size ||
+          download.manifest->hash != manifest.hash ||
+          download.manifest->chunk_size != manifest.chunk_size ||
+          download.manifest->chunk_hashes != manifest.chunk_hashes)
+      {
+        dlog("peer ${endpoint} offers a different state snapshot at block ${id}, not downloading from them",
+             ("endpoint", originating_peer->get_remote_endpoint())("id", manifest.block_id));
+        return;
+      }
+
+      originating_peer->offers_state_snapshot = true;
+      request_state_snapshot_chunks();
+    }
+
+    void node_impl::on_fetch_state_snapshot_chunk_message(peer_connection* originating_peer, const fetch_state_snapshot_chunk_message& fetch_state_snapshot_chunk_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      state_snapshot_chunk_message reply(fetch_state_snapshot_chunk_message_received.block_id,
+                                         fetch_state_snapshot_chunk_message_received.chunk_index);
+      try
+      {
+        reply.data = _delegate->get_state_snapshot_chunk(fetch_state_snapshot_chunk_message_received.block_id,
+                                                         fetch_state_snapshot_chunk_message_received.chunk_index);
+      }
+      catch (const fc::exception& e)
+      {
+        dlog("Unable to send chunk ${index} of the state snapshot at block ${id} to peer ${endpoint}: ${e}",
+             ("index", fetch_state_snapshot_chunk_message_received.chunk_index)
+             ("id", fetch_state_snapshot_chunk_message_received.block_id)
+             ("endpoint", originating_peer->get_remote_endpoint())("e", e));
+        reply.data.clear();
+      }
+      originating_peer->send_message(reply);
+    }
+
+    void node_impl::on_state_snapshot_chunk_message(peer_connection* originating_peer, const state_snapshot_chunk_message& state_snapshot_chunk_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      const uint32_t chunk_index = state_snapshot_chunk_message_received.chunk_index;
+      if (!originating_peer->state_snapshot_chunks_requested.erase(chunk_index))
+      {
+        dlog("received state snapshot chunk ${index} we didn't request from peer ${endpoint}, ignoring it",
+             ("index", chunk_index)("endpoint", originating_peer->get_remote_endpoint()));
+        return;
+      }
+      originating_peer->last_state_snapshot_progress_time = fc::time_point::now();
+      if (!_state_snapshot_download || !_state_snapshot_download->manifest)
+        return;
+      state_snapshot_download& download = *_state_snapshot_download;
+      download.chunks_requested.erase(chunk_index);
+
+      if (state_snapshot_chunk_message_received.data.empty())
+      {
+        dlog("peer ${endpoint} no longer offers the state snapshot", ("endpoint", originating_peer->get_remote_endpoint()));
+        for (uint32_t requested_chunk_index : originating_peer->state_snapshot_chunks_requested)
+          download.chunks_requested.erase(requested_chunk_index);
+        originating_peer->state_snapshot_chunks_requested.clear();
+        originating_peer->offers_state_snapshot = false;
+        request_state_snapshot_chunks();
+        return;
+      }
+
+      const state_snapshot_manifest_message& manifest = *download.manifest;
+      const uint64_t chunk_offset = uint64_t(chunk_index) * manifest.chunk_size;
+      const uint64_t expected_length = std::min<uint64_t>(manifest.chunk_size, manifest.size - chunk_offset);
+      if (state_snapshot_chunk_message_received.block_id != manifest.block_id ||
+          state_snapshot_chunk_message_received.data.size() != expected_length ||
+          fc::sha256::hash(state_snapshot_chunk_message_received.data.data(), state_snapshot_chunk_message_received.data.size()) != manifest.chunk_hashes[chunk_index])
+      {
+        wlog("peer ${endpoint} sent state snapshot chunk ${index} that doesn't match the manifest, disconnecting from peer",
+             ("endpoint", originating_peer->get_remote_endpoint())("index", chunk_index));
+        originating_peer->offers_state_snapshot = false;
+        disconnect_from_peer(originating_peer, "You sent me a state snapshot chunk that doesn't match your manifest");
+        request_state_snapshot_chunks();
+        return;
+      }
+
+      if (!download.chunks_received[chunk_index])
+      {
+        download.stream.seekp(chunk_offset);
+        download.stream.write(state_snapshot_chunk_message_received.data.data(), state_snapshot_chunk_message_received.data.size());
+        if (!download.stream)
+        {
+          elog("Unable to write the state snapshot to ${file}, syncing all blocks instead", ("file", download.file));
+          abandon_state_snapshot_download();
+          return;
+        }
+        download.chunks_received[chunk_index] = true;
+        ++download.number_of_chunks_received;
+        download.last_progress_time = fc::time_point::now();
+        if (download.number_of_chunks_received % 100 == 0)
+          ilog("Received ${received} of ${count} state snapshot chunks",
+               ("received", download.number_of_chunks_received)("count", download.chunks_received.size()));
+      }
+
+      if (download.is_complete())
+        finish_state_snapshot_download();
+      else
+        request_state_snapshot_chunks();
+    }
+
+    void node_impl::request_state_snapshot_manifest(const peer_connection_ptr& peer)
+    {
+      VERIFY_CORRECT_THREAD();
+      if (peer->core_protocol_version < GRAPHENE_NET_STATE_SNAPSHOT_PROTOCOL_VERSION ||
+          peer->state_snapshot_manifest_requested)
+        return;
+      peer->state_snapshot_manifest_requested = true;
+      peer->send_message(state_snapshot_request_message());
+    }
+
+    void node_impl::request_state_snapshot_chunks()
+    {
+      VERIFY_CORRECT_THREAD();
+      static_assert(GRAPHENE_NET_STATE_SNAPSHOT_CHUNK_SIZE * GRAPHENE_NET_STATE_SNAPSHOT_CHUNKS_PER_PEER <= GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES / 2,
+                    "the chunks requested from a peer must fit in its send queue next to its other messages");
+      if (!_state_snapshot_download || !_state_snapshot_download->manifest)
+        return;
+      state_snapshot_download& download = *_state_snapshot_download;
+      const block_id_type block_id = download.manifest->block_id;
+
+      // hand out the chunks in order, so that a slow peer holds up as little as possible
+      uint32_t next_chunk_index = 0;
+      for (const peer_connection_ptr& peer : _active_connections)
+      {
+        if (!peer->offers_state_snapshot)
+          continue;
+        while (peer->state_snapshot_chunks_requested.size() < GRAPHENE_NET_STATE_SNAPSHOT_CHUNKS_PER_PEER)
+        {
+          while (next_chunk_index < download.chunks_received.size() &&
+                 (download.chunks_received[next_chunk_index] || download.chunks_requested.count(next_chunk_index)))
+            ++next_chunk_index;
+          if (next_chunk_index >= download.chunks_received.size())
+            return;
+          if (peer->state_snapshot_chunks_requested.empty())
+            peer->last_state_snapshot_progress_time = fc::time_point::now();
+          peer->state_snapshot_chunks_requested.insert(next_chunk_index);
+          download.chunks_requested.insert(next_chunk_index);
+          peer->send_message(fetch_state_snapshot_chunk_message(block_id, next_chunk_index));
+        }
+      }
+    }
+
+    void node_impl::finish_state_snapshot_download()
+    {
+      VERIFY_CORRECT_THREAD();
+      const block_id_type block_id = _state_snapshot_download->manifest->block_id;
+      const fc::path file = _state_snapshot_download->file;
+      _state_snapshot_download->stream.close();
+      ilog("Downloaded the state snapshot at block ${id}, loading it", ("id", block_id));
+      try
+      {
+        // the chunks matched the manifest, the file must match the hash the manifest was accepted for
+        fc::sha256::encoder enc;
+        std::ifstream in(file.string().c_str(), std::ios::in | std::ios::binary);
+        std::vector<char> buffer(GRAPHENE_NET_STATE_SNAPSHOT_CHUNK_SIZE);
+        while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0)
+          enc.write(buffer.data(), in.gcount());
+        FC_ASSERT(in.eof(), "Unable to read the downloaded state snapshot ${file}", ("file", file));
+        const fc::sha256 hash = enc.result();
+        FC_ASSERT(hash == _state_snapshot_download->manifest->hash, "the state snapshot has hash ${hash}, the manifest promised ${expected}",
+                  ("hash", hash)("expected", _state_snapshot_download->manifest->hash));
+        _delegate->load_state_snapshot(file, block_id);
+      }
+      catch (const fc::exception& e)
+      {
+        elog("Unable to load the state snapshot at block ${id}, syncing all blocks instead: ${e}", ("id", block_id)("e", e));
+        abandon_state_snapshot_download();
+        return;
+      }
+      ilog("Loaded the state snapshot at block ${id}, syncing the blocks following it", ("id", block_id));
+
+      _state_snapshot_download.reset();
+      try
+      {
+        fc::remove_all(file);
+      }
+      catch (const fc::exception& e)
+      {
+        wlog("Unable to remove the downloaded state snapshot ${file}: ${e}", ("file", file)("e", e));
+      }
+      for (const peer_connection_ptr& peer : _active_connections)
+        peer->offers_state_snapshot = false;
+      _most_recent_blocks_accepted.clear();
+      _most_recent_blocks_accepted.push_back(block_id);
+      start_synchronizing();
+    }
+
+    void node_impl::abandon_state_snapshot_download()
+    {
+      VERIFY_CORRECT_THREAD();
+      if (!_state_snapshot_download)
+        return;
+      const fc::path file = _state_snapshot_download->file;
+      _state_snapshot_download.reset();
+      for (const peer_connection_ptr& peer : _active_connections)
+      {
+        peer->offers_state_snapshot = false;
+        peer->state_snapshot_chunks_requested.clear();
+      }
+      try
+      {
+        fc::remove_all(file);
+      }
+      catch (const fc::exception& e)
+      {
+        wlog("Unable to remove the partial state snapshot ${file}: ${e}", ("file", file)("e", e));
+      }
+      start_synchronizing();
+    }
+
     void node_impl::on_item_ids_inventory_message(peer_connection* originating_peer, const item_ids_inventory_message& item_ids_inventory_message_received)
     {
       VERIFY_CORRECT_THREAD();
@@ -3041,6 +3634,16 @@ namespace graphene { namespace net { namespace detail {
         trigger_fetch_items_loop();
       }
 
+      if (!originating_peer->state_snapshot_chunks_requested.empty())
+      {
+        if (_state_snapshot_download)
+          for (uint32_t chunk_index : originating_peer->state_snapshot_chunks_requested)
+            _state_snapshot_download->chunks_requested.erase(chunk_index);
+        originating_peer->state_snapshot_chunks_requested.clear();
+        request_state_snapshot_chunks();
+      }
+      originating_peer->offers_state_snapshot = false;
+
       schedule_peer_for_deletion(originating_peer_ptr);
     }
 
@@ -3259,84 +3862,92 @@ namespace graphene { namespace net { namespace detail {
 
       do
       {
-        std::copy(std::make_move_iterator(_new_received_sync_items.begin()),
-                  std::make_move_iterator(_new_received_sync_items.end()),
-                  std::front_inserter(_received_sync_items));
+        for (graphene::net::block_message& new_block : _new_received_sync_items)
+        {
+          item_hash_t new_block_id = new_block.block_id;
+          _received_sync_items.emplace(new_block_id, std::move(new_block));
+        }
         _new_received_sync_items.clear();
         dlog("currently ${count} sync items to consider", ("count", _received_sync_items.size()));
 
         block_processed_this_iteration = false;
-        for (auto received_block_iter = _received_sync_items.begin();
-             received_block_iter != _received_sync_items.end();
-             ++received_block_iter)
+
+        // look up the next block on the active chain or one of the forks, it is the first
+        // item a peer still has to give us
+        auto received_block_iter = _received_sync_items.end();
+        for (const peer_connection_ptr& peer : _active_connections)
         {
+          ASSERT_TASK_NOT_PREEMPTED(); // don't yield while iterating over _active_connections
+          if (!peer->ids_of_items_to_get.empty())
+          {
+            received_block_iter = _received_sync_items.find(peer->ids_of_items_to_get.front());
+            if (received_block_iter != _received_sync_items.end())
+              break;
+          }
+        }
 
-          // find out if this block is the next block on the active chain or one of the forks
-          bool potential_first_block = false;
+        if (received_block_iter != _received_sync_items.end())
+        {
+          const item_hash_t received_block_id = received_block_iter->first;
           for (const peer_connection_ptr& peer : _active_connections)
           {
             ASSERT_TASK_NOT_PREEMPTED(); // don't yield while iterating over _active_connections
             if (!peer->ids_of_items_to_get.empty() &&
-                peer->ids_of_items_to_get.front() == received_block_iter->block_id)
+                peer->ids_of_items_to_get.front() == received_block_id)
             {
-              potential_first_block = true;
               peer->ids_of_items_to_get.pop_front();
-              peer->ids_of_items_being_processed.insert(received_block_iter->block_id);
+              peer->ids_of_items_being_processed.insert(received_block_id);
             }
           }
 
-          // if it is, process it, remove it from all sync peers lists
-          if (potential_first_block)
+          // we can get into an interesting situation near the end of synchronization.  We can be in
+          // sync with one peer who is sending us the last block on the chain via a regular inventory
+          // message, while at the same time still be synchronizing with a peer who is sending us the
+          // block through the sync mechanism.  Further, we must request both blocks because
+          // we don't know they're the same (for the peer in normal operation, it has only told us the
+          // message id, for the peer in the sync case we only known the block_id).
+          graphene::net::block_message block_message_to_process = std::move(received_block_iter->second);
+          _received_sync_items.erase(received_block_iter);
+          if (std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
+                        received_block_id) == _most_recent_blocks_accepted.end())
           {
-            // we can get into an interesting situation near the end of synchronization.  We can be in
-            // sync with one peer who is sending us the last block on the chain via a regular inventory
-            // message, while at the same time still be synchronizing with a peer who is sending us the
-            // block through the sync mechanism.  Further, we must request both blocks because
-            // we don't know they're the same (for the peer in normal operation, it has only told us the
-            // message id, for the peer in the sync case we only known the block_id).
-            if (std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
-                          received_block_iter->block_id) == _most_recent_blocks_accepted.end())
-            {
-              graphene::net::block_message block_message_to_process = *received_block_iter;
-              _received_sync_items.erase(received_block_iter);
-              _handle_message_calls_in_progress.emplace_back(fc::async([this, block_message_to_process](){
-                send_sync_block_to_node_delegate(block_message_to_process);
-              }, "send_sync_block_to_node_delegate"));
-              ++blocks_processed;
-              block_processed_this_iteration = true;
-            }
-            else
+            _handle_message_calls_in_progress.emplace_back(fc::async([this, block_message_to_process](){
+              send_sync_block_to_node_delegate(block_message_to_process);
+            }, "send_sync_block_to_node_delegate"));
+            ++blocks_processed;
+            block_processed_this_iteration = true;
+          }
+          else
+          {
+            dlog("Already received and accepted this block (presumably through normal inventory mechanism), treating it as accepted");
+            std::vector< peer_connection_ptr > peers_needing_next_batch;
+            for (const peer_connection_ptr& peer : _active_connections)
             {
-              dlog("Already received and accepted this block (presumably through normal inventory mechanism), treating it as accepted");
-              std::vector< peer_connection_ptr > peers_needing_next_batch;
-              for (const peer_connection_ptr& peer : _active_connections)
+              auto items_being_processed_iter = peer->ids_of_items_being_processed.find(received_block_id);
+              if (items_being_processed_iter != peer->ids_of_items_being_processed.end())
               {
-                auto items_being_processed_iter = peer->ids_of_items_being_processed.find(received_block_iter->block_id);
-                if (items_being_processed_iter != peer->ids_of_items_being_processed.end())
+                peer->ids_of_items_being_processed.erase(items_being_processed_iter);
+                dlog("Removed item from ${endpoint}'s list of items being processed, still processing ${len} blocks",
+                     ("endpoint", peer->get_remote_endpoint())("len", peer->ids_of_items_being_processed.size()));
+
+                // if we just processed the last item in our list from this peer, we will want to
+                // send another request to find out if we are now in sync (this is normally handled in
+                // send_sync_block_to_node_delegate)
+                if (peer->ids_of_items_to_get.empty() &&
+                    peer->number_of_unfetched_item_ids == 0 &&
+                    peer->ids_of_items_being_processed.empty())
                 {
-                  peer->ids_of_items_being_processed.erase(items_being_processed_iter);
-                  dlog("Removed item from ${endpoint}'s list of items being processed, still processing ${len} blocks",
-                       ("endpoint", peer->get_remote_endpoint())("len", peer->ids_of_items_being_processed.size()));
-
-                  // if we just processed the last item in our list from this peer, we will want to
-                  // send another request to find out if we are now in sync (this is normally handled in
-                  // send_sync_block_to_node_delegate)
-                  if (peer->ids_of_items_to_get.empty() &&
-                      peer->number_of_unfetched_item_ids == 0 &&
-                      peer->ids_of_items_being_processed.empty())
-                  {
-                    dlog("We received last item in our list for peer ${endpoint}, setup to do a sync check", ("endpoint", peer->get_remote_endpoint()));
-                    peers_needing_next_batch.push_back( peer );
-                  }
+                  dlog("We received last item in our list for peer ${endpoint}, setup to do a sync check", ("endpoint", peer->get_remote_endpoint()));
+                  peers_needing_next_batch.push_back( peer );
                 }
               }
-              for( const peer_connection_ptr& peer : peers_needing_next_batch )
-                fetch_next_batch_of_item_ids_from_peer(peer.get());
             }
-
-            break; // start iterating _received_sync_items from the beginning
-          } // end if potential_first_block
-        } // end for each block in _received_sync_items
+            for( const peer_connection_ptr& peer : peers_needing_next_batch )
+              fetch_next_batch_of_item_ids_from_peer(peer.get());
+            // it's out of the way now, blocks that follow it may be ready
+            block_processed_this_iteration = true;
+          }
+        } // end if a received block is next on a chain
 
         if (_handle_message_calls_in_progress.size() >= _maximum_number_of_blocks_to_handle_at_one_time)
         {
@@ -3369,6 +3980,9 @@ namespace graphene { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
       dlog( "received a sync block from peer ${endpoint}", ("endpoint", originating_peer->get_remote_endpoint() ) );
 
+      // let the client check the block while it waits in the queue
+      _delegate->prevalidate_block( block_message_to_process );
+
       // add it to the front of _received_sync_items, then process _received_sync_items to try to
       // pass as many messages as possible to the client.
       _new_received_sync_items.push_front( block_message_to_process );
@@ -3554,6 +4168,8 @@ namespace graphene { namespace net { namespace detail {
           {
             originating_peer->last_sync_item_received_time = fc::time_point::now();
             _active_sync_requests.erase(block_message_to_process.block_id);
+            if (originating_peer->sync_items_requested_from_peer.empty())
+              update_sync_request_window(originating_peer);
             process_block_during_sync(originating_peer, block_message_to_process, message_hash);
             if (originating_peer->idle())
             {
@@ -3922,6 +4538,8 @@ namespace graphene { namespace net { namespace detail {
     void node_impl::start_synchronizing_with_peer( const peer_connection_ptr& peer )
     {
       VERIFY_CORRECT_THREAD();
+      if( _state_snapshot_download )
+        return; // we'll sync the blocks following the snapshot once it's loaded
       peer->ids_of_items_to_get.clear();
       peer->number_of_unfetched_item_ids = 0;
       peer->we_need_sync_items_from_peer = true;
@@ -3942,6 +4560,8 @@ namespace graphene { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
       peer->send_message(current_time_request_message(),
                          offsetof(current_time_request_message, request_sent_time));
+      if( _state_snapshot_download )
+        request_state_snapshot_manifest( peer );
       start_synchronizing_with_peer( peer );
       if( _active_connections.size() != _last_reported_number_of_connections )
       {
@@ -4888,6 +5508,7 @@ namespace graphene { namespace net { namespace detail {
         peer_details["startingheight"] = "";
         peer_details["banscore"] = "";
         peer_details["syncnode"] = "";
+        peer_details["sync_request_window"] = peer->sync_window.size();
 
         if (peer->fc_git_revision_sha)
         {
@@ -4974,6 +5595,19 @@ namespace graphene { namespace net { namespace detail {
       _hard_fork_block_numbers = hard_fork_block_numbers;
     }
 
+    void node_impl::sync_from_state_snapshot(const fc::optional<block_id_type>& expected_block_id,
+                                             const fc::sha256& expected_hash)
+    {
+      VERIFY_CORRECT_THREAD();
+      _state_snapshot_download.reset(new state_snapshot_download);
+      _state_snapshot_download->expected_block_id = expected_block_id;
+      _state_snapshot_download->expected_hash = expected_hash;
+      _state_snapshot_download->file = _node_configuration_directory / "state_snapshot.part";
+      _state_snapshot_download->last_progress_time = fc::time_point::now();
+      for (const peer_connection_ptr& peer : _active_connections)
+        request_state_snapshot_manifest(peer);
+    }
+
     bool node_impl::is_connected() const
     {
       VERIFY_CORRECT_THREAD();
@@ -5231,6 +5865,12 @@ namespace graphene { namespace net { namespace detail {
     INVOKE_IN_IMPL(sync_from, current_head_block, hard_fork_block_numbers);
   }
 
+  void node::sync_from_state_snapshot(const fc::optional<block_id_type>& expected_block_id,
+                                      const fc::sha256& expected_hash)
+  {
+    INVOKE_IN_IMPL(sync_from_state_snapshot, expected_block_id, expected_hash);
+  }
+
   bool node::is_connected() const
   {
     INVOKE_IN_IMPL(is_connected);
@@ -5487,6 +6127,13 @@ namespace graphene { namespace net { namespace detail {
       INVOKE_AND_COLLECT_STATISTICS(handle_block, block_message, sync_mode, contained_transaction_message_ids);
     }
 
+    void statistics_gathering_node_delegate_wrapper::prevalidate_block( const graphene::net::block_message& block_message )
+    {
+      // this function doesn't need to block,
+      ASSERT_TASK_NOT_PREEMPTED();
+      _node_delegate->prevalidate_block(block_message);
+    }
+
     void statistics_gathering_node_delegate_wrapper::handle_transaction( const graphene::net::trx_message& transaction_message )
     {
       INVOKE_AND_COLLECT_STATISTICS(handle_transaction, transaction_message);
@@ -5504,6 +6151,11 @@ namespace graphene { namespace net { namespace detail {
       INVOKE_AND_COLLECT_STATISTICS(get_item, id);
     }
 
+    std::vector<fc::optional<signed_transaction>> statistics_gathering_node_delegate_wrapper::get_transactions(const std::vector<transaction_id_type>& ids)
+    {
+      INVOKE_AND_COLLECT_STATISTICS(get_transactions, ids);
+    }
+
     std::vector<item_hash_t> statistics_gathering_node_delegate_wrapper::get_blockchain_synopsis(const item_hash_t& reference_point, uint32_t number_of_blocks_after_reference_point)
     {
       INVOKE_AND_COLLECT_STATISTICS(get_blockchain_synopsis, reference_point, number_of_blocks_after_reference_point);
@@ -5559,6 +6211,21 @@ namespace graphene { namespace net { namespace detail {
       INVOKE_AND_COLLECT_STATISTICS(error_encountered, message, error);
     }
 
+    state_snapshot_manifest_message statistics_gathering_node_delegate_wrapper::get_state_snapshot_manifest()
+    {
+      INVOKE_AND_COLLECT_STATISTICS(get_state_snapshot_manifest);
+    }
+
+    std::vector<char> statistics_gathering_node_delegate_wrapper::get_state_snapshot_chunk(const block_id_type& block_id, uint32_t chunk_index)
+    {
+      INVOKE_AND_COLLECT_STATISTICS(get_state_snapshot_chunk, block_id, chunk_index);
+    }
+
+    void statistics_gathering_node_delegate_wrapper::load_state_snapshot(const fc::path& file, const block_id_type& block_id)
+    {
+      INVOKE_AND_COLLECT_STATISTICS(load_state_snapshot, file, block_id);
+    }
+
 #undef INVOKE_AND_COLLECT_STATISTICS
 
   } // end namespace detail
@@ -35,6 +35,11 @@
 
 namespace graphene { namespace net {
 
+// reads only need to hold what the socket has ready, writes should take a whole batch of
+// queued messages so it is encrypted in one pass instead of one pass per 4KiB
+static const size_t read_buffer_length = 16 * 1024;
+static const size_t write_buffer_length = 64 * 1024;
+
 stcp_socket::stcp_socket()
 //:_buf_len(0)
 #ifndef NDEBUG
@@ -81,7 +86,8 @@ void stcp_socket::bind( const fc::ip::endpoint& local_endpoint )
 /**
  *   This method must read at least 16 bytes at a time from
  *   the underlying TCP socket so that it can decrypt them. It
- *   will buffer any left-over.
+ *   reads as much as is available and buffers any left-over
+ *   for the following calls.
  */
 size_t stcp_socket::readsome( char* buffer, size_t len )
 { try {
@@ -98,20 +104,38 @@ size_t stcp_socket::readsome( char* buffer, size_t len )
     } buffer_in_use_checker(_read_buffer_in_use);
 #endif
 
-    const size_t read_buffer_length = 4096;
     if (!_read_buffer)
+    {
       _read_buffer.reset(new char[read_buffer_length], [](char* p){ delete[] p; });
+      _plaintext_buffer.reset(new char[read_buffer_length], [](char* p){ delete[] p; });
+    }
 
-    len = std::min<size_t>(read_buffer_length, len);
-
-    size_t s = _sock.readsome( _read_buffer, len, 0 );
-    if( s % 16 ) 
+    if (_plaintext_begin == _plaintext_end)
     {
-      _sock.read(_read_buffer, 16 - (s%16), s);
-      s += 16-(s%16);
+      // drain whatever the socket has ready in one call.  Reads at least as large as the buffer
+      // are decrypted straight into the caller's buffer, smaller ones (like message headers)
+      // are served from the decrypted left-over of this read
+      size_t s = _sock.readsome( _read_buffer, read_buffer_length, 0 );
+      if( s % 16 )
+      {
+        _sock.read(_read_buffer, 16 - (s%16), s);
+        s += 16-(s%16);
+      }
+      if (len >= s)
+      {
+        _recv_aes.decode( _read_buffer.get(), s, buffer );
+        return s;
+      }
+      _recv_aes.decode( _read_buffer.get(), s, _plaintext_buffer.get() );
+      _plaintext_begin = 0;
+      _plaintext_end = s;
     }
-    _recv_aes.decode( _read_buffer.get(), s, buffer );
-    return s;
+
+    // the left-over is always a multiple of 16 bytes because len is
+    len = std::min<size_t>(_plaintext_end - _plaintext_begin, len);
+    memcpy(buffer, _plaintext_buffer.get() + _plaintext_begin, len);
+    _plaintext_begin += len;
+    return len;
 } FC_RETHROW_EXCEPTIONS( warn, "", ("len",len) ) }
 
 size_t stcp_socket::readsome( const std::shared_ptr<char>& buf, size_t len, size_t offset ) 
@@ -121,7 +145,7 @@ size_t stcp_socket::readsome( const std::shared_ptr<char>& buf, size_t len, size
 
 bool stcp_socket::eof()const
 {
-  return _sock.eof();
+  return _plaintext_begin == _plaintext_end && _sock.eof();
 }
 
 size_t stcp_socket::writesome( const char* buffer, size_t len )
@@ -139,11 +163,9 @@ size_t stcp_socket::writesome( const char* buffer, size_t len )
     } buffer_in_use_checker(_write_buffer_in_use);
 #endif
 
-    const std::size_t write_buffer_length = 4096;
     if (!_write_buffer)
       _write_buffer.reset(new char[write_buffer_length], [](char* p){ delete[] p; });
     len = std::min<size_t>(write_buffer_length, len);
-    memset(_write_buffer.get(), 0, len); // just in case aes.encode screws up
     /**
      * every sizeof(crypt_buf) bytes the aes channel
      * has an error and doesn't decrypt properly...  disable
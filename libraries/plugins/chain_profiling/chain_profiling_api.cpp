@@ -0,0 +1,41 @@
+
+#include <muse/app/api_context.hpp>
+#include <muse/app/application.hpp>
+
+#include <muse/plugins/chain_profiling/chain_profiling_api.hpp>
+
+namespace muse { namespace plugin { namespace chain_profiling {
+
+namespace detail {
+
+class chain_profiling_api_impl
+{
+   public:
+      chain_profiling_api_impl( muse::app::application& _app );
+
+      muse::app::application& app;
+};
+
+chain_profiling_api_impl::chain_profiling_api_impl( muse::app::application& _app ) : app( _app )
+{}
+
+} // detail
+
+chain_profiling_api::chain_profiling_api( const muse::app::api_context& ctx )
+{
+   my = std::make_shared< detail::chain_profiling_api_impl >(ctx.app);
+}
+
+chain::block_profile chain_profiling_api::get_profile()
+{
+   return my->app.chain_database()->get_profiler().get_profile();
+}
+
+void chain_profiling_api::reset_profile()
+{
+   my->app.chain_database()->get_profiler().reset();
+}
+
+void chain_profiling_api::on_api_startup() { }
+
+} } } // muse::plugin::chain_profiling
@@ -0,0 +1,88 @@
+#include <muse/chain/database.hpp>
+
+#include <muse/plugins/chain_profiling/chain_profiling_api.hpp>
+#include <muse/plugins/chain_profiling/chain_profiling_plugin.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+namespace muse { namespace plugin { namespace chain_profiling {
+
+static std::string summarize( std::vector< chain::timing_stats > stats, size_t count )
+{
+   std::sort( stats.begin(), stats.end(), []( const chain::timing_stats& a, const chain::timing_stats& b ) {
+      return a.total_us > b.total_us;
+   });
+   std::stringstream ss;
+   for( size_t i = 0; i < std::min( count, stats.size() ) && stats[i].count > 0; ++i )
+   {
+      if( i > 0 )
+         ss << ", ";
+      ss << stats[i].name << " " << stats[i].total_us << "us (avg " << stats[i].total_us / stats[i].count
+         << "us, max " << stats[i].max_us << "us)";
+   }
+   return ss.str();
+}
+
+chain_profiling_plugin::chain_profiling_plugin() {}
+chain_profiling_plugin::~chain_profiling_plugin() {}
+
+std::string chain_profiling_plugin::plugin_name()const
+{
+   return "chain_profiling";
+}
+
+void chain_profiling_plugin::plugin_set_program_options(
+   boost::program_options::options_description& cli,
+   boost::program_options::options_description& cfg
+)
+{
+   cli.add_options()
+         ("chain-profiling-log-interval", boost::program_options::value<uint32_t>()->default_value(1200),
+           "Log a summary of block application timings every this many blocks and start a new profile, 0 disables the summary")
+         ;
+   cfg.add(cli);
+}
+
+void chain_profiling_plugin::plugin_initialize( const boost::program_options::variables_map& options )
+{
+   try
+   {
+      if( options.count("chain-profiling-log-interval") )
+         _log_interval = options["chain-profiling-log-interval"].as< uint32_t >();
+
+      chain::block_profiler& profiler = database().get_profiler();
+      profiler.enable( true );
+      profiler.set_block_callback( [this]( chain::block_profiler& p ){ on_block_profiled( p ); } );
+   } FC_CAPTURE_AND_RETHROW()
+}
+
+void chain_profiling_plugin::plugin_startup()
+{
+   app().register_api_factory< chain_profiling_api >( "chain_profiling_api" );
+}
+
+void chain_profiling_plugin::plugin_shutdown()
+{
+   chain::block_profiler& profiler = database().get_profiler();
+   profiler.set_block_callback( nullptr );
+   profiler.enable( false );
+}
+
+void chain_profiling_plugin::on_block_profiled( chain::block_profiler& profiler )
+{
+   // called once the block is complete, so the new window starts with the next block
+   if( _log_interval == 0 || profiler.blocks() < _log_interval )
+      return;
+
+   const chain::block_profile profile = profiler.get_profile();
+   ilog( "Block application profile of ${n} blocks up to #${b}, slowest stages: ${s}",
+         ("n", profile.blocks)("b", database().head_block_num())("s", summarize( profile.stages, 5 )) );
+   ilog( "Slowest operations: ${o}", ("o", summarize( profile.operations, 5 )) );
+   profiler.reset();
+}
+
+} } } // muse::plugin::chain_profiling
+
+MUSE_DEFINE_PLUGIN( chain_profiling, muse::plugin::chain_profiling::chain_profiling_plugin )
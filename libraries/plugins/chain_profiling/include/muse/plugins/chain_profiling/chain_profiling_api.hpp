@@ -0,0 +1,38 @@
+
+#pragma once
+
+#include <muse/chain/block_profiler.hpp>
+
+#include <fc/api.hpp>
+
+namespace muse { namespace app {
+   struct api_context;
+} }
+
+namespace muse { namespace plugin { namespace chain_profiling {
+
+namespace detail {
+class chain_profiling_api_impl;
+}
+
+class chain_profiling_api
+{
+   public:
+      chain_profiling_api( const muse::app::api_context& ctx );
+
+      void on_api_startup();
+
+      /** timings collected since the last summary was logged or the profile was reset */
+      chain::block_profile get_profile();
+      void reset_profile();
+
+   private:
+      std::shared_ptr< detail::chain_profiling_api_impl > my;
+};
+
+} } }
+
+FC_API( muse::plugin::chain_profiling::chain_profiling_api,
+   (get_profile)
+   (reset_profile)
+   )
@@ -0,0 +1,35 @@
+
+#pragma once
+
+#include <muse/app/plugin.hpp>
+
+namespace muse { namespace chain {
+class block_profiler;
+} }
+
+namespace muse { namespace plugin { namespace chain_profiling {
+
+/**
+ *  Enables the block profiler of the database, logs a summary of it every
+ *  chain-profiling-log-interval blocks and serves it through chain_profiling_api.
+ */
+class chain_profiling_plugin : public muse::app::plugin
+{
+   public:
+      chain_profiling_plugin();
+      virtual ~chain_profiling_plugin();
+
+      virtual std::string plugin_name()const override;
+      virtual void plugin_set_program_options(
+         boost::program_options::options_description& cli,
+         boost::program_options::options_description& cfg ) override;
+      virtual void plugin_initialize( const boost::program_options::variables_map& options ) override;
+      virtual void plugin_startup() override;
+      virtual void plugin_shutdown() override;
+
+      void on_block_profiled( chain::block_profiler& profiler );
+
+      uint32_t _log_interval = 1200;
+};
+
+} } }
@@ -0,0 +1,117 @@
+/*
+ * Copies a block database (data_dir/blockchain/database/block_num_to_block)
+ * into a new directory, either compressed or raw. Both directions are
+ * supported, so a compressed log can be turned back into one that older
+ * versions of mused can read.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/io/raw.hpp>
+
+#include <muse/chain/block_database.hpp>
+
+using namespace muse::chain;
+
+using namespace std;
+
+static void print_usage( const char* name )
+{
+   cerr << "Usage: " << name << " <source dir> <destination dir> [options]\n"
+        << "\n"
+        << "Options:\n"
+        << "   --raw                    write uncompressed blocks\n"
+        << "   --no-dictionary          compress without a preset dictionary\n"
+        << "   --dictionary-samples N   number of blocks to train the dictionary on (default 2000)\n";
+}
+
+int main( int argc, char** argv )
+{
+   try
+   {
+      if( argc < 3 )
+      {
+         print_usage( argv[0] );
+         return 1;
+      }
+
+      const fc::path source_dir = argv[1];
+      const fc::path dest_dir = argv[2];
+      bool compress = true;
+      bool use_dictionary = true;
+      uint32_t sample_count = 2000;
+      for( int i = 3; i < argc; ++i )
+      {
+         const string arg = argv[i];
+         if( arg == "--raw" )
+            compress = false;
+         else if( arg == "--no-dictionary" )
+            use_dictionary = false;
+         else if( arg == "--dictionary-samples" && i + 1 < argc )
+            sample_count = std::stoul( argv[++i] );
+         else
+         {
+            print_usage( argv[0] );
+            return 1;
+         }
+      }
+
+      FC_ASSERT( fc::exists( source_dir / "index" ), "${d} does not contain a block database", ("d", source_dir) );
+      FC_ASSERT( !fc::exists( dest_dir / "index" ), "${d} already contains a block database", ("d", dest_dir) );
+
+      block_database source;
+      source.open( source_dir );
+      fc::optional<block_id_type> last_id = source.last_id();
+      FC_ASSERT( last_id.valid(), "Source block database is empty" );
+      const uint32_t last_num = block_header::num_from_id( *last_id );
+
+      block_database dest;
+      dest.open( dest_dir, false, compress );
+
+      if( compress && use_dictionary && sample_count > 0 )
+      {
+         // sample evenly, later blocks are the best predictor of the blocks still to come
+         vector< vector<char> > samples;
+         const uint32_t stride = std::max<uint32_t>( 1, last_num / sample_count );
+         for( uint32_t n = last_num; n > 0 && samples.size() < sample_count; n = n > stride ? n - stride : 0 )
+         {
+            fc::optional<signed_block> block = source.fetch_by_number( n );
+            if( block.valid() )
+               samples.push_back( fc::raw::pack_to_vector( *block ) );
+         }
+         vector<char> dictionary = block_database::train_dictionary( samples );
+         cout << "Trained a " << dictionary.size() << " byte dictionary on " << samples.size() << " blocks" << endl;
+         if( !dictionary.empty() )
+            dest.set_dictionary( dictionary );
+      }
+
+      uint64_t raw_bytes = 0;
+      uint32_t copied = 0;
+      for( uint32_t n = 1; n <= last_num; ++n )
+      {
+         fc::optional<signed_block> block = source.fetch_by_number( n );
+         if( !block.valid() )
+            continue;
+         raw_bytes += fc::raw::pack_size( *block );
+         dest.store( block->id(), *block );
+         if( ++copied % 100000 == 0 )
+            cout << "Converted " << copied << " of " << last_num << " blocks" << endl;
+      }
+      dest.close();
+      source.close();
+
+      const uint64_t stored_bytes = fc::file_size( dest_dir / "blocks" );
+      cout << "Converted " << copied << " blocks, " << raw_bytes << " bytes packed, "
+           << stored_bytes << " bytes stored" << endl;
+   }
+   catch ( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << std::endl;
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,165 @@
+/*
+ * Benchmark of block application for the name lookup heavy operations.
+ *
+ * Creates a set of accounts, a streaming platform and content, then pushes
+ * blocks that alternate transfers and streaming platform reports. Every one of
+ * these resolves several account, platform and content names through
+ * database::get_account and friends. The wall time per transaction is printed
+ * together with a direct comparison of the ordered and the hashed name index,
+ * so that running the binary built from before and after a change to the
+ * lookups gives comparable numbers.
+ *
+ * Tunables (environment): APPLY_BENCHMARK_ACCOUNTS, APPLY_BENCHMARK_BLOCKS,
+ * APPLY_BENCHMARK_TRANSACTIONS
+ */
+
+#include <boost/test/included/unit_test.hpp>
+
+#include <muse/chain/content_object.hpp>
+#include <muse/chain/streaming_platform_objects.hpp>
+
+#include "../common/database_fixture.hpp"
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace muse::chain;
+
+extern uint32_t MUSE_TESTING_GENESIS_TIMESTAMP;
+
+boost::unit_test::test_suite* init_unit_test_suite(int argc, char* argv[]) {
+   const char* genesis_timestamp_str = getenv("MUSE_TESTING_GENESIS_TIMESTAMP");
+   if( genesis_timestamp_str != nullptr )
+      MUSE_TESTING_GENESIS_TIMESTAMP = std::stoul( genesis_timestamp_str );
+   return nullptr;
+}
+
+static uint32_t tunable( const char* name, uint32_t def )
+{
+   const char* value = getenv( name );
+   return value != nullptr ? std::stoul( value ) : def;
+}
+
+template<typename Index>
+static fc::microseconds time_lookups( const Index& idx, const vector<string>& names, uint32_t rounds )
+{
+   size_t found = 0;
+   auto start = fc::time_point::now();
+   for( uint32_t r = 0; r < rounds; ++r )
+      for( const auto& name : names )
+         found += idx.find( name ) != idx.end();
+   auto elapsed = fc::time_point::now() - start;
+   BOOST_REQUIRE_EQUAL( found, names.size() * rounds );
+   return elapsed;
+}
+
+BOOST_FIXTURE_TEST_SUITE( apply_benchmark, clean_database_fixture )
+
+BOOST_AUTO_TEST_CASE( transfers_and_reports )
+{
+   try
+   {
+      const uint32_t accounts     = tunable( "APPLY_BENCHMARK_ACCOUNTS", 1000 );
+      const uint32_t blocks       = tunable( "APPLY_BENCHMARK_BLOCKS", 50 );
+      const uint32_t transactions = tunable( "APPLY_BENCHMARK_TRANSACTIONS", 200 );
+
+      vector<string> names;
+      vector<string> urls;
+      for( uint32_t i = 0; i < accounts; ++i )
+      {
+         names.push_back( "bench" + std::to_string( i ) );
+         account_create( names.back(), init_account_pub_key );
+         fund( names.back(), 1000000 );
+      }
+      // the platform signs every report, give it enough bandwidth
+      fund( names[0], 100000000 );
+      vest( names[0], 100000000 );
+      generate_block();
+
+      signed_transaction tx;
+      tx.set_expiration( db.head_block_time() + MUSE_MAX_TIME_UNTIL_EXPIRATION );
+      {
+         fund( names[0], MUSE_MIN_STREAMING_PLATFORM_CREATION_FEE );
+         streaming_platform_update_operation spuo;
+         spuo.fee = asset( MUSE_MIN_STREAMING_PLATFORM_CREATION_FEE, MUSE_SYMBOL );
+         spuo.owner = names[0];
+         spuo.url = "http://www.example.com";
+         tx.operations.push_back( spuo );
+         db.push_transaction( tx, database::skip_transaction_signatures );
+      }
+      for( uint32_t i = 0; i < accounts; i += 10 )
+      {
+         content_operation cop;
+         cop.uploader = names[i];
+         cop.url = "ipfs://bench" + std::to_string( i );
+         cop.album_meta.album_title = "Benchmark album";
+         cop.track_meta.track_title = "Benchmark track";
+         cop.comp_meta.third_party_publishers = false;
+         distribution dist;
+         dist.payee = names[i];
+         dist.bp = MUSE_100_PERCENT;
+         cop.distributions.push_back( dist );
+         management_vote mgmt;
+         mgmt.voter = names[i];
+         mgmt.percentage = 100;
+         cop.management.push_back( mgmt );
+         cop.management_threshold = 100;
+         cop.playing_reward = 10;
+         cop.publishers_share = 0;
+         tx.operations.clear();
+         tx.operations.push_back( cop );
+         db.push_transaction( tx, database::skip_transaction_signatures );
+         urls.push_back( cop.url );
+      }
+      generate_block();
+
+      uint32_t next = 0;
+      auto start = fc::time_point::now();
+      for( uint32_t b = 0; b < blocks; ++b )
+      {
+         for( uint32_t t = 0; t < transactions; ++t, ++next )
+         {
+            tx.operations.clear();
+            tx.set_expiration( db.head_block_time() + MUSE_MAX_TIME_UNTIL_EXPIRATION );
+            if( t % 2 == 0 )
+            {
+               transfer_operation op;
+               op.from = names[ next % accounts ];
+               op.to = names[ ( next * 7 + 1 ) % accounts ];
+               op.amount = asset( 1 + t, MUSE_SYMBOL );
+               tx.operations.push_back( op );
+            }
+            else
+            {
+               streaming_platform_report_operation op;
+               op.streaming_platform = names[0];
+               op.consumer = names[ next % accounts ];
+               op.content = urls[ next % urls.size() ];
+               op.play_time = 10;
+               tx.operations.push_back( op );
+            }
+            db.push_transaction( tx, database::skip_transaction_signatures );
+         }
+         generate_block();
+      }
+      auto applied = fc::time_point::now() - start;
+      validate_database();
+
+      const uint32_t rounds = 100;
+      const auto& accts = db.get_index_type<account_index>().indices();
+      auto ordered = time_lookups( accts.get<by_name>(), names, rounds );
+      auto hashed  = time_lookups( accts.get<by_name_hash>(), names, rounds );
+
+      const double txs = double( blocks ) * transactions;
+      const double lookups = double( names.size() ) * rounds;
+      std::cout << "accounts: " << accounts << ", blocks: " << blocks
+                << ", transactions per block: " << transactions << "\n";
+      std::cout << "applied in " << applied.count() / 1000 << " ms, "
+                << uint64_t( applied.count() / txs ) << " us per transaction\n";
+      std::cout << "account lookup, ordered index: " << uint64_t( ordered.count() * 1000.0 / lookups ) << " ns\n";
+      std::cout << "account lookup, hashed index:  " << uint64_t( hashed.count() * 1000.0 / lookups ) << " ns\n";
+   }
+   FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_SUITE_END()
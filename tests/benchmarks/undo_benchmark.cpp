@@ -0,0 +1,190 @@
+/*
+ * Micro benchmark of the undo bookkeeping done while pushing transactions.
+ *
+ * Every block opens a session, every transaction opens a temporary child
+ * session that is merged into the block session on success (as in
+ * database::_push_transaction), and the block session is committed. The
+ * current undo_database is compared against the previous hash map based
+ * undo_state, which is reproduced below.
+ *
+ * usage: undo_benchmark [blocks] [transactions per block] [objects]
+ */
+
+#include <muse/chain/account_object.hpp>
+
+#include <graphene/db/object_database.hpp>
+#include <graphene/db/undo_database.hpp>
+
+#include <fc/time.hpp>
+
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace graphene::db;
+using muse::chain::account_object;
+
+/** The undo_state and merge logic before the arena based implementation */
+class legacy_undo
+{
+   public:
+      struct state
+      {
+         std::unordered_map<object_id_type, unique_ptr<object> > old_values;
+         std::unordered_map<object_id_type, object_id_type>      old_index_next_ids;
+         std::unordered_set<object_id_type>                      new_ids;
+         std::unordered_map<object_id_type, unique_ptr<object> > removed;
+      };
+
+      void start_session()
+      {
+         while( _stack.size() > _max_size )
+            _stack.pop_front();
+         _stack.emplace_back();
+      }
+
+      void on_create( const object& obj )
+      {
+         auto& s = _stack.back();
+         auto index_id = object_id_type( obj.id.space(), obj.id.type(), 0 );
+         if( s.old_index_next_ids.find( index_id ) == s.old_index_next_ids.end() )
+            s.old_index_next_ids[index_id] = obj.id;
+         s.new_ids.insert( obj.id );
+      }
+
+      void on_modify( const object& obj )
+      {
+         auto& s = _stack.back();
+         if( s.new_ids.find( obj.id ) != s.new_ids.end() ) return;
+         if( s.old_values.find( obj.id ) != s.old_values.end() ) return;
+         s.old_values[obj.id] = obj.clone();
+      }
+
+      void merge()
+      {
+         auto& s = _stack.back();
+         auto& prev = _stack[_stack.size()-2];
+         for( auto& obj : s.old_values )
+         {
+            if( prev.new_ids.find( obj.second->id ) != prev.new_ids.end() ) continue;
+            if( prev.old_values.find( obj.second->id ) != prev.old_values.end() ) continue;
+            prev.old_values[obj.second->id] = std::move( obj.second );
+         }
+         for( auto id : s.new_ids )
+            prev.new_ids.insert( id );
+         for( auto& item : s.old_index_next_ids )
+            if( prev.old_index_next_ids.find( item.first ) == prev.old_index_next_ids.end() )
+               prev.old_index_next_ids[item.first] = item.second;
+         for( auto& obj : s.removed )
+         {
+            if( prev.new_ids.erase( obj.second->id ) ) continue;
+            auto it = prev.old_values.find( obj.second->id );
+            if( it != prev.old_values.end() )
+            {
+               prev.removed[obj.second->id] = std::move( it->second );
+               prev.old_values.erase( obj.second->id );
+               continue;
+            }
+            prev.removed[obj.second->id] = std::move( obj.second );
+         }
+         _stack.pop_back();
+      }
+
+   private:
+      std::deque<state> _stack;
+      size_t            _max_size = 21;
+};
+
+struct workload
+{
+   uint32_t blocks;
+   uint32_t transactions;
+   vector<account_object> accounts;
+   vector<uint32_t>       touched; ///< three accounts per transaction
+};
+
+static fc::microseconds run_current( workload& w )
+{
+   object_database db;
+   undo_database undo( db );
+   undo.enable();
+   undo.set_max_size( 21 );
+   uint64_t next_new = w.accounts.size();
+   size_t t = 0;
+
+   auto start = fc::time_point::now();
+   for( uint32_t b = 0; b < w.blocks; ++b )
+   {
+      auto block_session = undo.start_undo_session();
+      for( uint32_t i = 0; i < w.transactions; ++i )
+      {
+         auto tx_session = undo.start_undo_session();
+         for( int k = 0; k < 3; ++k )
+            undo.on_modify( w.accounts[ w.touched[t++] ] );
+         account_object created;
+         created.id = object_id_type( account_object::space_id, account_object::type_id, next_new++ );
+         undo.on_create( created );
+         tx_session.merge();
+      }
+      block_session.commit();
+   }
+   return fc::time_point::now() - start;
+}
+
+static fc::microseconds run_legacy( workload& w )
+{
+   legacy_undo undo;
+   uint64_t next_new = w.accounts.size();
+   size_t t = 0;
+
+   auto start = fc::time_point::now();
+   for( uint32_t b = 0; b < w.blocks; ++b )
+   {
+      undo.start_session();
+      for( uint32_t i = 0; i < w.transactions; ++i )
+      {
+         undo.start_session();
+         for( int k = 0; k < 3; ++k )
+            undo.on_modify( w.accounts[ w.touched[t++] ] );
+         account_object created;
+         created.id = object_id_type( account_object::space_id, account_object::type_id, next_new++ );
+         undo.on_create( created );
+         undo.merge();
+      }
+   }
+   return fc::time_point::now() - start;
+}
+
+int main( int argc, char** argv )
+{
+   workload w;
+   w.blocks       = argc > 1 ? std::atoi( argv[1] ) : 200;
+   w.transactions = argc > 2 ? std::atoi( argv[2] ) : 1000;
+   const uint32_t objects = argc > 3 ? std::atoi( argv[3] ) : 100000;
+
+   w.accounts.resize( objects );
+   for( uint32_t i = 0; i < objects; ++i )
+   {
+      w.accounts[i].id = object_id_type( account_object::space_id, account_object::type_id, i );
+      w.accounts[i].name = "account" + std::to_string( i );
+   }
+   std::mt19937 rng( 42 );
+   std::uniform_int_distribution<uint32_t> pick( 0, objects - 1 );
+   w.touched.resize( size_t(w.blocks) * w.transactions * 3 );
+   for( auto& t : w.touched )
+      t = pick( rng );
+
+   const double txs = double(w.blocks) * w.transactions;
+   auto legacy  = run_legacy( w );
+   auto current = run_current( w );
+   std::cout << "blocks: " << w.blocks << ", transactions per block: " << w.transactions
+             << ", objects: " << objects << "\n";
+   std::cout << "legacy undo_state:  " << legacy.count() / 1000 << " ms, "
+             << uint64_t( legacy.count() * 1000.0 / txs ) << " ns per transaction\n";
+   std::cout << "current undo_state: " << current.count() / 1000 << " ms, "
+             << uint64_t( current.count() * 1000.0 / txs ) << " ns per transaction\n";
+   return 0;
+}
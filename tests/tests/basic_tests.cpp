@@ -31,8 +31,15 @@
 
 #include <graphene/db/simple_index.hpp>
 
+#include <graphene/net/compact_block.hpp>
+#include <graphene/net/message_oriented_connection.hpp>
+#include <graphene/net/stcp_socket.hpp>
+#include <graphene/net/sync_request_window.hpp>
+
 #include <fc/crypto/digest.hpp>
 #include <fc/crypto/hex.hpp>
+#include <fc/network/tcp_socket.hpp>
+#include <fc/thread/thread.hpp>
 #include "../common/database_fixture.hpp"
 
 #include <algorithm>
@@ -322,4 +329,237 @@ BOOST_AUTO_TEST_CASE( merkle_root )
    BOOST_CHECK( block.calculate_merkle_root() == c(dO) );
 }
 
+BOOST_AUTO_TEST_CASE( sync_request_window_test )
+{
+   graphene::net::sync_request_window window;
+   BOOST_CHECK_EQUAL( window.size(), GRAPHENE_NET_INITIAL_BLOCKS_PER_PEER_DURING_SYNCING );
+   BOOST_CHECK_EQUAL( window.batch_size(), 0 );
+
+   // requests made while the batch is outstanding join it and keep its start time
+   fc::time_point start = fc::time_point::now();
+   window.items_requested( 100, false, start );
+   window.items_requested( 100, true, start + fc::milliseconds(100) );
+   BOOST_CHECK_EQUAL( window.batch_size(), 200 );
+   BOOST_CHECK( window.batch_request_time() == start );
+
+   // 200 blocks in 200ms, 500 fit in the target duration, the window moves halfway there
+   fc::microseconds duration = window.batch_completed( start + fc::milliseconds(200), fc::milliseconds(10), GRAPHENE_NET_MAX_SYNC_REQUEST_WINDOW );
+   BOOST_CHECK_EQUAL( duration.count(), fc::milliseconds(200).count() );
+   BOOST_CHECK_EQUAL( window.size(), 350 );
+   BOOST_CHECK_EQUAL( window.batch_size(), 0 );
+   // nothing left to measure
+   BOOST_CHECK_EQUAL( window.batch_completed( start + fc::seconds(1), fc::milliseconds(10), GRAPHENE_NET_MAX_SYNC_REQUEST_WINDOW ).count(), 0 );
+   BOOST_CHECK_EQUAL( window.size(), 350 );
+
+   // a slow batch shrinks the window
+   start += fc::seconds(1);
+   window.items_requested( 350, false, start );
+   window.batch_completed( start + fc::seconds(10), fc::milliseconds(10), GRAPHENE_NET_MAX_SYNC_REQUEST_WINDOW );
+   BOOST_CHECK_EQUAL( window.size(), (350 + 350 * 500 / 10000) / 2 );
+
+   // a long round trip lengthens the target to four round trips
+   uint32_t size = window.size();
+   start += fc::seconds(10);
+   window.items_requested( size, false, start );
+   window.batch_completed( start + fc::seconds(1), fc::seconds(1), GRAPHENE_NET_MAX_SYNC_REQUEST_WINDOW );
+   BOOST_CHECK_EQUAL( window.size(), (size + size * 4) / 2 );
+
+   // the window stays within its bounds
+   for( int i = 0; i < 10; ++i )
+   {
+      start += fc::seconds(1);
+      window.items_requested( window.size(), false, start );
+      window.batch_completed( start, fc::milliseconds(10), GRAPHENE_NET_MAX_SYNC_REQUEST_WINDOW );
+   }
+   BOOST_CHECK_EQUAL( window.size(), GRAPHENE_NET_MAX_SYNC_REQUEST_WINDOW );
+   start += fc::seconds(1);
+   window.items_requested( 1, false, start );
+   window.batch_completed( start, fc::milliseconds(10), 100 );
+   BOOST_CHECK_EQUAL( window.size(), 100 );
+   for( int i = 0; i < 10; ++i )
+   {
+      start += fc::seconds(100);
+      window.items_requested( 1, false, start );
+      window.batch_completed( start + fc::seconds(100), fc::milliseconds(10), GRAPHENE_NET_MAX_SYNC_REQUEST_WINDOW );
+   }
+   BOOST_CHECK_EQUAL( window.size(), GRAPHENE_NET_MIN_BLOCKS_PER_PEER_DURING_SYNCING );
+
+   // a request made when nothing is outstanding starts a new batch
+   start += fc::seconds(1);
+   window.items_requested( 5, true, start );
+   window.items_requested( 7, false, start + fc::seconds(1) );
+   BOOST_CHECK_EQUAL( window.batch_size(), 7 );
+   BOOST_CHECK( window.batch_request_time() == start + fc::seconds(1) );
+}
+
+BOOST_AUTO_TEST_CASE( compact_block_test )
+{
+   using namespace graphene::net;
+
+   // only peers that know compact blocks are asked for them
+   BOOST_CHECK_EQUAL( block_item_type_for_peer( GRAPHENE_NET_COMPACT_BLOCKS_PROTOCOL_VERSION - 1 ), (uint32_t)block_message_type );
+   BOOST_CHECK_EQUAL( block_item_type_for_peer( GRAPHENE_NET_COMPACT_BLOCKS_PROTOCOL_VERSION ), (uint32_t)compact_block_message_type );
+
+   signed_block block;
+   block.timestamp = fc::time_point_sec( 1000 );
+   for( uint16_t i = 0; i < 3; ++i )
+   {
+      signed_transaction tx;
+      tx.ref_block_num = i;
+      tx.expiration = fc::time_point_sec( 2000 );
+      block.transactions.push_back( tx );
+   }
+   const item_hash_t hash = message( block_message( block ) ).id();
+   const compact_block_message compact( hash, block );
+   BOOST_REQUIRE_EQUAL( compact.transaction_ids.size(), 3u );
+
+   std::map< transaction_id_type, signed_transaction > mempool;
+   auto look_up = [&mempool]( const transaction_id_type& id ) {
+      auto itr = mempool.find( id );
+      return itr == mempool.end() ? fc::optional<signed_transaction>() : fc::optional<signed_transaction>( itr->second );
+   };
+
+   // every transaction is known
+   for( const auto& tx : block.transactions )
+      mempool[ tx.id() ] = tx;
+   {
+      partial_compact_block partial( compact );
+      partial.look_up( look_up );
+      BOOST_CHECK( partial.complete() );
+      fc::optional<message> rebuilt = partial.rebuilt_message( hash );
+      BOOST_REQUIRE( rebuilt );
+      BOOST_CHECK( rebuilt->as<block_message>().block.id() == block.id() );
+   }
+
+   // the first transaction comes from the mempool, the last from the client, the middle one from the peer by index
+   mempool.clear();
+   mempool[ block.transactions[0].id() ] = block.transactions[0];
+   {
+      partial_compact_block partial( compact );
+      partial.look_up( look_up );
+      BOOST_REQUIRE_EQUAL( partial.missing_transaction_indices().size(), 2u );
+      std::vector< transaction_id_type > ids = partial.missing_transaction_ids();
+      BOOST_CHECK( ids[1] == block.transactions[2].id() );
+      partial.fill_in( { fc::optional<signed_transaction>(), fc::optional<signed_transaction>( block.transactions[2] ) } );
+      BOOST_REQUIRE_EQUAL( partial.missing_transaction_indices().size(), 1u );
+      BOOST_CHECK_EQUAL( partial.missing_transaction_indices()[0], 1u );
+
+      fc::optional<block_transactions_message> reply = select_block_transactions( hash, block, partial.missing_transaction_indices() );
+      BOOST_REQUIRE( reply );
+      BOOST_CHECK( reply->block_message_hash == hash );
+      BOOST_REQUIRE_EQUAL( reply->transactions.size(), 1u );
+      BOOST_CHECK( reply->transactions[0].id() == block.transactions[1].id() );
+      // an answer that doesn't fit the request is refused
+      BOOST_CHECK( !partial.add_missing_transactions( block.transactions ) );
+      BOOST_CHECK( partial.add_missing_transactions( reply->transactions ) );
+      BOOST_CHECK( partial.complete() );
+      BOOST_CHECK( partial.rebuilt_message( hash ) );
+   }
+   BOOST_CHECK( !select_block_transactions( hash, block, { 0, 3 } ) );
+
+   // ids don't cover signatures, a differently signed copy rebuilds a different block
+   mempool.clear();
+   for( const auto& tx : block.transactions )
+      mempool[ tx.id() ] = tx;
+   mempool[ block.transactions[1].id() ].signatures.push_back( fc::ecc::compact_signature() );
+   {
+      partial_compact_block partial( compact );
+      partial.look_up( look_up );
+      BOOST_CHECK( partial.complete() );
+      BOOST_CHECK( !partial.rebuilt_message( hash ) );
+   }
+}
+
+BOOST_AUTO_TEST_CASE( stcp_socket_read_ahead_test )
+{
+   using namespace graphene::net;
+
+   fc::tcp_server server;
+   server.listen( fc::ip::endpoint( fc::ip::address( "127.0.0.1" ), 0 ) );
+   stcp_socket client;
+   stcp_socket served;
+   fc::future<void> accepted = fc::async( [&]() {
+      server.accept( served.get_socket() );
+      served.accept();
+   }, "accept" );
+   client.connect_to( server.get_local_endpoint() );
+   accepted.wait();
+
+   // a 16 byte header, its body is served from what was read ahead with it
+   char sent[64];
+   for( size_t i = 0; i < sizeof(sent); ++i )
+      sent[i] = char( i );
+   client.write( sent, sizeof(sent) );
+   client.flush();
+   char received[1024];
+   BOOST_CHECK_EQUAL( served.readsome( received, 16 ), 16u );
+   served.read( received + 16, sizeof(sent) - 16 );
+   BOOST_CHECK( std::equal( sent, sent + sizeof(sent), received ) );
+
+   // a read larger than the data that is ready returns what there is
+   client.write( sent, 32 );
+   client.flush();
+   size_t n = served.readsome( received, sizeof(received) );
+   BOOST_CHECK( n > 0 && n <= 32 && n % 16 == 0 );
+   if( n < 32 )
+      served.read( received + n, 32 - n );
+   BOOST_CHECK( std::equal( sent, sent + 32, received ) );
+
+   client.close();
+   served.close();
+}
+
+BOOST_AUTO_TEST_CASE( send_messages_batch_test )
+{
+   using namespace graphene::net;
+
+   struct collecting_delegate : message_oriented_connection_delegate
+   {
+      std::vector< message > received;
+      virtual void on_message( message_oriented_connection*, const message& m ) override { received.push_back( m ); }
+      virtual void on_connection_closed( message_oriented_connection* ) override {}
+   };
+   collecting_delegate client_delegate;
+   collecting_delegate served_delegate;
+
+   fc::tcp_server server;
+   server.listen( fc::ip::endpoint( fc::ip::address( "127.0.0.1" ), 0 ) );
+   message_oriented_connection client( &client_delegate );
+   message_oriented_connection served( &served_delegate );
+   fc::future<void> accepted = fc::async( [&]() {
+      server.accept( served.get_socket() );
+      served.accept();
+   }, "accept" );
+   client.connect_to( server.get_local_endpoint() );
+   accepted.wait();
+
+   // sizes around the header, the padding and the read ahead buffer
+   std::vector< message > batch;
+   for( uint32_t size : { 0u, 5u, 8u, 9u, 100u, 20000u, 16u } )
+   {
+      message m;
+      m.msg_type = 1000 + batch.size();
+      m.size = size;
+      m.data.assign( size, char( batch.size() + 1 ) );
+      batch.push_back( m );
+   }
+   client.send_messages( batch );
+   client.send_message( batch[1] );
+   for( int i = 0; i < 500 && served_delegate.received.size() < batch.size() + 1; ++i )
+      fc::usleep( fc::milliseconds( 10 ) );
+
+   BOOST_REQUIRE_EQUAL( served_delegate.received.size(), batch.size() + 1 );
+   batch.push_back( batch[1] );
+   for( size_t i = 0; i < batch.size(); ++i )
+   {
+      BOOST_CHECK_EQUAL( served_delegate.received[i].msg_type, batch[i].msg_type );
+      BOOST_CHECK_EQUAL( served_delegate.received[i].size, batch[i].size );
+      BOOST_CHECK( served_delegate.received[i].data == batch[i].data );
+   }
+   BOOST_CHECK_EQUAL( client.get_total_bytes_sent(), served.get_total_bytes_received() );
+
+   client.close_connection();
+   served.close_connection();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -32,6 +32,11 @@
 #include <graphene/utilities/tempdir.hpp>
 
 #include <fc/crypto/digest.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <thread>
 
 #include "../common/database_fixture.hpp"
 
@@ -100,6 +105,217 @@ BOOST_AUTO_TEST_CASE( block_database_test )
    }
 }
 
+BOOST_AUTO_TEST_CASE( block_database_mmap_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      block_database bdb;
+      bdb.open( data_dir.path(), true );
+      FC_ASSERT( bdb.is_open() );
+      FC_ASSERT( bdb.is_mmap_enabled() );
+      FC_ASSERT( !bdb.last().valid() );
+      FC_ASSERT( !bdb.fetch_by_number( 1 ).valid() );
+
+      signed_block b;
+      vector<block_id_type> ids;
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         bdb.store( b.id(), b );
+         ids.push_back( b.id() );
+
+         FC_ASSERT( bdb.contains( b.id() ) );
+         FC_ASSERT( bdb.fetch_block_id( i+1 ) == b.id() );
+         auto fetch = bdb.fetch_by_number( i+1 );
+         FC_ASSERT( fetch.valid() );
+         FC_ASSERT( fetch->witness == b.witness );
+         fetch = bdb.fetch_optional( b.id() );
+         FC_ASSERT( fetch.valid() );
+         FC_ASSERT( fetch->witness == b.witness );
+      }
+
+      // concurrent readers while the writer keeps appending
+      std::atomic<bool> failed( false );
+      std::vector<std::thread> readers;
+      for( int t = 0; t < 4; ++t )
+         readers.emplace_back( [&bdb,&ids,&failed]() {
+            for( int round = 0; round < 50; ++round )
+               for( uint32_t i = 0; i < ids.size(); ++i )
+               {
+                  auto blk = bdb.fetch_by_number( i+1 );
+                  if( !blk.valid() || blk->id() != ids[i] || !bdb.contains( ids[i] ) )
+                     failed = true;
+               }
+         });
+      signed_block extra = b;
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         extra.previous = extra.id();
+         bdb.store( extra.id(), extra );
+      }
+      for( auto& t : readers ) t.join();
+      FC_ASSERT( !failed );
+
+      bdb.remove( extra.id() );
+      FC_ASSERT( !bdb.contains( extra.id() ) );
+      FC_ASSERT( !bdb.fetch_optional( extra.id() ).valid() );
+
+      bdb.close();
+      bdb.open( data_dir.path(), true );
+      auto last = bdb.last();
+      FC_ASSERT( last );
+      FC_ASSERT( last->id() == extra.previous );
+
+      for( uint32_t i = 0; i < ids.size(); ++i )
+      {
+         auto blk = bdb.fetch_by_number( i+1 );
+         FC_ASSERT( blk.valid() );
+         FC_ASSERT( blk->id() == ids[i] );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_compression_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      signed_block b;
+      {
+         signed_transaction trx;
+         transfer_operation op;
+         op.from = "suzy";
+         op.to = "colette";
+         op.amount = asset( 100, MUSE_SYMBOL );
+         op.memo = string( 200, 'x' );
+         for( int i = 0; i < 20; ++i )
+            trx.operations.push_back( op );
+         b.transactions.push_back( trx );
+      }
+      vector<block_id_type> ids;
+      vector< vector<char> > packed;
+      auto append = [&]( block_database& bdb ) {
+         if( !ids.empty() ) b.previous = b.id();
+         b.witness = witness_id_type( ids.size() + 1 );
+         bdb.store( b.id(), b );
+         ids.push_back( b.id() );
+         packed.push_back( fc::raw::pack_to_vector( b ) );
+      };
+
+      // raw blocks written before compression was enabled stay readable
+      block_database bdb;
+      bdb.open( data_dir.path() );
+      FC_ASSERT( !bdb.is_compression_enabled() );
+      for( int i = 0; i < 5; ++i )
+         append( bdb );
+      bdb.close();
+
+      bdb.open( data_dir.path(), false, true );
+      FC_ASSERT( bdb.is_compression_enabled() );
+      MUSE_REQUIRE_THROW( bdb.set_dictionary( vector<char>( 16, 'x' ) ), fc::exception );
+      for( int i = 0; i < 5; ++i )
+         append( bdb );
+      bdb.close();
+
+      bdb.open( data_dir.path(), true );
+      uint64_t raw_size = 0;
+      for( uint32_t i = 0; i < ids.size(); ++i )
+      {
+         auto blk = bdb.fetch_by_number( i+1 );
+         FC_ASSERT( blk.valid() );
+         FC_ASSERT( blk->id() == ids[i] );
+         FC_ASSERT( bdb.fetch_optional( ids[i] ).valid() );
+         raw_size += packed[i].size();
+      }
+      FC_ASSERT( bdb.last_id().valid() && *bdb.last_id() == ids.back() );
+      bdb.close();
+      BOOST_CHECK_LT( fc::file_size( data_dir.path() / "blocks" ), raw_size );
+
+      // with a preset dictionary
+      fc::temp_directory dict_dir( graphene::utilities::temp_directory_path() );
+      vector<char> dictionary = block_database::train_dictionary( packed );
+      FC_ASSERT( !dictionary.empty() );
+      ids.clear();
+      b.previous = block_id_type();
+      block_database dbdb;
+      dbdb.open( dict_dir.path(), false, true );
+      dbdb.set_dictionary( dictionary );
+      for( int i = 0; i < 5; ++i )
+         append( dbdb );
+      dbdb.close();
+      dbdb.open( dict_dir.path() );
+      FC_ASSERT( dbdb.get_dictionary() == dictionary );
+      for( uint32_t i = 0; i < ids.size(); ++i )
+      {
+         auto blk = dbdb.fetch_by_number( i+1 );
+         FC_ASSERT( blk.valid() );
+         FC_ASSERT( blk->id() == ids[i] );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_id_index_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      block_database bdb;
+      bdb.open( data_dir.path() );
+      signed_block b;
+      vector<block_id_type> ids;
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         bdb.store( b.id(), b );
+         ids.push_back( b.id() );
+      }
+
+      signed_block other = b;
+      other.witness = witness_id_type(100);
+      FC_ASSERT( bdb.contains( ids[3] ) );
+      FC_ASSERT( !bdb.contains( other.id() ) );
+      FC_ASSERT( !bdb.fetch_optional( other.id() ).valid() );
+      auto stats = bdb.get_id_index_stats();
+      BOOST_CHECK_EQUAL( 11, stats.index_size );
+      BOOST_CHECK_EQUAL( 1, stats.hits );
+      BOOST_CHECK_EQUAL( 2, stats.misses );
+
+      bdb.remove( ids[9] );
+      FC_ASSERT( !bdb.contains( ids[9] ) );
+      FC_ASSERT( bdb.fetch_block_id( 10 ) == ids[9] );
+      bdb.close();
+
+      // the index is rebuilt from the index file
+      bdb.open( data_dir.path() );
+      for( uint32_t i = 0; i < 9; ++i )
+      {
+         FC_ASSERT( bdb.contains( ids[i] ) );
+         FC_ASSERT( bdb.fetch_block_id( i+1 ) == ids[i] );
+         FC_ASSERT( bdb.fetch_optional( ids[i] ).valid() );
+      }
+      FC_ASSERT( !bdb.contains( ids[9] ) );
+      MUSE_REQUIRE_THROW( bdb.fetch_block_id( 11 ), fc::key_not_found_exception );
+
+      // replacing a block by one with the same number replaces its id
+      bdb.store( other.id(), other );
+      FC_ASSERT( bdb.contains( other.id() ) );
+      FC_ASSERT( !bdb.contains( ids[9] ) );
+      FC_ASSERT( bdb.fetch_block_id( 10 ) == other.id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 static const fc::ecc::private_key& init_account_priv_key()
 {
    static const auto priv_key = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "init_key" ) ) );
@@ -186,6 +402,180 @@ BOOST_AUTO_TEST_CASE( generate_empty_blocks )
    }
 }
 
+BOOST_AUTO_TEST_CASE( state_checkpoint_recovery )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      genesis_state_type genesis;
+      genesis.init_supply = INITIAL_TEST_SUPPLY;
+
+      database db;
+      db.set_block_log_mmap( true ); // flushes every stored block
+      db.set_state_checkpoint_interval( 10 );
+      db.open( data_dir.path(), genesis, "TEST" );
+      init_witness_keys( db );
+      while( db.get_dynamic_global_properties().last_irreversible_block_num < 50 )
+         db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key(), database::skip_nothing );
+      BOOST_REQUIRE( fc::exists( data_dir.path() / "object_database" / "checkpoints" / "10" ) );
+
+      // db is never closed, as if the node had crashed
+      database db2;
+      db2.open( data_dir.path(), genesis, "TEST" );
+      BOOST_CHECK_EQUAL( db2.head_block_num(), db.head_block_num() );
+      BOOST_CHECK( db2.head_block_id() == db.head_block_id() );
+      BOOST_CHECK( db2.get_account( MUSE_INIT_MINER_NAME ).balance == db.get_account( MUSE_INIT_MINER_NAME ).balance );
+      BOOST_CHECK( db2.get_witness( MUSE_INIT_MINER_NAME ).signing_key == init_account_pub_key() );
+      db2.generate_block( db2.get_slot_time(1), db2.get_scheduled_witness(1), init_account_priv_key(), database::skip_nothing );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( state_checkpoint_fold )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      genesis_state_type genesis;
+      genesis.init_supply = INITIAL_TEST_SUPPLY;
+
+      database db;
+      db.set_block_log_mmap( true ); // flushes every stored block
+      db.set_state_checkpoint_interval( 2 );
+      db.open( data_dir.path(), genesis, "TEST" );
+      init_witness_keys( db );
+      while( db.get_dynamic_global_properties().last_irreversible_block_num < 200 )
+         db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key(), database::skip_nothing );
+
+      // far more checkpoints than that have been written, they were folded
+      size_t files = 0;
+      const fc::path dir = data_dir.path() / "object_database" / "checkpoints";
+      for( fc::directory_iterator itr( dir ); itr != fc::directory_iterator(); ++itr )
+         ++files;
+      BOOST_CHECK_GT( files, 0u );
+      BOOST_CHECK_LT( files, 16u );
+
+      // db is never closed, as if the node had crashed
+      database db2;
+      db2.open( data_dir.path(), genesis, "TEST" );
+      BOOST_CHECK_EQUAL( db2.head_block_num(), db.head_block_num() );
+      BOOST_CHECK( db2.head_block_id() == db.head_block_id() );
+      BOOST_CHECK( db2.get_account( MUSE_INIT_MINER_NAME ).balance == db.get_account( MUSE_INIT_MINER_NAME ).balance );
+      db2.generate_block( db2.get_slot_time(1), db2.get_scheduled_witness(1), init_account_priv_key(), database::skip_nothing );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( state_checkpoint_inconsistent )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      genesis_state_type genesis;
+      genesis.init_supply = INITIAL_TEST_SUPPLY;
+
+      database db;
+      db.set_block_log_mmap( true ); // flushes every stored block
+      db.set_state_checkpoint_interval( 10 );
+      db.open( data_dir.path(), genesis, "TEST" );
+      init_witness_keys( db );
+      while( db.get_dynamic_global_properties().last_irreversible_block_num < 50 )
+         db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key(), database::skip_nothing );
+      const fc::path checkpoint = data_dir.path() / "object_database" / "checkpoints" / "10";
+      BOOST_REQUIRE( fc::exists( checkpoint ) );
+
+      // claim the checkpoint leads to block 11, which is in the block log but not where its changes lead
+      {
+         const block_id_type wrong_id = db.get_block_id_for_num( 11 );
+         std::fstream f( checkpoint.generic_string(), std::ios::in | std::ios::out | std::ios::binary );
+         f.seekp( 2 * sizeof(uint32_t) ); // after base_block_num and block_num
+         f.write( (const char*)&wrong_id, sizeof(wrong_id) );
+      }
+
+      // the checkpoints are dropped and the blocks replayed from the last full save
+      database db2;
+      db2.open( data_dir.path(), genesis, "TEST" );
+      BOOST_CHECK( !fc::exists( checkpoint ) );
+      BOOST_CHECK_EQUAL( db2.head_block_num(), db.head_block_num() );
+      BOOST_CHECK( db2.head_block_id() == db.head_block_id() );
+      BOOST_CHECK( db2.get_account( MUSE_INIT_MINER_NAME ).balance == db.get_account( MUSE_INIT_MINER_NAME ).balance );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( state_snapshot_sync )
+{
+   try {
+      fc::temp_directory data_dir1( graphene::utilities::temp_directory_path() );
+      fc::temp_directory data_dir2( graphene::utilities::temp_directory_path() );
+      genesis_state_type genesis;
+      genesis.init_supply = INITIAL_TEST_SUPPLY;
+
+      database db1;
+      db1.set_state_snapshot_interval( 20, 4096 );
+      db1.open( data_dir1.path(), genesis, "TEST" );
+      init_witness_keys( db1 );
+      // written by the worker thread, offered after a later block
+      for( uint32_t i = 0; i < 200 && db1.get_state_snapshot_info().block_num == 0; ++i )
+         db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key(), database::skip_nothing );
+      const state_snapshot_info snapshot = db1.get_state_snapshot_info();
+      BOOST_CHECK_EQUAL( snapshot.block_num, 20u );
+      BOOST_CHECK( snapshot.block_id == db1.get_block_id_for_num( 20 ) );
+      BOOST_REQUIRE( fc::exists( snapshot.file ) );
+      BOOST_CHECK_EQUAL( snapshot.size, fc::file_size( snapshot.file ) );
+
+      // hashed when it was written
+      std::string data;
+      fc::read_file_contents( snapshot.file, data );
+      BOOST_CHECK( snapshot.hash == fc::sha256::hash( data.data(), data.size() ) );
+      BOOST_CHECK_EQUAL( snapshot.chunk_size, 4096u );
+      BOOST_REQUIRE_EQUAL( snapshot.chunk_hashes.size(), ( data.size() + 4095 ) / 4096 );
+      BOOST_CHECK( snapshot.chunk_hashes.front() == fc::sha256::hash( data.data(), 4096 ) );
+      const size_t last_offset = ( snapshot.chunk_hashes.size() - 1 ) * 4096;
+      BOOST_CHECK( snapshot.chunk_hashes.back() == fc::sha256::hash( data.data() + last_offset, data.size() - last_offset ) );
+
+      // objects of other layouts are refused before the state is touched
+      {
+         fc::temp_directory data_dir3( graphene::utilities::temp_directory_path() );
+         database db3;
+         db3.open( data_dir3.path(), genesis, "OTHER" );
+         BOOST_CHECK_THROW( db3.load_state_snapshot( snapshot.file, snapshot.block_id ), fc::exception );
+         BOOST_CHECK_EQUAL( db3.head_block_num(), 0u );
+         BOOST_CHECK_NO_THROW( db3.get_account( MUSE_INIT_MINER_NAME ) );
+      }
+
+      // a fresh database continues from the snapshot with the blocks following it
+      database db2;
+      db2.open( data_dir2.path(), genesis, "TEST" );
+      BOOST_CHECK_THROW( db2.load_state_snapshot( snapshot.file, block_id_type() ), fc::exception );
+      db2.load_state_snapshot( snapshot.file, snapshot.block_id );
+      BOOST_CHECK( db2.head_block_id() == snapshot.block_id );
+      BOOST_CHECK( db2.get_block_id_for_num( 20 ) == snapshot.block_id );
+      for( uint32_t n = snapshot.block_num + 1; n <= db1.head_block_num(); ++n )
+         PUSH_BLOCK( db2, *db1.fetch_block_by_number( n ) );
+      PUSH_BLOCK( db2, db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key(), database::skip_nothing ) );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+      BOOST_CHECK( db2.get_account( MUSE_INIT_MINER_NAME ).balance == db1.get_account( MUSE_INIT_MINER_NAME ).balance );
+      BOOST_CHECK( db2.get_witness( MUSE_INIT_MINER_NAME ).signing_key == init_account_pub_key() );
+
+      // only a database without blocks accepts a snapshot
+      BOOST_CHECK_THROW( db1.load_state_snapshot( snapshot.file, snapshot.block_id ), fc::exception );
+
+      // the hashes are not computed again after a restart
+      db1.close();
+      db1.open( data_dir1.path(), genesis, "TEST" );
+      BOOST_CHECK( db1.get_state_snapshot_info().block_id == snapshot.block_id );
+      BOOST_CHECK( db1.get_state_snapshot_info().hash == snapshot.hash );
+      BOOST_CHECK( db1.get_state_snapshot_info().chunk_hashes == snapshot.chunk_hashes );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( undo_block )
 {
    try {
@@ -476,6 +866,184 @@ BOOST_AUTO_TEST_CASE( duplicate_transactions )
    }
 }
 
+BOOST_AUTO_TEST_CASE( parallel_signature_recovery )
+{
+   try {
+      fc::temp_directory dir1( graphene::utilities::temp_directory_path() ),
+                         dir2( graphene::utilities::temp_directory_path() );
+
+      genesis_state_type genesis;
+      genesis.init_supply = INITIAL_TEST_SUPPLY;
+
+      database db1,
+               db2;
+      db1.open(dir1.path(), genesis, "TEST" );
+      init_witness_keys( db1 );
+      db2.set_signature_threads( 4 );
+      db2.open(dir2.path(), genesis, "TEST" );
+      init_witness_keys( db2 );
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+
+      signed_transaction trx;
+      account_create_operation cop;
+      cop.new_account_name = "alice";
+      cop.creator = MUSE_INIT_MINER_NAME;
+      cop.owner = authority(1, init_account_pub_key(), 1);
+      cop.active = cop.owner;
+      trx.operations.push_back(cop);
+      trx.set_expiration( db1.head_block_time() + MUSE_MAX_TIME_UNTIL_EXPIRATION );
+      trx.sign( init_account_priv_key(), db1.get_chain_id() );
+      PUSH_TX( db1, trx );
+      for( int i = 1; i <= 10; ++i )
+      {
+         trx = decltype(trx)();
+         transfer_operation t;
+         t.from = MUSE_INIT_MINER_NAME;
+         t.to = "alice";
+         t.amount = asset(i,MUSE_SYMBOL);
+         trx.operations.push_back(t);
+         trx.set_expiration( db1.head_block_time() + MUSE_MAX_TIME_UNTIL_EXPIRATION );
+         trx.sign( init_account_priv_key(), db1.get_chain_id() );
+         PUSH_TX( db1, trx );
+      }
+
+      auto b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key(), database::skip_nothing );
+      BOOST_CHECK_EQUAL( 11, b.transactions.size() );
+      // applying the block reuses the keys recovered when the transactions were pushed
+      BOOST_CHECK_GE( db1.get_signature_cache_stats().hits, 11 );
+      PUSH_BLOCK( db2, b );
+      BOOST_CHECK_EQUAL(db2.get_balance( "alice", MUSE_SYMBOL ).amount.value, 55);
+
+      // a wrongly signed transaction among correctly signed ones still rejects the block
+      for( int i = 1; i <= 5; ++i )
+      {
+         trx = decltype(trx)();
+         transfer_operation t;
+         t.from = MUSE_INIT_MINER_NAME;
+         t.to = "alice";
+         t.amount = asset(100+i,MUSE_SYMBOL);
+         trx.operations.push_back(t);
+         trx.set_expiration( db1.head_block_time() + MUSE_MAX_TIME_UNTIL_EXPIRATION );
+         trx.sign( i == 3 ? fc::ecc::private_key::generate() : init_account_priv_key(), db1.get_chain_id() );
+         PUSH_TX( db1, trx, skip_sigs );
+      }
+      b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key(), skip_sigs );
+      BOOST_CHECK_EQUAL( 5, b.transactions.size() );
+      MUSE_CHECK_THROW( PUSH_BLOCK( db2, b ), fc::exception );
+      BOOST_CHECK_EQUAL(db2.get_balance( "alice", MUSE_SYMBOL ).amount.value, 55);
+      BOOST_CHECK( db2.head_block_id() != b.id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( signature_cache_test )
+{
+   try {
+      const chain_id_type& chain_id = MUSE_CHAIN_ID;
+      signature_cache cache( 2 );
+
+      signed_transaction trx;
+      transfer_operation t;
+      t.from = MUSE_INIT_MINER_NAME;
+      t.to = "alice";
+      t.amount = asset(1,MUSE_SYMBOL);
+      trx.operations.push_back(t);
+      trx.sign( init_account_priv_key(), chain_id );
+
+      auto keys = cache.get_signature_keys( trx, chain_id );
+      BOOST_CHECK( keys == trx.get_signature_keys( chain_id ) );
+      BOOST_CHECK( cache.get_signature_keys( trx, chain_id ) == keys );
+      auto stats = cache.get_stats();
+      BOOST_CHECK_EQUAL( 1, stats.size );
+      BOOST_CHECK_EQUAL( 1, stats.hits );
+      BOOST_CHECK_EQUAL( 1, stats.misses );
+
+      // a different signature set is a different entry
+      signed_transaction two_sigs = trx;
+      two_sigs.sign( fc::ecc::private_key::generate(), chain_id );
+      BOOST_CHECK_EQUAL( 2, cache.get_signature_keys( two_sigs, chain_id ).size() );
+
+      // failures are not cached
+      signed_transaction dup_sig = trx;
+      dup_sig.signatures.push_back( trx.signatures[0] );
+      MUSE_REQUIRE_THROW( cache.get_signature_keys( dup_sig, chain_id ), fc::exception );
+      MUSE_REQUIRE_THROW( cache.get_signature_keys( dup_sig, chain_id ), fc::exception );
+
+      // the oldest entry is evicted
+      signed_transaction other = trx;
+      other.operations[0].get<transfer_operation>().amount = asset(2,MUSE_SYMBOL);
+      other.signatures.clear();
+      other.sign( init_account_priv_key(), chain_id );
+      cache.get_signature_keys( other, chain_id );
+      stats = cache.get_stats();
+      BOOST_CHECK_EQUAL( 2, stats.size );
+      cache.get_signature_keys( trx, chain_id );
+      BOOST_CHECK_EQUAL( stats.misses + 1, cache.get_stats().misses );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( precomputed_block_test )
+{
+   try {
+      const chain_id_type& chain_id = MUSE_CHAIN_ID;
+
+      signed_block b;
+      b.timestamp = MUSE_GENESIS_TIME;
+      b.witness = MUSE_INIT_MINER_NAME;
+      for( int i = 1; i <= 3; i++ )
+      {
+         signed_transaction trx;
+         trx.set_expiration( b.timestamp + MUSE_MAX_TIME_UNTIL_EXPIRATION );
+         transfer_operation t;
+         t.from = MUSE_INIT_MINER_NAME;
+         t.to = "alice";
+         t.amount = asset( i, MUSE_SYMBOL );
+         trx.operations.push_back( t );
+         trx.sign( init_account_priv_key(), chain_id );
+         b.transactions.push_back( trx );
+      }
+      b.transaction_merkle_root = b.calculate_merkle_root();
+      b.sign( init_account_priv_key() );
+
+      for( const auto& trx : b.transactions )
+      {
+         precomputed_transaction ptrx( trx );
+         BOOST_CHECK( ptrx.id() == trx.id() );
+         BOOST_CHECK( ptrx.merkle_digest() == trx.merkle_digest() );
+         BOOST_CHECK_EQUAL( fc::raw::pack_size( trx ), ptrx.packed_size() );
+         BOOST_CHECK( precomputed_transaction::view( trx ).id() == trx.id() );
+      }
+
+      precomputed_block pb( b );
+      BOOST_CHECK( pb.id() == b.id() );
+      BOOST_CHECK( pb.calculate_merkle_root() == b.transaction_merkle_root );
+      BOOST_CHECK_EQUAL( fc::raw::pack_size( b ), pb.packed_size() );
+      BOOST_CHECK_EQUAL( b.transactions.size(), pb.transactions().size() );
+      BOOST_CHECK( pb.signee() == public_key_type( init_account_priv_key().get_public_key() ) );
+
+      // memoized values computed on another thread are seen by this one
+      precomputed_block prevalidated( b );
+      fc::thread worker( "prevalidate" );
+      worker.async( [&prevalidated]() { prevalidated.precompute(); } ).wait();
+      BOOST_CHECK( prevalidated.id() == b.id() );
+      BOOST_CHECK( prevalidated.calculate_merkle_root() == b.transaction_merkle_root );
+      BOOST_CHECK( prevalidated.signee() == pb.signee() );
+
+      signed_block empty;
+      BOOST_CHECK( precomputed_block( empty ).calculate_merkle_root() == checksum_type() );
+      BOOST_CHECK_EQUAL( fc::raw::pack_size( empty ), precomputed_block( empty ).packed_size() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( tapos )
 {
    try {
@@ -1213,4 +1781,175 @@ BOOST_FIXTURE_TEST_CASE( generate_block_size, clean_database_fixture )
    FC_LOG_AND_RETHROW()
 }
 
+BOOST_FIXTURE_TEST_CASE( generate_block_from_pending, clean_database_fixture )
+{
+   try
+   {
+      const uint32_t skip = database::skip_undo_history_check | database::skip_witness_signature;
+      const auto& produce = [&]() {
+         return db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, skip );
+      };
+      generate_block();
+      const int64_t start = db.get_balance( MUSE_TEMP_ACCOUNT, MUSE_SYMBOL ).amount.value;
+
+      signed_transaction tx;
+      transfer_operation op;
+      op.from = MUSE_INIT_MINER_NAME;
+      op.to = MUSE_TEMP_ACCOUNT;
+      for( int i = 1; i <= 3; i++ )
+      {
+         tx.clear();
+         op.amount = asset( i, MUSE_SYMBOL );
+         tx.operations.push_back( op );
+         tx.set_expiration( db.head_block_time() + MUSE_MAX_TIME_UNTIL_EXPIRATION );
+         tx.sign( init_account_priv_key, db.get_chain_id() );
+         db.push_transaction( tx, skip );
+      }
+
+      // every pending transaction was applied with the flags used for generating
+      signed_block block = produce();
+      BOOST_CHECK_EQUAL( 3, block.transactions.size() );
+      BOOST_CHECK_EQUAL( start + 6, db.get_balance( MUSE_TEMP_ACCOUNT, MUSE_SYMBOL ).amount.value );
+
+      // a transaction accepted with weaker checks is applied again and left out
+      tx.clear();
+      op.amount = asset( 10, MUSE_SYMBOL );
+      tx.operations.push_back( op );
+      tx.set_expiration( db.head_block_time() + MUSE_MAX_TIME_UNTIL_EXPIRATION );
+      tx.sign( fc::ecc::private_key::generate(), db.get_chain_id() );
+      db.push_transaction( tx, skip | database::skip_transaction_signatures | database::skip_authority_check );
+
+      tx.clear();
+      op.amount = asset( 20, MUSE_SYMBOL );
+      tx.operations.push_back( op );
+      tx.set_expiration( db.head_block_time() + MUSE_MAX_TIME_UNTIL_EXPIRATION );
+      tx.sign( init_account_priv_key, db.get_chain_id() );
+      db.push_transaction( tx, skip );
+
+      block = produce();
+      BOOST_CHECK_EQUAL( 1, block.transactions.size() );
+      BOOST_CHECK_EQUAL( start + 26, db.get_balance( MUSE_TEMP_ACCOUNT, MUSE_SYMBOL ).amount.value );
+
+      // transactions that do not fit behind the candidate are postponed to the next block
+      db.modify( db.get_dynamic_global_properties(), []( dynamic_global_property_object& gpo )
+      {
+         gpo.maximum_block_size = MUSE_MIN_BLOCK_SIZE_LIMIT;
+      });
+      tx.clear();
+      op.amount = asset( 1, MUSE_SYMBOL );
+      for( size_t i = 0; i < 2507; i++ )
+         tx.operations.push_back( op );
+      tx.set_expiration( db.head_block_time() + MUSE_MAX_TIME_UNTIL_EXPIRATION );
+      tx.sign( init_account_priv_key, db.get_chain_id() );
+      db.push_transaction( tx, skip );
+
+      tx.clear();
+      op.memo = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ123";
+      tx.operations.push_back( op );
+      tx.set_expiration( db.head_block_time() + MUSE_MAX_TIME_UNTIL_EXPIRATION );
+      tx.sign( init_account_priv_key, db.get_chain_id() );
+      db.push_transaction( tx, skip );
+
+      block = produce();
+      BOOST_CHECK_EQUAL( 1, block.transactions.size() );
+      BOOST_CHECK_EQUAL( start + 26 + 2507, db.get_balance( MUSE_TEMP_ACCOUNT, MUSE_SYMBOL ).amount.value );
+      block = produce();
+      BOOST_CHECK_EQUAL( 1, block.transactions.size() );
+      BOOST_CHECK_EQUAL( start + 26 + 2508, db.get_balance( MUSE_TEMP_ACCOUNT, MUSE_SYMBOL ).amount.value );
+   }
+   FC_LOG_AND_RETHROW()
+}
+
+BOOST_FIXTURE_TEST_CASE( recent_transaction_lookup, clean_database_fixture )
+{
+   try
+   {
+      signed_transaction tx;
+      transfer_operation op;
+      op.from = MUSE_INIT_MINER_NAME;
+      op.to = MUSE_TEMP_ACCOUNT;
+      op.amount = asset( 1, MUSE_SYMBOL );
+      tx.operations.push_back( op );
+      tx.set_expiration( db.head_block_time() + MUSE_MAX_TIME_UNTIL_EXPIRATION );
+      tx.sign( init_account_priv_key, db.get_chain_id() );
+      db.push_transaction( tx, 0 );
+
+      // pending transactions are found in the pending queue
+      BOOST_CHECK( db.get_recent_transaction( tx.id() ).id() == tx.id() );
+      MUSE_CHECK_THROW( db.get_recent_transaction( transaction_id_type() ), fc::exception );
+
+      // included transactions are read from their block
+      op.amount = asset( 2, MUSE_SYMBOL );
+      signed_transaction tx2;
+      tx2.operations.push_back( op );
+      tx2.set_expiration( db.head_block_time() + MUSE_MAX_TIME_UNTIL_EXPIRATION );
+      tx2.sign( init_account_priv_key, db.get_chain_id() );
+      db.push_transaction( tx2, 0 );
+      BOOST_CHECK( !db.find_recent_transaction( transaction_id_type() ).valid() );
+      BOOST_REQUIRE( db.find_recent_transaction( tx2.id() ).valid() );
+      BOOST_CHECK( db.find_recent_transaction( tx2.id() )->id() == tx2.id() );
+      BOOST_CHECK( db.find_recent_transaction( tx.id() )->id() == tx.id() );
+      generate_block();
+      BOOST_CHECK( db.get_recent_transaction( tx.id() ).id() == tx.id() );
+      BOOST_CHECK( db.get_recent_transaction( tx2.id() ).id() == tx2.id() );
+      BOOST_CHECK( db.get_recent_transaction( tx2.id() ).signatures == tx2.signatures );
+
+      // expired transactions are forgotten
+      generate_blocks( db.head_block_time() + MUSE_MAX_TIME_UNTIL_EXPIRATION + MUSE_BLOCK_INTERVAL );
+      BOOST_CHECK( !db.is_known_transaction( tx.id() ) );
+      MUSE_CHECK_THROW( db.get_recent_transaction( tx.id() ), fc::exception );
+   }
+   FC_LOG_AND_RETHROW()
+}
+
+BOOST_FIXTURE_TEST_CASE( block_profiler_test, clean_database_fixture )
+{
+   try
+   {
+      block_profiler& profiler = db.get_profiler();
+      generate_block();
+      BOOST_CHECK_EQUAL( 0, profiler.get_profile().blocks );
+
+      profiler.enable( true );
+      transfer( MUSE_INIT_MINER_NAME, MUSE_TEMP_ACCOUNT, 1 );
+      generate_block();
+
+      block_profile profile = profiler.get_profile();
+      BOOST_CHECK_EQUAL( 1, profile.blocks );
+      BOOST_REQUIRE_EQUAL( block_profiler::stage_count, profile.stages.size() );
+      BOOST_CHECK_EQUAL( "apply_transactions", profile.stages[block_profiler::apply_transactions].name );
+      // one sample per stage, update_virtual_supply runs twice per block but is recorded once
+      for( size_t i = 0; i < profile.stages.size(); ++i )
+         BOOST_CHECK_EQUAL( 1, profile.stages[i].count );
+      BOOST_REQUIRE_EQUAL( 1, profile.operations.size() );
+      BOOST_CHECK_EQUAL( "transfer_operation", profile.operations[0].name );
+      // pushing and generating are not timed, only applying the block
+      BOOST_CHECK_EQUAL( 1, profile.operations[0].count );
+
+      // the callback sees the complete block, a reset from there starts with the next block
+      profiler.reset();
+      block_profile seen;
+      profiler.set_block_callback( [&seen]( block_profiler& p ) {
+         seen = p.get_profile();
+         p.reset();
+      });
+      generate_block();
+      profiler.set_block_callback( nullptr );
+      BOOST_CHECK_EQUAL( 1, seen.blocks );
+      BOOST_CHECK_EQUAL( 1, seen.stages[block_profiler::notify_changed_objects].count );
+      profile = profiler.get_profile();
+      BOOST_CHECK_EQUAL( 0, profile.blocks );
+      BOOST_CHECK_EQUAL( 0, profile.stages[block_profiler::notify_changed_objects].count );
+
+      profiler.reset();
+      profiler.enable( false );
+      generate_block();
+      profile = profiler.get_profile();
+      BOOST_CHECK_EQUAL( 0, profile.blocks );
+      BOOST_CHECK_EQUAL( 0, profile.stages[block_profiler::apply_transactions].count );
+      BOOST_CHECK( profile.operations.empty() );
+   }
+   FC_LOG_AND_RETHROW()
+}
+
 BOOST_AUTO_TEST_SUITE_END()
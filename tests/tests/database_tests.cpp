@@ -25,6 +25,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include <muse/chain/database.hpp>
+#include <muse/chain/account_object.hpp>
 #include <muse/chain/content_object.hpp>
 #include <muse/chain/streaming_platform_objects.hpp>
 
@@ -107,4 +108,332 @@ BOOST_AUTO_TEST_CASE( merge_test )
    }
 }
 
+BOOST_AUTO_TEST_CASE( nested_undo_test )
+{
+   try {
+      database db;
+      const auto& sp1 = db.create<streaming_platform_object>( [&]( streaming_platform_object& obj ){
+          obj.owner = "one";
+      });
+      const auto& sp2 = db.create<streaming_platform_object>( [&]( streaming_platform_object& obj ){
+          obj.owner = "two";
+      });
+      const auto id1 = sp1.id;
+      const auto id2 = sp2.id;
+
+      auto block = db._undo_db.start_undo_session();
+      for( int i = 0; i < 100; ++i )
+      {
+         auto tx = db._undo_db.start_undo_session();
+         db.modify( db.get<streaming_platform_object>( id1 ), [i]( streaming_platform_object& obj ){
+            obj.url = std::to_string( i );
+         });
+         db.create<streaming_platform_object>( [i]( streaming_platform_object& obj ){
+             obj.owner = "new" + std::to_string( i );
+         });
+         if( i % 2 )
+            tx.merge();
+         else
+            tx.undo();
+      }
+      {
+         auto tx = db._undo_db.start_undo_session();
+         db.modify( db.get<streaming_platform_object>( id2 ), []( streaming_platform_object& obj ){
+            obj.url = "modified";
+         });
+         db.remove( db.get<streaming_platform_object>( id2 ) );
+         tx.merge();
+      }
+      BOOST_CHECK( db.find_object( id2 ) == nullptr );
+      BOOST_CHECK_EQUAL( "99", db.get<streaming_platform_object>( id1 ).url );
+      BOOST_CHECK_EQUAL( "new99", db.get_streaming_platform( "new99" ).owner );
+
+      block.undo();
+      BOOST_CHECK_EQUAL( "", db.get<streaming_platform_object>( id1 ).url );
+      BOOST_CHECK_EQUAL( "two", db.get<streaming_platform_object>( id2 ).owner );
+      BOOST_CHECK_EQUAL( "", db.get<streaming_platform_object>( id2 ).url );
+      BOOST_CHECK( db.find_streaming_platform( "new99" ) == nullptr );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( large_undo_session_test )
+{
+   try {
+      database db;
+      const uint32_t count = 3000; // well beyond the size at which undo maps switch to hashing
+      vector<object_id_type> ids;
+      for( uint32_t i = 0; i < count; ++i )
+         ids.push_back( db.create<streaming_platform_object>( [i]( streaming_platform_object& obj ){
+             obj.owner = "sp" + std::to_string( i );
+         }).id );
+
+      {
+         auto ses = db._undo_db.start_undo_session();
+         for( uint32_t i = 0; i < count; ++i )
+            db.modify( db.get<streaming_platform_object>( ids[i] ), [i]( streaming_platform_object& obj ){
+               obj.url = std::to_string( i );
+            });
+         for( uint32_t i = 0; i < count; i += 2 )
+            db.remove( db.get<streaming_platform_object>( ids[i] ) );
+         for( uint32_t i = 0; i < count; ++i )
+            db.create<streaming_platform_object>( [i]( streaming_platform_object& obj ){
+                obj.owner = "new" + std::to_string( i );
+            });
+         BOOST_CHECK( db.find_object( ids[0] ) == nullptr );
+         BOOST_CHECK_EQUAL( "1", db.get<streaming_platform_object>( ids[1] ).url );
+         ses.undo();
+      }
+      for( uint32_t i = 0; i < count; ++i )
+      {
+         BOOST_CHECK_EQUAL( "sp" + std::to_string( i ), db.get<streaming_platform_object>( ids[i] ).owner );
+         BOOST_CHECK_EQUAL( "", db.get<streaming_platform_object>( ids[i] ).url );
+      }
+      BOOST_CHECK( db.find_streaming_platform( "new0" ) == nullptr );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( serialized_undo_test )
+{
+   try {
+      database db;
+      const auto& acct = db.create<account_object>( []( account_object& a ){
+          a.name = "alice";
+          a.friends.insert( account_id_type(1) );
+          a.total_time_by_platform[ streaming_platform_id_type(3) ] = 5;
+      });
+      const auto id = acct.id;
+      BOOST_CHECK( acct.uses_serialized_undo() );
+
+      {
+         auto ses = db._undo_db.start_undo_session();
+         db.modify_social_graph( acct, []( account_object& a ){
+            a.total_listening_time += 10;
+            a.friends.insert( account_id_type(2) );
+            a.total_time_by_platform[ streaming_platform_id_type(3) ] += 10;
+         });
+         ses.undo();
+      }
+      const auto& restored = db.get<account_object>( id );
+      BOOST_CHECK_EQUAL( 0u, restored.total_listening_time );
+      BOOST_CHECK_EQUAL( 1u, restored.friends.size() );
+      BOOST_CHECK_EQUAL( 5u, restored.total_time_by_platform.at( streaming_platform_id_type(3) ) );
+
+      // modified in one session, removed in a merged child session
+      {
+         auto ses = db._undo_db.start_undo_session();
+         db.modify( restored, []( account_object& a ){ a.total_listening_time = 7; } );
+         {
+            auto tx = db._undo_db.start_undo_session();
+            db.remove( db.get<account_object>( id ) );
+            tx.merge();
+         }
+         BOOST_CHECK( db.find_object( id ) == nullptr );
+         ses.undo();
+      }
+      const auto& reinserted = db.get<account_object>( id );
+      BOOST_CHECK_EQUAL( "alice", reinserted.name );
+      BOOST_CHECK_EQUAL( 0u, reinserted.total_listening_time );
+      BOOST_CHECK_EQUAL( 1u, reinserted.friends.size() );
+
+      // a committed session keeps a diff, which has to survive a later session merged into it
+      {
+         auto ses = db._undo_db.start_undo_session();
+         db.modify( reinserted, []( account_object& a ){
+            a.total_listening_time = 3;
+            a.friends.insert( account_id_type(4) );
+         });
+         ses.commit();
+      }
+      {
+         auto ses = db._undo_db.start_undo_session();
+         db.modify( db.get<account_object>( id ), []( account_object& a ){
+            a.total_listening_time = 9;
+            a.friends.erase( account_id_type(1) );
+         });
+         ses.merge();
+      }
+      BOOST_CHECK_EQUAL( 9u, db.get<account_object>( id ).total_listening_time );
+      db._undo_db.pop_commit();
+      const auto& popped = db.get<account_object>( id );
+      BOOST_CHECK_EQUAL( 0u, popped.total_listening_time );
+      BOOST_CHECK_EQUAL( 1u, popped.friends.size() );
+      BOOST_CHECK( popped.friends.count( account_id_type(1) ) == 1 );
+      BOOST_CHECK_EQUAL( 5u, popped.total_time_by_platform.at( streaming_platform_id_type(3) ) );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( modify_fields_test )
+{
+   try {
+      database db;
+      const auto& acct = db.create<account_object>( []( account_object& a ){ a.name = "alice"; } );
+      {
+         auto ses = db._undo_db.start_undo_session();
+         db.modify_fields< GRAPHENE_DB_FIELD( account_object, total_listening_time ) >( acct, []( account_object& a ){
+            a.total_listening_time = 42;
+         });
+         BOOST_CHECK_EQUAL( 42u, db.get_account( "alice" ).total_listening_time );
+         ses.undo();
+      }
+      BOOST_CHECK_EQUAL( 0u, db.get_account( "alice" ).total_listening_time );
+
+#ifndef NDEBUG
+      // debug builds catch modifiers that change a field which is not listed
+      {
+         auto ses = db._undo_db.start_undo_session();
+         BOOST_CHECK_THROW( db.modify_fields< GRAPHENE_DB_FIELD( account_object, total_listening_time ) >( acct,
+                               []( account_object& a ){
+                                  a.total_listening_time = 42;
+                                  a.total_time_by_platform[ streaming_platform_id_type(1) ] = 42;
+                               }), fc::assert_exception );
+      }
+      BOOST_CHECK( db.get_account( "alice" ).total_time_by_platform.empty() );
+#endif
+
+      // a key field falls back to modify() and keeps the index ordered
+      const auto& c1 = db.create<content_object>( []( content_object& c ){ c.url = "ipfs://1"; c.times_played_24 = 5; } );
+      const auto& c2 = db.create<content_object>( []( content_object& c ){ c.url = "ipfs://2"; c.times_played_24 = 7; } );
+      const auto& by_popularity = db.get_index_type<content_index>().indices().get<by_popularity>();
+      BOOST_CHECK( by_popularity.begin()->id == c1.id );
+      db.modify_fields< GRAPHENE_DB_FIELD( content_object, times_played ),
+                        GRAPHENE_DB_FIELD( content_object, times_played_24 ) >( c1, []( content_object& c ){
+         ++c.times_played;
+         c.times_played_24 = 10;
+      });
+      BOOST_CHECK( by_popularity.begin()->id == c2.id );
+      BOOST_CHECK_EQUAL( 1u, c1.times_played );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( voted_streaming_platform_cache_test )
+{
+   try {
+      database db;
+      const uint32_t voted = MUSE_MAX_VOTED_STREAMING_PLATFORMS;
+      vector< streaming_platform_id_type > ids;
+      for( uint32_t i = 0; i <= voted; i++ )
+         ids.push_back( db.create<streaming_platform_object>( [i]( streaming_platform_object& sp ) {
+            sp.owner = "platform" + fc::to_string( i );
+            sp.votes = 1000 - i;
+         }).id );
+
+      BOOST_CHECK( db.is_voted_streaming_platform( ids[0] ) );
+      BOOST_CHECK( db.is_voted_streaming_platform( ids[voted - 1] ) );
+      BOOST_CHECK( !db.is_voted_streaming_platform( ids[voted] ) );
+      BOOST_CHECK( !db.is_voted_streaming_platform( "platform" + fc::to_string( voted ) ) );
+      BOOST_CHECK( !db.is_voted_streaming_platform( "nobody" ) );
+      BOOST_CHECK_EQUAL( voted, db.get_voted_streaming_platforms().size() );
+      BOOST_CHECK_EQUAL( "platform0", db.get_voted_streaming_platforms().front() );
+
+      // votes that do not change the ranking
+      db.modify( ids[voted](db), []( streaming_platform_object& sp ) { sp.votes -= 1; } );
+      BOOST_CHECK( !db.is_voted_streaming_platform( ids[voted] ) );
+
+      {
+         auto session = db._undo_db.start_undo_session();
+         db.modify( ids[voted](db), []( streaming_platform_object& sp ) { sp.votes = 2000; } );
+         BOOST_CHECK( db.is_voted_streaming_platform( ids[voted] ) );
+         BOOST_CHECK( !db.is_voted_streaming_platform( ids[voted - 1] ) );
+         BOOST_CHECK_EQUAL( "platform" + fc::to_string( voted ), db.get_voted_streaming_platforms().front() );
+         session.undo();
+      }
+      BOOST_CHECK( !db.is_voted_streaming_platform( ids[voted] ) );
+      BOOST_CHECK( db.is_voted_streaming_platform( ids[voted - 1] ) );
+
+      {
+         auto session = db._undo_db.start_undo_session();
+         db.remove( ids[0](db) );
+         BOOST_CHECK( db.is_voted_streaming_platform( ids[voted] ) );
+         session.undo();
+      }
+      BOOST_CHECK( db.is_voted_streaming_platform( ids[0] ) );
+      BOOST_CHECK( !db.is_voted_streaming_platform( ids[voted] ) );
+      BOOST_CHECK_EQUAL( "platform0", db.get_voted_streaming_platforms().front() );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( account_score_index_test )
+{
+   try {
+      database db;
+      vector< account_id_type > ids;
+      for( uint32_t i = 0; i < 4; i++ )
+         ids.push_back( db.create<account_object>( [i]( account_object& a ) {
+            a.name = "account" + fc::to_string( i );
+            a.vesting_shares = asset( ( i + 1 ) * ( i + 1 ) * 10000, VESTS_SYMBOL );
+         }).id );
+
+      const auto& expected_score = [&db]( const account_object& a ) {
+         uint64_t score = muse::chain::detail::isqrt( a.get_scoring_vesting() );
+         for( const auto& f : a.friends )
+            score += muse::chain::detail::isqrt( f(db).get_scoring_vesting() ) * MUSE_1ST_LEVEL_SCORING_PERCENTAGE / 100;
+         for( const auto& sl : a.second_level )
+            score += muse::chain::detail::isqrt( sl(db).get_scoring_vesting() ) * MUSE_2ST_LEVEL_SCORING_PERCENTAGE / 100;
+         return score;
+      };
+      const auto& check_scores = [&]() {
+         for( const auto& id : ids )
+            if( db.find( id ) != nullptr )
+               BOOST_CHECK_EQUAL( expected_score( id(db) ), db.get_scoring( id(db) ) );
+      };
+
+      BOOST_CHECK_EQUAL( 100u, db.get_scoring( ids[0](db) ) );
+      db.modify_social_graph( ids[0](db), [&ids]( account_object& a ) {
+         a.friends.insert( ids[1] );
+         a.friends.insert( ids[2] );
+         a.second_level.insert( ids[3] );
+      });
+      db.modify_social_graph( ids[1](db), [&ids]( account_object& a ) { a.friends.insert( ids[0] ); } );
+      db.modify_social_graph( ids[2](db), [&ids]( account_object& a ) {
+         a.second_level.insert( ids[0] );
+         a.second_level.insert( ids[1] );
+      });
+      check_scores();
+      BOOST_CHECK_EQUAL( 100u + 100 + 150 + 40, db.get_scoring( ids[0](db) ) );
+
+      db.modify( ids[1](db), []( account_object& a ) { a.vesting_shares.amount = 250000; } );
+      check_scores();
+
+      {
+         auto session = db._undo_db.start_undo_session();
+         db.modify( ids[2](db), []( account_object& a ) { a.vesting_shares.amount = 1; } );
+         db.modify_social_graph( ids[0](db), [&ids]( account_object& a ) {
+            a.friends.erase( ids[1] );
+            a.second_level.clear();
+         });
+         db.remove( ids[3](db) );
+         check_scores();
+         session.undo();
+      }
+      check_scores();
+
+      db.recalculate_score( ids[2](db) );
+      BOOST_CHECK_EQUAL( expected_score( ids[2](db) ), ids[2](db).score );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -2871,6 +2871,158 @@ BOOST_AUTO_TEST_CASE( split_payout_test )
    validate_database();
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE( repeated_play_payout_test )
+{ try {
+
+   initialize_clean( 5 );
+
+   ACTORS( (suzy)(uhura)(paula)(priscilla)(martha)(colette)(cora)(coreen) );
+
+   generate_block();
+
+   // pay out in MBD, paula holds some already and is due interest at the first credit
+   set_price_feed( price( ASSET( "1.000 2.28.0" ), ASSET( "1.000 2.28.2" ) ) );
+   fund( "paula", 2000000 );
+   generate_block();
+   convert( "paula", ASSET( "1.000 2.28.0" ) );
+
+   trx.set_expiration( db.head_block_time() + MUSE_MAX_TIME_UNTIL_EXPIRATION );
+
+   // --------- Create streaming platform ------------
+   {
+      fund( "suzy", MUSE_MIN_STREAMING_PLATFORM_CREATION_FEE + 300 );
+      vest( "suzy", 300 );
+      streaming_platform_update_operation spuo;
+      spuo.fee = asset( MUSE_MIN_STREAMING_PLATFORM_CREATION_FEE, MUSE_SYMBOL );
+      spuo.owner = "suzy";
+      spuo.url = "http://www.google.de";
+      trx.operations.push_back( spuo );
+      db.push_transaction( trx, database::skip_transaction_signatures  );
+      trx.operations.clear();
+   }
+
+   // --------- Create content with split payout ------------
+   {
+      content_operation cop;
+      cop.uploader = "uhura";
+      cop.url = "ipfs://abcdef1";
+      cop.album_meta.album_title = "First test song";
+      cop.track_meta.track_title = "First test song";
+      cop.comp_meta.third_party_publishers = false;
+      distribution dist;
+      dist.payee = "paula";
+      dist.bp = MUSE_100_PERCENT / 2;
+      cop.distributions.push_back( dist );
+      dist.payee = "priscilla";
+      cop.distributions.push_back( dist );
+      management_vote mgmt;
+      mgmt.voter = "martha";
+      mgmt.percentage = 100;
+      cop.management.push_back( mgmt );
+      cop.management_threshold = 100;
+      cop.playing_reward = 10;
+      cop.publishers_share = 0;
+      trx.operations.push_back( cop );
+      db.push_transaction( trx, database::skip_transaction_signatures  );
+      trx.operations.clear();
+   }
+
+   // --------- Play the same song several times ------------
+   {
+      streaming_platform_report_operation spro;
+      spro.streaming_platform = "suzy";
+      spro.content = "ipfs://abcdef1";
+      spro.consumer = "colette";
+      spro.play_time = 1000;
+      trx.operations.push_back( spro );
+      spro.play_time = 333;
+      trx.operations.push_back( spro );
+      spro.consumer = "cora";
+      spro.play_time = 3601;
+      trx.operations.push_back( spro );
+      spro.consumer = "coreen";
+      spro.play_time = 17;
+      trx.operations.push_back( spro );
+      db.push_transaction( trx, database::skip_transaction_signatures  );
+      trx.operations.clear();
+   }
+
+   BOOST_CHECK_EQUAL( 4, db.get_content( "ipfs://abcdef1" ).times_played_24 );
+
+   // every report is still split on its own, so the virtual operations are those of an unbatched payout
+   const asset paula_mbd = paula_id(db).mbd_balance;
+   const asset priscilla_mbd = priscilla_id(db).mbd_balance;
+   const asset mbd_supply = db.get_dynamic_global_properties().current_mbd_supply;
+   vector< operation > paid;
+   auto connection = db.pre_apply_operation.connect( [&paid]( const operation_object& o ) {
+      if( o.op.which() == operation::tag< content_reward_operation >::value
+            || o.op.which() == operation::tag< playing_reward_operation >::value
+            || o.op.which() == operation::tag< interest_operation >::value )
+         paid.push_back( o.op );
+   });
+
+   const auto& played_at = db.head_block_time();
+   generate_blocks( played_at + 86400 );
+   connection.disconnect();
+
+   {
+      const content_object& song1 = db.get_content( "ipfs://abcdef1" );
+      BOOST_CHECK_EQUAL( 0, song1.times_played_24 );
+      BOOST_CHECK_EQUAL( 0, db.get_index_type< report_index >().indices().size() );
+
+      share_type paula_paid = 0, priscilla_paid = 0, paula_interest = 0, mbd_created = 0;
+      int paula_interest_at = -1, paula_first_reward_at = -1;
+      for( size_t i = 0; i < paid.size(); i++ )
+      {
+         if( paid[i].which() == operation::tag< content_reward_operation >::value )
+         {
+            const auto& reward = paid[i].get< content_reward_operation >();
+            if( reward.payee == "paula" )
+            {
+               paula_paid += reward.mbd_payout.amount;
+               if( paula_first_reward_at < 0 )
+                  paula_first_reward_at = i;
+            }
+            else if( reward.payee == "priscilla" )
+               priscilla_paid += reward.mbd_payout.amount;
+            mbd_created += reward.mbd_payout.amount;
+         }
+         else if( paid[i].which() == operation::tag< playing_reward_operation >::value )
+            mbd_created += paid[i].get< playing_reward_operation >().mbd_payout.amount;
+         else
+         {
+            const auto& interest = paid[i].get< interest_operation >();
+            BOOST_CHECK_EQUAL( "paula", interest.owner );
+            paula_interest += interest.interest.amount;
+            mbd_created += interest.interest.amount;
+            paula_interest_at = i;
+         }
+      }
+
+      // interest is paid at the first credit, as it was when every report was paid out on its own
+      BOOST_CHECK_LE( 0, paula_interest_at );
+      BOOST_CHECK_LT( paula_interest_at, paula_first_reward_at );
+
+      // balances and supply add up to exactly what the per report virtual operations say
+      BOOST_CHECK_LT( 0, paula_paid.value );
+      BOOST_CHECK_EQUAL( ( paula_mbd.amount + paula_paid + paula_interest ).value, paula_id(db).mbd_balance.amount.value );
+      BOOST_CHECK_EQUAL( ( priscilla_mbd.amount + priscilla_paid ).value, priscilla_id(db).mbd_balance.amount.value );
+      BOOST_CHECK_EQUAL( ( mbd_supply.amount + mbd_created ).value,
+                         db.get_dynamic_global_properties().current_mbd_supply.amount.value );
+
+      // both payees get the same share of every single report, at most one satoshi is left over
+      BOOST_CHECK_EQUAL( paula_paid.value, priscilla_paid.value );
+      BOOST_CHECK_LE( 0, song1.accumulated_balance_master.amount.value );
+      BOOST_CHECK_GE( 1, song1.accumulated_balance_master.amount.value );
+
+      BOOST_CHECK_EQUAL( 0, colette_id(db).total_listening_time );
+      BOOST_CHECK_EQUAL( 0, cora_id(db).total_listening_time );
+      BOOST_CHECK_EQUAL( 0, coreen_id(db).total_listening_time );
+   }
+
+   validate_database();
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE( anon_user_test )
 { try {
 